@@ -0,0 +1,957 @@
+/*
+ * assetpacker.c
+ *
+ * Packs the PNGs and GIFs in a directory into the assets.bin image which is
+ * flashed to ASSETS_ADDR and read by firmware/user/utils/assets.c
+ *
+ * assets.bin is laid out as
+ *   uint32_t numIndexItems
+ *   numIndexItems * { char name[16]; uint32_t address; uint32_t length; }
+ *   asset data, each starting on a 32 bit boundary
+ *
+ * PNGs are
+ *   uint32_t width | (encoding << 16)
+ *   uint32_t height
+ *   PNG_ENC_VLC:    the pixel stream, packed MSB first into 32 bit words,
+ *                   where 1 is black, 01 is transparent and 00 is white
+ *   PNG_ENC_FASTLZ: uint32_t length of the pixel stream, then the pixel
+ *                   stream compressed with FastLZ
+ *
+ * GIFs are
+ *   uint32_t width, height, nFrames, duration
+ *   nFrames * { uint32_t compressedLen; compressed data padded to 32 bits }
+ *   Each frame is a 1bpp bitmap compressed with FastLZ. Every frame after the
+ *   first is XORed with the one before it.
+ *
+ * Raycaster maps (.rmp) are already in their packed format, written by
+ * mapconv, so they are copied as-is.
+ *
+ * Anything else, like the flight sim's .obj, can't be packed here. With -b,
+ * those assets are copied from a base image made by the Python packer.
+ * Otherwise they fail the pack, since the firmware can't run without them.
+ *
+ * Identical assets are only stored once, their index entries point to the
+ * same data. Assets are converted in parallel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#define STBI_ONLY_PNG
+#define STBI_ONLY_GIF
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "fastlz_compress.h"
+
+/*==============================================================================
+ * Defines, Enums
+ *============================================================================*/
+
+#define ASSET_NAME_LEN 16
+#define INDEX_ENTRY_LEN (ASSET_NAME_LEN + (2 * sizeof(uint32_t)))
+
+// Keep these in sync with assets.h
+#define PNG_ENC_VLC    0
+#define PNG_ENC_FASTLZ 1
+
+// Compressing a PNG costs a decompression every time it's loaded, so only do
+// it when it saves at least this much, in bytes or as a fraction of the size
+#define MIN_FASTLZ_SAVINGS      32
+#define MIN_FASTLZ_SAVINGS_FRAC 8
+
+#define DEFAULT_ASSETS_SIZE 0x51000
+
+typedef enum
+{
+    AT_PNG,
+    AT_GIF,
+    AT_RAW,
+    AT_BASE,
+    AT_UNSUPPORTED,
+} assetType_t;
+
+typedef struct
+{
+    char path[512];
+    char name[ASSET_NAME_LEN];
+    assetType_t type;
+
+    // The packed data, not padded
+    uint8_t* blob;
+    uint32_t blobLen;
+    uint32_t hash;
+
+    // For the report
+    uint16_t width;
+    uint16_t height;
+    uint16_t nFrames;
+    uint32_t rawLen;
+    const char* encoding;
+    char error[128];
+
+    // Where this asset's data ends up in assets.bin
+    int dupOf;
+    uint32_t address;
+} asset_t;
+
+typedef struct
+{
+    asset_t* assets;
+    int numAssets;
+    int nextAsset;
+} workQueue_t;
+
+typedef struct
+{
+    uint8_t* data;
+    uint32_t len;
+    uint32_t cap;
+} byteBuf_t;
+
+/*==============================================================================
+ * Prototypes
+ *============================================================================*/
+
+int main(int argc, char** argv);
+static int findAssets(const char* dir, asset_t** assets);
+static int loadBaseAssets(const char* baseFile, asset_t** assets, int numAssets);
+static void* convertWorker(void* arg);
+static void convertAsset(asset_t* asset);
+static bool convertPng(asset_t* asset);
+static bool convertGif(asset_t* asset);
+static bool convertRaw(asset_t* asset);
+static int compressBest(const uint8_t* in, int len, uint8_t* out);
+static bool isWhite(const uint8_t* rgba);
+static void bufAppend(byteBuf_t* buf, const void* data, uint32_t len);
+static void bufAppendU32(byteBuf_t* buf, uint32_t val);
+static void bufPad(byteBuf_t* buf);
+static uint32_t fnv1a(const uint8_t* data, uint32_t len);
+static void dedupAssets(asset_t* assets, int numAssets);
+static uint32_t writeAssets(const char* outFile, asset_t* assets, int numAssets);
+static void printReport(asset_t* assets, int numAssets, uint32_t totalLen, uint32_t budget);
+
+/*==============================================================================
+ * Functions
+ *============================================================================*/
+
+int main(int argc, char** argv)
+{
+    const char* assetDir = "assets";
+    const char* outFile = "assets.bin";
+    const char* baseFile = NULL;
+    uint32_t budget = DEFAULT_ASSETS_SIZE;
+    long numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool quiet = false;
+
+    int opt;
+    while(-1 != (opt = getopt(argc, argv, "d:o:b:s:j:q")))
+    {
+        switch(opt)
+        {
+            case 'd':
+            {
+                assetDir = optarg;
+                break;
+            }
+            case 'o':
+            {
+                outFile = optarg;
+                break;
+            }
+            case 'b':
+            {
+                baseFile = optarg;
+                break;
+            }
+            case 's':
+            {
+                budget = strtoul(optarg, NULL, 0);
+                break;
+            }
+            case 'j':
+            {
+                numThreads = strtol(optarg, NULL, 0);
+                break;
+            }
+            case 'q':
+            {
+                quiet = true;
+                break;
+            }
+            default:
+            {
+                fprintf(stderr, "Usage: %s [-d asset_dir] [-o assets.bin] [-b base.bin] [-s max_size] [-j threads] [-q]\n", argv[0]);
+                return 1;
+            }
+        }
+    }
+    if(numThreads < 1)
+    {
+        numThreads = 1;
+    }
+
+    // Find everything to pack, sorted by name so the output is reproducible
+    asset_t* assets = NULL;
+    int numAssets = findAssets(assetDir, &assets);
+    if(numAssets < 0)
+    {
+        return 1;
+    }
+
+    // Fill in what can't be packed here from the base image
+    if(NULL != baseFile)
+    {
+        numAssets = loadBaseAssets(baseFile, &assets, numAssets);
+        if(numAssets < 0)
+        {
+            return 1;
+        }
+    }
+
+    // Convert all the assets in parallel
+    workQueue_t queue =
+    {
+        .assets = assets,
+        .numAssets = numAssets,
+        .nextAsset = 0,
+    };
+    pthread_t threads[numThreads];
+    for(long t = 0; t < numThreads; t++)
+    {
+        pthread_create(&threads[t], NULL, convertWorker, &queue);
+    }
+    for(long t = 0; t < numThreads; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    // Check for errors
+    int errors = 0;
+    for(int i = 0; i < numAssets; i++)
+    {
+        if(assets[i].error[0])
+        {
+            fprintf(stderr, "%s: %s\n", assets[i].path, assets[i].error);
+            errors++;
+        }
+    }
+    if(errors)
+    {
+        return 1;
+    }
+
+    dedupAssets(assets, numAssets);
+    uint32_t totalLen = writeAssets(outFile, assets, numAssets);
+    if(0 == totalLen)
+    {
+        return 1;
+    }
+
+    if(!quiet)
+    {
+        printReport(assets, numAssets, totalLen, budget);
+    }
+
+    for(int i = 0; i < numAssets; i++)
+    {
+        free(assets[i].blob);
+    }
+    free(assets);
+
+    if(totalLen > budget)
+    {
+        fprintf(stderr, "%s is %u bytes, which doesn't fit in %u bytes\n", outFile, totalLen, budget);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Find all the files in a directory which should be packed
+ *
+ * @param dir    The directory to scan
+ * @param assets Will be pointed to an allocated array of assets
+ * @return The number of assets found, or -1 on error
+ */
+static int findAssets(const char* dir, asset_t** assets)
+{
+    struct dirent** entries;
+    int numEntries = scandir(dir, &entries, NULL, alphasort);
+    if(numEntries < 0)
+    {
+        fprintf(stderr, "Could not open %s\n", dir);
+        return -1;
+    }
+
+    *assets = calloc(numEntries, sizeof(asset_t));
+    int numAssets = 0;
+    for(int i = 0; i < numEntries; i++)
+    {
+        const char* fname = entries[i]->d_name;
+        const char* ext = strrchr(fname, '.');
+        if(DT_DIR != entries[i]->d_type && '.' != fname[0] && NULL != ext)
+        {
+            asset_t* asset = &(*assets)[numAssets++];
+            snprintf(asset->path, sizeof(asset->path), "%s/%s", dir, fname);
+            snprintf(asset->name, sizeof(asset->name), "%.*s", ASSET_NAME_LEN - 1, fname);
+            asset->dupOf = -1;
+
+            if(strlen(fname) >= ASSET_NAME_LEN)
+            {
+                asset->type = AT_UNSUPPORTED;
+                snprintf(asset->error, sizeof(asset->error), "name is longer than %d characters", ASSET_NAME_LEN - 1);
+            }
+            else if(0 == strcasecmp(ext, ".png"))
+            {
+                asset->type = AT_PNG;
+            }
+            else if(0 == strcasecmp(ext, ".gif"))
+            {
+                asset->type = AT_GIF;
+            }
+            else if(0 == strcasecmp(ext, ".rmp"))
+            {
+                asset->type = AT_RAW;
+            }
+            else
+            {
+                asset->type = AT_UNSUPPORTED;
+                snprintf(asset->error, sizeof(asset->error), "unsupported file type, pack it into a base image with -b");
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return numAssets;
+}
+
+/**
+ * Copy assets from a base image. Assets which can't be packed here take the
+ * base's version, and anything only in the base is added. Assets which can
+ * be packed here are, so the base's version is ignored
+ *
+ * @param baseFile  The base image, an assets.bin
+ * @param assets    The assets found so far, may be reallocated
+ * @param numAssets The number of assets found so far
+ * @return The new number of assets, or -1 on error
+ */
+static int loadBaseAssets(const char* baseFile, asset_t** assets, int numAssets)
+{
+    FILE* fp = fopen(baseFile, "rb");
+    if(NULL == fp)
+    {
+        fprintf(stderr, "Could not open %s\n", baseFile);
+        return -1;
+    }
+    fseek(fp, 0L, SEEK_END);
+    long sz = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+    uint8_t* base = malloc(sz);
+    if(sz < 4 || 1 != fread(base, sz, 1, fp))
+    {
+        fprintf(stderr, "Could not read %s\n", baseFile);
+        free(base);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+#define RD32(p) ((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+    uint32_t numIndexItems = RD32(base);
+    if(numIndexItems > (sz - sizeof(uint32_t)) / INDEX_ENTRY_LEN)
+    {
+        fprintf(stderr, "%s isn't an assets.bin\n", baseFile);
+        free(base);
+        return -1;
+    }
+
+    for(uint32_t i = 0; i < numIndexItems; i++)
+    {
+        const uint8_t* entry = &base[sizeof(uint32_t) + (i * INDEX_ENTRY_LEN)];
+        char name[ASSET_NAME_LEN];
+        snprintf(name, sizeof(name), "%.*s", ASSET_NAME_LEN - 1, (const char*)entry);
+        uint32_t address = RD32(&entry[ASSET_NAME_LEN]);
+        uint32_t length = RD32(&entry[ASSET_NAME_LEN + sizeof(uint32_t)]);
+        if(address > (uint32_t)sz || length > (uint32_t)sz - address)
+        {
+            fprintf(stderr, "%s: %s is out of bounds\n", baseFile, name);
+            free(base);
+            return -1;
+        }
+
+        // Find the file this came from
+        asset_t* asset = NULL;
+        for(int j = 0; j < numAssets; j++)
+        {
+            if(0 == strcmp((*assets)[j].name, name))
+            {
+                asset = &(*assets)[j];
+                break;
+            }
+        }
+
+        if(NULL == asset)
+        {
+            // Only in the base, keep it
+            *assets = realloc(*assets, (numAssets + 1) * sizeof(asset_t));
+            asset = &(*assets)[numAssets++];
+            memset(asset, 0, sizeof(asset_t));
+            snprintf(asset->path, sizeof(asset->path), "%s:%s", baseFile, name);
+            snprintf(asset->name, sizeof(asset->name), "%s", name);
+            asset->dupOf = -1;
+        }
+        else if(AT_UNSUPPORTED != asset->type || strlen(strrchr(asset->path, '/') + 1) >= ASSET_NAME_LEN)
+        {
+            // Packed here instead, or too long a name for the base to be the same file
+            continue;
+        }
+
+        asset->type = AT_BASE;
+        asset->error[0] = 0;
+        asset->blob = malloc(length ? length : 1);
+        memcpy(asset->blob, &base[address], length);
+        asset->blobLen = length;
+        asset->rawLen = length;
+        asset->nFrames = 1;
+        asset->encoding = "base";
+    }
+#undef RD32
+
+    free(base);
+    return numAssets;
+}
+
+/**
+ * Thread function, converts assets from the queue until there are none left
+ *
+ * @param arg The workQueue_t
+ * @return NULL
+ */
+static void* convertWorker(void* arg)
+{
+    workQueue_t* queue = (workQueue_t*)arg;
+    int idx;
+    while((idx = __atomic_fetch_add(&queue->nextAsset, 1, __ATOMIC_RELAXED)) < queue->numAssets)
+    {
+        convertAsset(&queue->assets[idx]);
+    }
+    return NULL;
+}
+
+/**
+ * Convert a single asset to the packed format
+ *
+ * @param asset The asset to convert
+ */
+static void convertAsset(asset_t* asset)
+{
+    bool success = false;
+    switch(asset->type)
+    {
+        case AT_PNG:
+        {
+            success = convertPng(asset);
+            break;
+        }
+        case AT_GIF:
+        {
+            success = convertGif(asset);
+            break;
+        }
+        case AT_RAW:
+        {
+            success = convertRaw(asset);
+            break;
+        }
+        case AT_BASE:
+        {
+            // Already copied from the base image
+            success = true;
+            break;
+        }
+        case AT_UNSUPPORTED:
+        default:
+        {
+            return;
+        }
+    }
+
+    if(success)
+    {
+        asset->hash = fnv1a(asset->blob, asset->blobLen);
+    }
+    else if(!asset->error[0])
+    {
+        snprintf(asset->error, sizeof(asset->error), "could not load: %s", stbi_failure_reason());
+    }
+}
+
+/**
+ * Convert a PNG to either the variable length pixel stream or a FastLZ
+ * compressed version of that stream, whichever is better
+ *
+ * @param asset The asset to convert
+ * @return true if it was converted, false if there was an error
+ */
+static bool convertPng(asset_t* asset)
+{
+    int w, h, n;
+    uint8_t* rgba = stbi_load(asset->path, &w, &h, &n, 4);
+    if(NULL == rgba)
+    {
+        return false;
+    }
+    asset->width = w;
+    asset->height = h;
+    asset->nFrames = 1;
+
+    // Each pixel is at most two bits
+    uint32_t numWords = ((2 * w * h) + 31) / 32;
+    uint32_t* words = calloc(numWords, sizeof(uint32_t));
+    uint32_t bitIdx = 0;
+    for(int i = 0; i < w * h; i++)
+    {
+        const uint8_t* px = &rgba[4 * i];
+        if(px[3] < 0x80)
+        {
+            // Transparent is 01
+            bitIdx++;
+            words[bitIdx / 32] |= (0x80000000 >> (bitIdx % 32));
+            bitIdx++;
+        }
+        else if(isWhite(px))
+        {
+            // White is 00
+            bitIdx += 2;
+        }
+        else
+        {
+            // Black is 1
+            words[bitIdx / 32] |= (0x80000000 >> (bitIdx % 32));
+            bitIdx++;
+        }
+    }
+    stbi_image_free(rgba);
+
+    // The stream as it's laid out in memory, whole words
+    uint32_t streamLen = sizeof(uint32_t) * ((bitIdx + 31) / 32);
+    uint8_t stream[streamLen + 4];
+    for(uint32_t i = 0; i < streamLen / 4; i++)
+    {
+        stream[(4 * i) + 0] = (words[i] >> 0) & 0xFF;
+        stream[(4 * i) + 1] = (words[i] >> 8) & 0xFF;
+        stream[(4 * i) + 2] = (words[i] >> 16) & 0xFF;
+        stream[(4 * i) + 3] = (words[i] >> 24) & 0xFF;
+    }
+    free(words);
+    asset->rawLen = streamLen;
+
+    // Try compressing it
+    uint8_t compressed[streamLen + (streamLen / 16) + 66];
+    int compressedLen = compressBest(stream, streamLen, compressed);
+    uint32_t minSavings = streamLen / MIN_FASTLZ_SAVINGS_FRAC;
+    if(minSavings < MIN_FASTLZ_SAVINGS)
+    {
+        minSavings = MIN_FASTLZ_SAVINGS;
+    }
+
+    byteBuf_t buf = {0};
+    if(compressedLen > 0 && compressedLen + sizeof(uint32_t) + minSavings <= streamLen)
+    {
+        asset->encoding = "fastlz";
+        bufAppendU32(&buf, w | (PNG_ENC_FASTLZ << 16));
+        bufAppendU32(&buf, h);
+        bufAppendU32(&buf, streamLen);
+        bufAppend(&buf, compressed, compressedLen);
+    }
+    else
+    {
+        asset->encoding = "vlc";
+        bufAppendU32(&buf, w | (PNG_ENC_VLC << 16));
+        bufAppendU32(&buf, h);
+        bufAppend(&buf, stream, streamLen);
+    }
+    asset->blob = buf.data;
+    asset->blobLen = buf.len;
+    return true;
+}
+
+/**
+ * Convert a GIF to a sequence of FastLZ compressed 1bpp delta frames
+ *
+ * @param asset The asset to convert
+ * @return true if it was converted, false if there was an error
+ */
+static bool convertGif(asset_t* asset)
+{
+    FILE* fp = fopen(asset->path, "rb");
+    if(NULL == fp)
+    {
+        return false;
+    }
+    fseek(fp, 0L, SEEK_END);
+    long sz = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+    uint8_t* file = malloc(sz);
+    if(1 != fread(file, sz, 1, fp))
+    {
+        free(file);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+
+    int w, h, nFrames, n;
+    int* delays = NULL;
+    uint8_t* rgba = stbi_load_gif_from_memory(file, sz, &delays, &w, &h, &nFrames, &n, 4);
+    free(file);
+    if(NULL == rgba)
+    {
+        return false;
+    }
+    asset->width = w;
+    asset->height = h;
+    asset->nFrames = nFrames;
+
+    // This matches allocedSize in loadGifFromAsset()
+    uint32_t frameLen = ((w * h) + 8) / 8;
+    uint8_t prev[frameLen];
+    uint8_t frame[frameLen];
+    uint8_t delta[frameLen];
+    uint8_t compressed[frameLen + (frameLen / 16) + 66];
+    memset(prev, 0, frameLen);
+
+    byteBuf_t buf = {0};
+    bufAppendU32(&buf, w);
+    bufAppendU32(&buf, h);
+    bufAppendU32(&buf, nFrames);
+    bufAppendU32(&buf, (NULL != delays) ? delays[0] : 0);
+
+    for(int f = 0; f < nFrames; f++)
+    {
+        // Pack this frame into a bitmap, 1 is white
+        memset(frame, 0, frameLen);
+        const uint8_t* px = &rgba[4 * w * h * f];
+        for(int i = 0; i < w * h; i++)
+        {
+            if(isWhite(&px[4 * i]))
+            {
+                frame[i / 8] |= (0x80 >> (i % 8));
+            }
+        }
+
+        // The first frame is stored as-is, the rest are deltas
+        for(uint32_t i = 0; i < frameLen; i++)
+        {
+            delta[i] = (0 == f) ? frame[i] : (frame[i] ^ prev[i]);
+        }
+        memcpy(prev, frame, frameLen);
+
+        int compressedLen = compressBest(delta, frameLen, compressed);
+        bufAppendU32(&buf, compressedLen);
+        bufAppend(&buf, compressed, compressedLen);
+        bufPad(&buf);
+    }
+    asset->rawLen = frameLen * nFrames;
+    asset->encoding = "fastlz-delta";
+    asset->blob = buf.data;
+    asset->blobLen = buf.len;
+
+    stbi_image_free(rgba);
+    free(delays);
+    return true;
+}
+
+/**
+ * Compress data with both FastLZ levels and keep the smaller result. Both
+ * decompress at the same speed
+ *
+ * @param in  The data to compress
+ * @param len The length of the data to compress
+ * @param out The buffer to write compressed data to
+ * @return The length of the compressed data
+ */
+static int compressBest(const uint8_t* in, int len, uint8_t* out)
+{
+    uint8_t l2[len + (len / 16) + 66];
+    int l1Len = fastlz_compress_level(1, in, len, out);
+    int l2Len = fastlz_compress_level(2, in, len, l2);
+    if(l2Len < l1Len)
+    {
+        memcpy(out, l2, l2Len);
+        return l2Len;
+    }
+    return l1Len;
+}
+
+/**
+ * Copy an asset which is already in its packed format
+ *
+ * @param asset The asset to copy
+ * @return true if it was copied, false if there was an error
+ */
+static bool convertRaw(asset_t* asset)
+{
+    FILE* fp = fopen(asset->path, "rb");
+    if(NULL == fp)
+    {
+        snprintf(asset->error, sizeof(asset->error), "could not open");
+        return false;
+    }
+    fseek(fp, 0L, SEEK_END);
+    long sz = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+
+    byteBuf_t buf = {0};
+    uint8_t* data = malloc(sz);
+    if(sz > 0 && 1 != fread(data, sz, 1, fp))
+    {
+        snprintf(asset->error, sizeof(asset->error), "read error");
+        free(data);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+    bufAppend(&buf, data, sz);
+    free(data);
+
+    asset->nFrames = 1;
+    asset->rawLen = sz;
+    asset->encoding = "raw";
+    asset->blob = buf.data;
+    asset->blobLen = buf.len;
+    return true;
+}
+
+/**
+ * @param rgba A pixel
+ * @return true if the pixel should be white on the OLED, false for black
+ */
+static bool isWhite(const uint8_t* rgba)
+{
+    return ((rgba[0] + rgba[1] + rgba[2]) / 3) >= 0x80;
+}
+
+/**
+ * Append data to a growable buffer
+ *
+ * @param buf  The buffer to append to
+ * @param data The data to append
+ * @param len  The length of the data
+ */
+static void bufAppend(byteBuf_t* buf, const void* data, uint32_t len)
+{
+    if(buf->len + len > buf->cap)
+    {
+        buf->cap = (buf->len + len) * 2;
+        buf->data = realloc(buf->data, buf->cap);
+    }
+    memcpy(&buf->data[buf->len], data, len);
+    buf->len += len;
+}
+
+/**
+ * Append a little endian uint32_t to a growable buffer
+ *
+ * @param buf The buffer to append to
+ * @param val The value to append
+ */
+static void bufAppendU32(byteBuf_t* buf, uint32_t val)
+{
+    uint8_t le[4] = {val & 0xFF, (val >> 8) & 0xFF, (val >> 16) & 0xFF, (val >> 24) & 0xFF};
+    bufAppend(buf, le, sizeof(le));
+}
+
+/**
+ * Pad a growable buffer with zeros to a 32 bit boundary
+ *
+ * @param buf The buffer to pad
+ */
+static void bufPad(byteBuf_t* buf)
+{
+    const uint8_t zeros[4] = {0};
+    bufAppend(buf, zeros, (4 - (buf->len % 4)) % 4);
+}
+
+/**
+ * @param data The data to hash
+ * @param len  The length of the data
+ * @return The 32 bit FNV-1a hash of the data
+ */
+static uint32_t fnv1a(const uint8_t* data, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    for(uint32_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Find assets whose packed data is identical to an earlier asset
+ *
+ * @param assets    The assets
+ * @param numAssets The number of assets
+ */
+static void dedupAssets(asset_t* assets, int numAssets)
+{
+    for(int i = 0; i < numAssets; i++)
+    {
+        if(NULL == assets[i].blob)
+        {
+            continue;
+        }
+        for(int j = 0; j < i; j++)
+        {
+            if(-1 == assets[j].dupOf &&
+                    NULL != assets[j].blob &&
+                    assets[i].hash == assets[j].hash &&
+                    assets[i].blobLen == assets[j].blobLen &&
+                    0 == memcmp(assets[i].blob, assets[j].blob, assets[i].blobLen))
+            {
+                assets[i].dupOf = j;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Lay out and write assets.bin
+ *
+ * @param outFile   The file to write
+ * @param assets    The assets, already converted and deduplicated
+ * @param numAssets The number of assets
+ * @return The length of the written file, or 0 on error
+ */
+static uint32_t writeAssets(const char* outFile, asset_t* assets, int numAssets)
+{
+    // Count the assets which will actually be in the index
+    uint32_t numIndexItems = 0;
+    for(int i = 0; i < numAssets; i++)
+    {
+        if(NULL != assets[i].blob)
+        {
+            numIndexItems++;
+        }
+    }
+
+    // Assign addresses, duplicates share their original's address
+    uint32_t address = sizeof(uint32_t) + (numIndexItems * INDEX_ENTRY_LEN);
+    for(int i = 0; i < numAssets; i++)
+    {
+        if(NULL == assets[i].blob)
+        {
+            continue;
+        }
+        else if(-1 != assets[i].dupOf)
+        {
+            assets[i].address = assets[assets[i].dupOf].address;
+        }
+        else
+        {
+            assets[i].address = address;
+            address += (assets[i].blobLen + 3) & ~3;
+        }
+    }
+
+    byteBuf_t buf = {0};
+    bufAppendU32(&buf, numIndexItems);
+    for(int i = 0; i < numAssets; i++)
+    {
+        if(NULL != assets[i].blob)
+        {
+            bufAppend(&buf, assets[i].name, ASSET_NAME_LEN);
+            bufAppendU32(&buf, assets[i].address);
+            bufAppendU32(&buf, assets[i].blobLen);
+        }
+    }
+    for(int i = 0; i < numAssets; i++)
+    {
+        if(NULL != assets[i].blob && -1 == assets[i].dupOf)
+        {
+            bufAppend(&buf, assets[i].blob, assets[i].blobLen);
+            bufPad(&buf);
+        }
+    }
+
+    FILE* fp = fopen(outFile, "wb");
+    if(NULL == fp || 1 != fwrite(buf.data, buf.len, 1, fp))
+    {
+        fprintf(stderr, "Could not write %s\n", outFile);
+        if(NULL != fp)
+        {
+            fclose(fp);
+        }
+        free(buf.data);
+        return 0;
+    }
+    fclose(fp);
+    free(buf.data);
+    return address;
+}
+
+/**
+ * Print what was packed, how, and how much space it takes
+ *
+ * @param assets    The assets
+ * @param numAssets The number of assets
+ * @param totalLen  The length of assets.bin
+ * @param budget    The size of the flash partition for assets
+ */
+static void printReport(asset_t* assets, int numAssets, uint32_t totalLen, uint32_t budget)
+{
+    uint32_t rawTotal = 0;
+    uint32_t packedTotal = 0;
+    uint32_t dedupTotal = 0;
+
+    printf("%-16s %9s %6s %-12s %8s %8s\n", "name", "size", "frames", "encoding", "raw", "packed");
+    for(int i = 0; i < numAssets; i++)
+    {
+        asset_t* asset = &assets[i];
+        if(NULL == asset->blob)
+        {
+            printf("%-16s %s\n", asset->name, "skipped");
+            continue;
+        }
+
+        char dims[16];
+        if(0 == asset->width)
+        {
+            snprintf(dims, sizeof(dims), "-");
+        }
+        else
+        {
+            snprintf(dims, sizeof(dims), "%dx%d", asset->width, asset->height);
+        }
+        printf("%-16s %9s %6d %-12s %8u %8u", asset->name, dims, asset->nFrames,
+               asset->encoding, asset->rawLen, asset->blobLen);
+        if(-1 != asset->dupOf)
+        {
+            printf(" (same as %s)", assets[asset->dupOf].name);
+            dedupTotal += asset->blobLen;
+        }
+        else
+        {
+            packedTotal += asset->blobLen;
+        }
+        rawTotal += asset->rawLen;
+        printf("\n");
+    }
+
+    printf("\n");
+    printf("Raw pixel data:      %8u bytes\n", rawTotal);
+    printf("Packed asset data:   %8u bytes\n", packedTotal);
+    printf("Saved by dedup:      %8u bytes\n", dedupTotal);
+    printf("Total with index:    %8u bytes, %.1f%% of 0x%X\n", totalLen,
+           (100.0f * totalLen) / budget, budget);
+}
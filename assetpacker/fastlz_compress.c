@@ -0,0 +1,321 @@
+/*
+  FastLZ - lightning-fast lossless compression library
+
+  Copyright (C) 2007 Ariya Hidayat (ariya@kde.org)
+  Copyright (C) 2006 Ariya Hidayat (ariya@kde.org)
+  Copyright (C) 2005 Ariya Hidayat (ariya@kde.org)
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/*
+ * This is the compressor half of FastLZ, the firmware only carries the
+ * decompressor (firmware/user/utils/fastlz.c). Both compression levels are
+ * folded into one function here, the output is bit-exact with the original.
+ * The hash table is on the stack, so this is safe to call from many threads
+ */
+
+#include <stdint.h>
+#include "fastlz_compress.h"
+
+typedef uint8_t  flzuint8;
+typedef uint16_t flzuint16;
+typedef uint32_t flzuint32;
+
+#define HASH_LOG  13
+#define HASH_SIZE (1 << HASH_LOG)
+#define HASH_MASK (HASH_SIZE - 1)
+
+#define FASTLZ_READU16(p) ((p)[0] | (p)[1] << 8)
+#define HASH_FUNCTION(v, p) { v = FASTLZ_READU16(p); v ^= FASTLZ_READU16(p + 1) ^ (v >> (16 - HASH_LOG)); v &= HASH_MASK; }
+
+#define MAX_COPY        32
+#define MAX_LEN         264  /* 256 + 8 */
+#define MAX_DISTANCE_L1 8192
+#define MAX_DISTANCE_L2 8191
+#define MAX_FARDISTANCE (65535 + MAX_DISTANCE_L2 - 1)
+
+int fastlz_compress_level(int level, const void* input, int length, void* output)
+{
+    const flzuint8* ip = (const flzuint8*) input;
+    const flzuint8* ip_bound = ip + length - 2;
+    const flzuint8* ip_limit = ip + length - 12;
+    flzuint8* op = (flzuint8*) output;
+    flzuint32 maxDistance = (level == 1) ? MAX_DISTANCE_L1 : MAX_DISTANCE_L2;
+
+    const flzuint8* htab[HASH_SIZE];
+    const flzuint8** hslot;
+    flzuint32 hval;
+
+    flzuint32 copy;
+
+    if(level != 1 && level != 2)
+    {
+        return 0;
+    }
+
+    /* sanity check */
+    if(length < 4)
+    {
+        if(length)
+        {
+            /* create literal copy only */
+            *op++ = length - 1;
+            ip_bound++;
+            while(ip <= ip_bound)
+            {
+                *op++ = *ip++;
+            }
+            return length + 1;
+        }
+        return 0;
+    }
+
+    /* initializes hash table */
+    for (hslot = htab; hslot < htab + HASH_SIZE; hslot++)
+    {
+        *hslot = ip;
+    }
+
+    /* we start with literal copy */
+    copy = 2;
+    *op++ = MAX_COPY - 1;
+    *op++ = *ip++;
+    *op++ = *ip++;
+
+    /* main loop */
+    while(ip < ip_limit)
+    {
+        const flzuint8* ref;
+        flzuint32 distance;
+
+        /* minimum match length */
+        flzuint32 len = 3;
+
+        /* comparison starting-point */
+        const flzuint8* anchor = ip;
+
+        /* check for a run */
+        if(level == 2 && ip[0] == ip[-1] && FASTLZ_READU16(ip - 1) == FASTLZ_READU16(ip + 1))
+        {
+            distance = 1;
+            ip += 3;
+            ref = anchor - 1 + 3;
+            goto match;
+        }
+
+        /* find potential match */
+        HASH_FUNCTION(hval, ip);
+        hslot = htab + hval;
+        ref = htab[hval];
+
+        /* calculate distance to the match */
+        distance = anchor - ref;
+
+        /* update hash table */
+        *hslot = anchor;
+
+        /* is this a match? check the first 3 bytes */
+        if(distance == 0 ||
+                (level == 1 ? (distance >= MAX_DISTANCE_L1) : (distance >= MAX_FARDISTANCE)) ||
+                *ref++ != *ip++ || *ref++ != *ip++ || *ref++ != *ip++)
+        {
+            goto literal;
+        }
+
+        /* far, needs at least 5-byte match */
+        if(level == 2 && distance >= MAX_DISTANCE_L2)
+        {
+            if(*ip++ != *ref++ || *ip++ != *ref++)
+            {
+                goto literal;
+            }
+            len += 2;
+        }
+
+match:
+        /* last matched byte */
+        ip = anchor + len;
+
+        /* distance is biased */
+        distance--;
+
+        if(!distance)
+        {
+            /* zero distance means a run */
+            flzuint8 x = ip[-1];
+            while(ip < ip_bound)
+            {
+                if(*ref++ != x)
+                {
+                    break;
+                }
+                ip++;
+            }
+        }
+        else
+        {
+            /* safe because the outer check against ip limit */
+            while(ip < ip_bound)
+            {
+                if(*ref++ != *ip++)
+                {
+                    break;
+                }
+            }
+        }
+
+        /* if we have copied something, adjust the copy count */
+        if(copy)
+        {
+            /* copy is biased, '0' means 1 byte copy */
+            *(op - copy - 1) = copy - 1;
+        }
+        else
+        {
+            /* back, to overwrite the copy count */
+            op--;
+        }
+
+        /* reset literal counter */
+        copy = 0;
+
+        /* length is biased, '1' means a match of 3 bytes */
+        ip -= 3;
+        len = ip - anchor;
+
+        /* encode the match */
+        if(level == 2)
+        {
+            if(distance < maxDistance)
+            {
+                if(len < 7)
+                {
+                    *op++ = (len << 5) + (distance >> 8);
+                    *op++ = (distance & 255);
+                }
+                else
+                {
+                    *op++ = (7 << 5) + (distance >> 8);
+                    for(len -= 7; len >= 255; len -= 255)
+                    {
+                        *op++ = 255;
+                    }
+                    *op++ = len;
+                    *op++ = (distance & 255);
+                }
+            }
+            else
+            {
+                /* far away, but not yet in the another galaxy... */
+                distance -= maxDistance;
+                if(len < 7)
+                {
+                    *op++ = (len << 5) + 31;
+                }
+                else
+                {
+                    *op++ = (7 << 5) + 31;
+                    for(len -= 7; len >= 255; len -= 255)
+                    {
+                        *op++ = 255;
+                    }
+                    *op++ = len;
+                }
+                *op++ = 255;
+                *op++ = distance >> 8;
+                *op++ = distance & 255;
+            }
+        }
+        else
+        {
+            while(len > MAX_LEN - 2)
+            {
+                *op++ = (7 << 5) + (distance >> 8);
+                *op++ = MAX_LEN - 2 - 7 - 2;
+                *op++ = (distance & 255);
+                len -= MAX_LEN - 2;
+            }
+
+            if(len < 7)
+            {
+                *op++ = (len << 5) + (distance >> 8);
+                *op++ = (distance & 255);
+            }
+            else
+            {
+                *op++ = (7 << 5) + (distance >> 8);
+                *op++ = len - 7;
+                *op++ = (distance & 255);
+            }
+        }
+
+        /* update the hash at match boundary */
+        HASH_FUNCTION(hval, ip);
+        htab[hval] = ip++;
+        HASH_FUNCTION(hval, ip);
+        htab[hval] = ip++;
+
+        /* assuming literal copy */
+        *op++ = MAX_COPY - 1;
+
+        continue;
+
+literal:
+        *op++ = *anchor++;
+        ip = anchor;
+        copy++;
+        if(copy == MAX_COPY)
+        {
+            copy = 0;
+            *op++ = MAX_COPY - 1;
+        }
+    }
+
+    /* left-over as literal copy */
+    ip_bound++;
+    while(ip <= ip_bound)
+    {
+        *op++ = *ip++;
+        copy++;
+        if(copy == MAX_COPY)
+        {
+            copy = 0;
+            *op++ = MAX_COPY - 1;
+        }
+    }
+
+    /* if we have copied something, adjust the copy length */
+    if(copy)
+    {
+        *(op - copy - 1) = copy - 1;
+    }
+    else
+    {
+        op--;
+    }
+
+    /* marker for fastlz2 */
+    if(level == 2)
+    {
+        *(flzuint8*)output |= (1 << 5);
+    }
+
+    return op - (flzuint8*)output;
+}
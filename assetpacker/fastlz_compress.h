@@ -0,0 +1,24 @@
+#ifndef FASTLZ_COMPRESS_H
+#define FASTLZ_COMPRESS_H
+
+/**
+  Compress a block of data in the input buffer and returns the size of
+  compressed block. The size of input buffer is specified by length.
+
+  The output buffer must be at least 5% larger than the input buffer
+  and can not be smaller than 66 bytes.
+
+  If the input is not compressible, the return value might be larger than
+  length (input buffer size).
+
+  The input buffer and the output buffer can not overlap.
+
+  Compression level can be specified in parameter level. Level 1 is the
+  fastest compression and generally useful for short data. Level 2 is
+  slightly slower but it gives better compression ratio. Both can be
+  decompressed with fastlz_decompress() on the Swadge.
+*/
+
+int fastlz_compress_level(int level, const void* input, int length, void* output);
+
+#endif
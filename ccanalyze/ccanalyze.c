@@ -0,0 +1,683 @@
+/*
+ * ccanalyze.c
+ *
+ * Runs a WAV or raw PCM file through the same ColorChord sources the firmware
+ * uses (DFT32.c, embeddednf.c, embeddedbeat.c and embeddedout.c), as fast as it can, and
+ * writes what ColorChord saw each frame. This is for tuning CCSettings
+ * against recordings and for benchmarking the DSP without a Swadge or a mic.
+ *
+ * Audio is mixed down to mono and linearly resampled to DFREQ. It is then
+ * scaled so 16 bit full scale matches a full scale ADC reading after the
+ * filter in procTask(), and amplified by INITIAL_AMP like the firmware does.
+ * Every 128 samples is one frame, just like colorchordSampleHandler()
+ *
+ * The CSV output has one row per frame
+ *   frame, time, NUM_LIN_LEDS * { g, r, b }, MAXNOTES * { freq },
+ *   MAXNOTES * { amp }, bpm, beat_phase, beat_conf, beat_count, [cents]
+ *
+ * The binary output has one record per frame, little endian
+ *   uint32_t frame
+ *   MAXNOTES * { uint8_t note_peak_freqs }
+ *   MAXNOTES * { uint16_t note_peak_amps }
+ *   NUM_LIN_LEDS * 3 * { uint8_t ledOut }
+ *   uint16_t beat_bpm
+ *   uint16_t beat_phase
+ *   uint8_t beat_confidence
+ *   uint32_t beat_count
+ *   [int16_t cents]
+ *
+ * cents is only there with -p BIN. It's PeakOffsetCents() around
+ * fuzzed_bins[BIN], unfiltered, which is what tunernome's tuners start from.
+ * It's for measuring how quickly and how accurately pitch estimates settle
+ *
+ * Throughput is printed to stderr when the file is done
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "user_main.h"
+#include "embeddednf.h"
+#include "embeddedout.h"
+#include "embeddedbeat.h"
+#include "mode_colorchord.h"
+
+/*==============================================================================
+ * Defines, Enums
+ *============================================================================*/
+
+#define SAMPLES_PER_FRAME 128
+#define READ_FRAMES       4096
+
+typedef enum
+{
+    OUT_CSV,
+    OUT_BIN,
+    OUT_NONE,
+} outFormat_t;
+
+typedef struct
+{
+    FILE* fp;
+    uint32_t rate;
+    uint16_t channels;
+    uint16_t bitsPerSample;
+    uint32_t dataLeft; ///< Bytes of audio left to read, UINT32_MAX for raw PCM
+} audioIn_t;
+
+typedef struct
+{
+    const char* name;
+    size_t offset;
+} ccSetting_t;
+
+/*==============================================================================
+ * Variables
+ *============================================================================*/
+
+// Same defaults as mode_colorchord.c
+struct CCSettings CCS =
+{
+    .gSETTINGS_KEY         = 0,
+    .gROOT_NOTE_OFFSET     = 0,
+    .gDFTIIR               = 6,
+    .gFUZZ_IIR_BITS        = 1,
+    .gFILTER_BLUR_PASSES   = 2,
+    .gSEMIBITSPERBIN       = 3,
+    .gMAX_JUMP_DISTANCE    = 4,
+    .gMAX_COMBINE_DISTANCE = 7,
+    .gAMP_1_IIR_BITS       = 4,
+    .gAMP_2_IIR_BITS       = 2,
+    .gMIN_AMP_FOR_NOTE     = 80,
+    .gMINIMUM_AMP_FOR_NOTE_TO_DISAPPEAR = 64,
+    .gNOTE_FINAL_AMP       = 12,
+    .gNERF_NOTE_PORP       = 15,
+    .gUSE_NUM_LIN_LEDS     = NUM_LIN_LEDS,
+    .gCOLORCHORD_ACTIVE    = 1,
+    .gCOLORCHORD_OUTPUT_DRIVER = 1,
+    .gINITIAL_AMP          = AMP_OFFSET + (AMP_STEP_SIZE * (AMP_STEPS / 2))
+};
+
+#define CC_SETTING(n) { #n, offsetof(struct CCSettings, g##n) }
+static const ccSetting_t ccSettings[] =
+{
+    CC_SETTING(ROOT_NOTE_OFFSET),
+    CC_SETTING(DFTIIR),
+    CC_SETTING(FUZZ_IIR_BITS),
+    CC_SETTING(FILTER_BLUR_PASSES),
+    CC_SETTING(SEMIBITSPERBIN),
+    CC_SETTING(MAX_JUMP_DISTANCE),
+    CC_SETTING(MAX_COMBINE_DISTANCE),
+    CC_SETTING(AMP_1_IIR_BITS),
+    CC_SETTING(AMP_2_IIR_BITS),
+    CC_SETTING(MIN_AMP_FOR_NOTE),
+    CC_SETTING(MINIMUM_AMP_FOR_NOTE_TO_DISAPPEAR),
+    CC_SETTING(NOTE_FINAL_AMP),
+    CC_SETTING(NERF_NOTE_PORP),
+    CC_SETTING(USE_NUM_LIN_LEDS),
+    CC_SETTING(COLORCHORD_OUTPUT_DRIVER),
+    CC_SETTING(INITIAL_AMP),
+};
+
+// The fuzzed_bins[] index to estimate the pitch around, or -1 for none
+static int pitchBin = -1;
+
+/*==============================================================================
+ * Prototypes
+ *============================================================================*/
+
+int main(int argc, char** argv);
+static bool setCcSetting(const char* arg);
+static bool openAudio(const char* fname, uint32_t rawRate, uint16_t rawChannels, audioIn_t* in);
+static uint32_t readU32(const uint8_t* b);
+static uint16_t readU16(const uint8_t* b);
+static int readMono(audioIn_t* in, int32_t* out, int maxFrames);
+static void processFrame(const int16_t* samples);
+static void writeFrame(FILE* out, outFormat_t fmt, uint32_t frame);
+static double nowSeconds(void);
+
+/*==============================================================================
+ * Functions
+ *============================================================================*/
+
+int main(int argc, char** argv)
+{
+    const char* outFile = NULL;
+    outFormat_t fmt = OUT_CSV;
+    uint32_t rawRate = DFREQ;
+    uint16_t rawChannels = 1;
+
+    int opt;
+    while(-1 != (opt = getopt(argc, argv, "o:f:r:c:s:p:")))
+    {
+        switch(opt)
+        {
+            case 'o':
+            {
+                outFile = optarg;
+                break;
+            }
+            case 'f':
+            {
+                if(0 == strcasecmp(optarg, "csv"))
+                {
+                    fmt = OUT_CSV;
+                }
+                else if(0 == strcasecmp(optarg, "bin"))
+                {
+                    fmt = OUT_BIN;
+                }
+                else if(0 == strcasecmp(optarg, "none"))
+                {
+                    fmt = OUT_NONE;
+                }
+                else
+                {
+                    fprintf(stderr, "Unknown format %s, use csv, bin or none\n", optarg);
+                    return -1;
+                }
+                break;
+            }
+            case 'r':
+            {
+                rawRate = strtoul(optarg, NULL, 0);
+                break;
+            }
+            case 'c':
+            {
+                rawChannels = strtoul(optarg, NULL, 0);
+                break;
+            }
+            case 's':
+            {
+                if(!setCcSetting(optarg))
+                {
+                    return -1;
+                }
+                break;
+            }
+            case 'p':
+            {
+                pitchBin = strtol(optarg, NULL, 0);
+                if(pitchBin < 1 || pitchBin > FIXBINS - 2)
+                {
+                    fprintf(stderr, "Pitch bin must be from 1 to %d\n", FIXBINS - 2);
+                    return -1;
+                }
+                break;
+            }
+            default:
+            {
+                fprintf(stderr, "Usage: %s [-o out_file] [-f csv|bin|none] [-r raw_rate] [-c raw_channels] "
+                        "[-s SETTING=value]... [-p pitch_bin] in.wav|in.raw\n", argv[0]);
+                return -1;
+            }
+        }
+    }
+
+    if(optind >= argc)
+    {
+        fprintf(stderr, "No input file\n");
+        return -1;
+    }
+
+    audioIn_t in = {0};
+    if(!openAudio(argv[optind], rawRate, rawChannels, &in))
+    {
+        return -1;
+    }
+
+    FILE* out = stdout;
+    if(NULL != outFile)
+    {
+        out = fopen(outFile, (OUT_BIN == fmt) ? "wb" : "w");
+        if(NULL == out)
+        {
+            fprintf(stderr, "Couldn't open %s\n", outFile);
+            fclose(in.fp);
+            return -1;
+        }
+    }
+
+    if(OUT_CSV == fmt)
+    {
+        fprintf(out, "frame,time");
+        for(int i = 0; i < NUM_LIN_LEDS; i++)
+        {
+            fprintf(out, ",led%d_g,led%d_r,led%d_b", i, i, i);
+        }
+        for(int i = 0; i < MAXNOTES; i++)
+        {
+            fprintf(out, ",freq%d", i);
+        }
+        for(int i = 0; i < MAXNOTES; i++)
+        {
+            fprintf(out, ",amp%d", i);
+        }
+        fprintf(out, ",bpm,beat_phase,beat_conf,beat_count");
+        if(0 <= pitchBin)
+        {
+            fprintf(out, ",cents");
+        }
+        fprintf(out, "\n");
+    }
+
+    InitColorChord();
+
+    // Resample with a 16.16 step, carrying the last input sample between reads
+    uint32_t step = (uint32_t)(((uint64_t)in.rate << 16) / DFREQ);
+    uint32_t phase = 0;
+    int32_t prev = 0;
+
+    int32_t mono[READ_FRAMES];
+    int16_t samples[SAMPLES_PER_FRAME];
+    int numSamples = 0;
+    uint32_t frame = 0;
+    uint64_t totalSamples = 0;
+    double dspTime = 0;
+    double tStart = nowSeconds();
+
+    int numRead;
+    while(0 < (numRead = readMono(&in, mono, READ_FRAMES)))
+    {
+        // phase is the position between prev (0) and mono[0] (1 << 16)
+        for(int i = 0; i < numRead; )
+        {
+            if(phase >= (1 << 16))
+            {
+                phase -= (1 << 16);
+                prev = mono[i++];
+                continue;
+            }
+
+            int32_t cur = mono[i];
+            int32_t s = prev + (int32_t)(((int64_t)(cur - prev) * phase) >> 16);
+            phase += step;
+
+            // Full scale 16 bit is a full scale ADC reading after procTask()'s
+            // filter, then amplify it the same way
+            s = ((s >> 4) * CCS.gINITIAL_AMP) >> 4;
+            // DFT32 only takes -4095 to +4095
+            if(s > 4095)
+            {
+                s = 4095;
+            }
+            else if(s < -4095)
+            {
+                s = -4095;
+            }
+            samples[numSamples++] = s;
+
+            if(SAMPLES_PER_FRAME == numSamples)
+            {
+                double t = nowSeconds();
+                processFrame(samples);
+                dspTime += nowSeconds() - t;
+
+                writeFrame(out, fmt, frame);
+                frame++;
+                totalSamples += numSamples;
+                numSamples = 0;
+            }
+        }
+    }
+
+    double wallTime = nowSeconds() - tStart;
+    double audioTime = (double)totalSamples / DFREQ;
+    fprintf(stderr, "%u frames, %.2f s of audio\n", frame, audioTime);
+    if(dspTime > 0)
+    {
+        fprintf(stderr, "DSP:   %.3f s, %.0f samples/s, %.1fx real time\n",
+                dspTime, totalSamples / dspTime, audioTime / dspTime);
+    }
+    if(wallTime > 0)
+    {
+        fprintf(stderr, "Total: %.3f s, %.0f samples/s, %.1fx real time\n",
+                wallTime, totalSamples / wallTime, audioTime / wallTime);
+    }
+
+    if(stdout != out)
+    {
+        fclose(out);
+    }
+    fclose(in.fp);
+    return 0;
+}
+
+/**
+ * Set one of the CCSettings from a NAME=value argument
+ *
+ * @param arg The argument, i.e. DFTIIR=6
+ * @return true if the setting was set, false if it is unknown
+ */
+static bool setCcSetting(const char* arg)
+{
+    const char* eq = strchr(arg, '=');
+    if(NULL != eq)
+    {
+        for(uint32_t i = 0; i < sizeof(ccSettings) / sizeof(ccSettings[0]); i++)
+        {
+            if(strlen(ccSettings[i].name) == (size_t)(eq - arg) &&
+                    0 == strncasecmp(ccSettings[i].name, arg, eq - arg))
+            {
+                ((uint8_t*)&CCS)[ccSettings[i].offset] = strtoul(eq + 1, NULL, 0);
+                return true;
+            }
+        }
+    }
+
+    fprintf(stderr, "Unknown setting %s, use one of\n", arg);
+    for(uint32_t i = 0; i < sizeof(ccSettings) / sizeof(ccSettings[0]); i++)
+    {
+        fprintf(stderr, "  %s=%d\n", ccSettings[i].name, ((uint8_t*)&CCS)[ccSettings[i].offset]);
+    }
+    return false;
+}
+
+/**
+ * Open an audio file. WAV files are read by their header, anything else is
+ * treated as signed 16 bit little endian PCM
+ *
+ * @param fname       The file to open
+ * @param rawRate     The sample rate for raw PCM
+ * @param rawChannels The number of channels for raw PCM
+ * @param in          Filled in with the open file and its format
+ * @return true if the file was opened and can be read, false otherwise
+ */
+static bool openAudio(const char* fname, uint32_t rawRate, uint16_t rawChannels, audioIn_t* in)
+{
+    in->fp = fopen(fname, "rb");
+    if(NULL == in->fp)
+    {
+        fprintf(stderr, "Couldn't open %s\n", fname);
+        return false;
+    }
+
+    uint8_t hdr[12];
+    if(sizeof(hdr) != fread(hdr, 1, sizeof(hdr), in->fp) ||
+            0 != memcmp(hdr, "RIFF", 4) || 0 != memcmp(&hdr[8], "WAVE", 4))
+    {
+        // Not a WAV, so it's raw PCM from the top
+        rewind(in->fp);
+        in->rate = rawRate;
+        in->channels = rawChannels;
+        in->bitsPerSample = 16;
+        in->dataLeft = UINT32_MAX;
+    }
+    else
+    {
+        // Walk the chunks until the data, picking up the format on the way
+        bool gotFmt = false;
+        while(true)
+        {
+            uint8_t chunk[8];
+            if(sizeof(chunk) != fread(chunk, 1, sizeof(chunk), in->fp))
+            {
+                fprintf(stderr, "%s has no data chunk\n", fname);
+                fclose(in->fp);
+                return false;
+            }
+            uint32_t chunkLen = readU32(&chunk[4]);
+
+            if(0 == memcmp(chunk, "fmt ", 4) && chunkLen >= 16)
+            {
+                uint8_t fmt[16];
+                if(sizeof(fmt) != fread(fmt, 1, sizeof(fmt), in->fp))
+                {
+                    fprintf(stderr, "%s has a truncated format\n", fname);
+                    fclose(in->fp);
+                    return false;
+                }
+                // 1 is PCM, 0xFFFE is WAVE_FORMAT_EXTENSIBLE which is PCM for our purposes
+                uint16_t format = readU16(&fmt[0]);
+                in->channels = readU16(&fmt[2]);
+                in->rate = readU32(&fmt[4]);
+                in->bitsPerSample = readU16(&fmt[14]);
+                if((1 != format && 0xFFFE != format) || (8 != in->bitsPerSample && 16 != in->bitsPerSample))
+                {
+                    fprintf(stderr, "%s isn't 8 or 16 bit PCM\n", fname);
+                    fclose(in->fp);
+                    return false;
+                }
+                fseek(in->fp, (chunkLen - 16) + (chunkLen & 1), SEEK_CUR);
+                gotFmt = true;
+            }
+            else if(0 == memcmp(chunk, "data", 4))
+            {
+                if(!gotFmt)
+                {
+                    fprintf(stderr, "%s has data before its format\n", fname);
+                    fclose(in->fp);
+                    return false;
+                }
+                in->dataLeft = chunkLen;
+                break;
+            }
+            else
+            {
+                // Chunks are padded to an even length
+                fseek(in->fp, chunkLen + (chunkLen & 1), SEEK_CUR);
+            }
+        }
+    }
+
+    if(0 == in->rate || 0 == in->channels)
+    {
+        fprintf(stderr, "%s has a bad sample rate or channel count\n", fname);
+        fclose(in->fp);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @param b Four bytes, little endian
+ * @return the 32 bit word
+ */
+static uint32_t readU32(const uint8_t* b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+/**
+ * @param b Two bytes, little endian
+ * @return the 16 bit word
+ */
+static uint16_t readU16(const uint8_t* b)
+{
+    return b[0] | (b[1] << 8);
+}
+
+/**
+ * Read audio and mix it down to one channel of signed 16 bit samples
+ *
+ * @param in        The audio to read
+ * @param out       Where to write the mono samples
+ * @param maxFrames The most samples to write
+ * @return the number of samples written, 0 at the end of the audio
+ */
+static int readMono(audioIn_t* in, int32_t* out, int maxFrames)
+{
+    uint8_t raw[READ_FRAMES * 2 * 8];
+    uint32_t bytesPerFrame = in->channels * (in->bitsPerSample / 8);
+    uint32_t maxBytes = maxFrames * bytesPerFrame;
+    if(maxBytes > sizeof(raw))
+    {
+        maxBytes = (sizeof(raw) / bytesPerFrame) * bytesPerFrame;
+    }
+    if(maxBytes > in->dataLeft)
+    {
+        maxBytes = in->dataLeft;
+    }
+
+    int numFrames = fread(raw, 1, maxBytes, in->fp) / bytesPerFrame;
+    if(UINT32_MAX != in->dataLeft)
+    {
+        in->dataLeft -= numFrames * bytesPerFrame;
+    }
+
+    const uint8_t* b = raw;
+    for(int i = 0; i < numFrames; i++)
+    {
+        int32_t sum = 0;
+        for(int c = 0; c < in->channels; c++)
+        {
+            if(8 == in->bitsPerSample)
+            {
+                // 8 bit WAVs are unsigned
+                sum += ((int32_t)(*b) - 128) << 8;
+                b++;
+            }
+            else
+            {
+                sum += (int16_t)readU16(b);
+                b += 2;
+            }
+        }
+        out[i] = sum / in->channels;
+    }
+    return numFrames;
+}
+
+/**
+ * Run one frame of audio through ColorChord, the same way
+ * colorchordSampleHandler() does
+ *
+ * @param samples SAMPLES_PER_FRAME samples
+ */
+static void processFrame(const int16_t* samples)
+{
+    PushSamples32(samples, SAMPLES_PER_FRAME);
+    HandleFrameInfo();
+    HandleBeatFrame();
+
+    switch(COLORCHORD_OUTPUT_DRIVER)
+    {
+        default:
+        case 0:
+        {
+            UpdateLinearLEDs();
+            break;
+        }
+        case 1:
+        {
+            UpdateAllSameLEDs();
+            break;
+        }
+        case 2:
+        {
+            UpdateBeatLEDs();
+            break;
+        }
+    }
+}
+
+/**
+ * Write the notes and LEDs for the last frame
+ *
+ * @param out   The file to write to
+ * @param fmt   The format to write in
+ * @param frame The frame number
+ */
+static void writeFrame(FILE* out, outFormat_t fmt, uint32_t frame)
+{
+    int16_t cents = 0;
+    if(0 <= pitchBin)
+    {
+        cents = PeakOffsetCents(fuzzed_bins[pitchBin - 1], fuzzed_bins[pitchBin], fuzzed_bins[pitchBin + 1]);
+    }
+
+    switch(fmt)
+    {
+        case OUT_CSV:
+        {
+            fprintf(out, "%u,%.4f", frame, (double)(frame * SAMPLES_PER_FRAME) / DFREQ);
+            for(int i = 0; i < NUM_LIN_LEDS * 3; i++)
+            {
+                fprintf(out, ",%d", ledOut[i]);
+            }
+            for(int i = 0; i < MAXNOTES; i++)
+            {
+                fprintf(out, ",%d", note_peak_freqs[i]);
+            }
+            for(int i = 0; i < MAXNOTES; i++)
+            {
+                fprintf(out, ",%d", note_peak_amps[i]);
+            }
+            fprintf(out, ",%d,%d,%d,%u", beat_bpm, beat_phase, beat_confidence, beat_count);
+            if(0 <= pitchBin)
+            {
+                fprintf(out, ",%d", cents);
+            }
+            fprintf(out, "\n");
+            break;
+        }
+        case OUT_BIN:
+        {
+            uint8_t rec[4 + MAXNOTES + (MAXNOTES * 2) + (NUM_LIN_LEDS * 3) + 9 + 2];
+            uint8_t* r = rec;
+            for(int i = 0; i < 4; i++)
+            {
+                *(r++) = (frame >> (8 * i)) & 0xFF;
+            }
+            memcpy(r, note_peak_freqs, MAXNOTES);
+            r += MAXNOTES;
+            for(int i = 0; i < MAXNOTES; i++)
+            {
+                *(r++) = note_peak_amps[i] & 0xFF;
+                *(r++) = note_peak_amps[i] >> 8;
+            }
+            memcpy(r, ledOut, NUM_LIN_LEDS * 3);
+            r += NUM_LIN_LEDS * 3;
+            *(r++) = beat_bpm & 0xFF;
+            *(r++) = beat_bpm >> 8;
+            *(r++) = beat_phase & 0xFF;
+            *(r++) = beat_phase >> 8;
+            *(r++) = beat_confidence;
+            for(int i = 0; i < 4; i++)
+            {
+                *(r++) = (beat_count >> (8 * i)) & 0xFF;
+            }
+            if(0 <= pitchBin)
+            {
+                *(r++) = cents & 0xFF;
+                *(r++) = (cents >> 8) & 0xFF;
+            }
+            fwrite(rec, r - rec, 1, out);
+            break;
+        }
+        case OUT_NONE:
+        default:
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * @return a monotonic time in seconds
+ */
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+// The ColorChord sources call these, which are in ROM on the ESP8266
+void* ets_memset(void* s, int c, size_t n)
+{
+    return memset(s, c, n);
+}
+
+void* ets_memcpy(void* dest, const void* src, size_t n)
+{
+    return memcpy(dest, src, n);
+}
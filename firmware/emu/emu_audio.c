@@ -0,0 +1,423 @@
+//Audio sources for the emulator's mic, see emu_audio.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "emu_audio.h"
+
+#ifndef DFREQ
+    #define DFREQ 16000
+#endif
+
+//Peak amplitude of everything synthesized, out of 32767
+#define EMU_AUDIO_AMP 8192
+
+typedef enum
+{
+    EA_MIC,
+    EA_SILENCE,
+    EA_WAV,
+    EA_TONE,
+    EA_SWEEP,
+} emuAudioType_t;
+
+static struct
+{
+    emuAudioType_t type;
+
+    //Tones and chords
+    int numTones;
+    double freqs[EMU_AUDIO_MAX_TONES];
+    double phases[EMU_AUDIO_MAX_TONES];
+
+    //Sweeps
+    double sweepFrom;
+    double sweepTo;
+    double sweepSec;
+
+    //WAV files, already mono and at DFREQ
+    int16_t* wav;
+    uint32_t wavLen;
+    uint32_t wavPos;
+
+    //White noise, 0 for none
+    double noiseRms;
+    uint32_t noiseSeed;
+
+    //The emulator clock
+    uint32_t startUs;
+    uint64_t rendered;
+} ea =
+{
+    .type = EA_MIC,
+};
+
+static bool emuAudioLoadWav( const char* fname );
+static double emuAudioSignalRms( void );
+static double emuAudioNoise( void );
+
+/**
+ * Pick what the mic hears
+ *
+ * @param spec The source, as described in emu_audio.h
+ * @return true if the source was set, false if spec is bad
+ */
+bool emuAudioSetSource( const char* spec )
+{
+    char buf[512];
+    snprintf( buf, sizeof( buf ), "%s", spec );
+
+    //Split off the SNR
+    double snr = -1;
+    char* at = strrchr( buf, '@' );
+    if( at )
+    {
+        *at = 0;
+        snr = atof( at + 1 );
+    }
+
+    char* arg = strchr( buf, ':' );
+    if( arg )
+    {
+        *(arg++) = 0;
+    }
+
+    if( 0 == strcmp( buf, "mic" ) )
+    {
+        ea.type = EA_MIC;
+        return true;
+    }
+    else if( 0 == strcmp( buf, "silence" ) )
+    {
+        ea.type = EA_SILENCE;
+    }
+    else if( 0 == strcmp( buf, "wav" ) && arg )
+    {
+        if( !emuAudioLoadWav( arg ) )
+        {
+            return false;
+        }
+        ea.type = EA_WAV;
+    }
+    else if( ( 0 == strcmp( buf, "tone" ) || 0 == strcmp( buf, "chord" ) ) && arg )
+    {
+        //Every frequency must parse and be below Nyquist, and there must be one
+        double freqs[EMU_AUDIO_MAX_TONES];
+        int numTones = 0;
+        char* tok;
+        for( tok = strtok( arg, "," ); tok && numTones < EMU_AUDIO_MAX_TONES; tok = strtok( NULL, "," ) )
+        {
+            char* end;
+            double f = strtod( tok, &end );
+            if( end == tok || *end || f <= 0 || f >= DFREQ / 2 )
+            {
+                fprintf( stderr, "Bad frequency \"%s\" in \"%s\", must be between 0 and %d Hz\n", tok, spec, DFREQ / 2 );
+                return false;
+            }
+            freqs[numTones++] = f;
+        }
+        if( 0 == numTones )
+        {
+            fprintf( stderr, "No frequencies in \"%s\"\n", spec );
+            return false;
+        }
+        memcpy( ea.freqs, freqs, sizeof( freqs[0] ) * numTones );
+        ea.numTones = numTones;
+        ea.type = EA_TONE;
+    }
+    else if( 0 == strcmp( buf, "sweep" ) && arg &&
+             3 == sscanf( arg, "%lf,%lf,%lf", &ea.sweepFrom, &ea.sweepTo, &ea.sweepSec ) &&
+             ea.sweepFrom > 0 && ea.sweepTo > 0 && ea.sweepSec > 0 &&
+             ea.sweepFrom < DFREQ / 2 && ea.sweepTo < DFREQ / 2 )
+    {
+        ea.numTones = 1;
+        ea.type = EA_SWEEP;
+    }
+    else
+    {
+        fprintf( stderr, "Unknown audio source \"%s\", see emu_audio.h\n", spec );
+        return false;
+    }
+
+    //Scale the noise to the signal. Silence gets noise as loud as a full tone
+    ea.noiseRms = 0;
+    if( snr >= 0 )
+    {
+        double rms = ( EA_SILENCE == ea.type ) ? EMU_AUDIO_AMP / sqrt( 2 ) : emuAudioSignalRms();
+        ea.noiseRms = rms / pow( 10, snr / 20 );
+    }
+    return true;
+}
+
+/**
+ * @return true if the sound card's mic is the source, false if the emulator
+ * makes the samples
+ */
+bool emuAudioIsMic( void )
+{
+    return EA_MIC == ea.type;
+}
+
+/**
+ * Restart the source, the next sample is due at nowUs
+ *
+ * @param nowUs The emulator's time, from system_get_time()
+ */
+void emuAudioStart( uint32_t nowUs )
+{
+    int i;
+    ea.startUs = nowUs;
+    ea.rendered = 0;
+    ea.wavPos = 0;
+    ea.noiseSeed = 0x2021;
+    for( i = 0; i < EMU_AUDIO_MAX_TONES; i++ )
+    {
+        ea.phases[i] = 0;
+    }
+}
+
+/**
+ * Render every sample which is due by nowUs, at DFREQ since emuAudioStart()
+ *
+ * @param nowUs      The emulator's time, from system_get_time()
+ * @param out        Where to write the samples
+ * @param maxSamples The most samples to write
+ * @return the number of samples written
+ */
+int emuAudioRender( uint32_t nowUs, int16_t* out, int maxSamples )
+{
+    uint64_t due = ( (uint64_t)( nowUs - ea.startUs ) * DFREQ ) / 1000000;
+    if( due <= ea.rendered )
+    {
+        return 0;
+    }
+
+    //If the emulator stalled for longer than the caller can take, drop the
+    //oldest samples like an overrun ADC would
+    uint64_t owed = due - ea.rendered;
+    if( owed > (uint64_t)maxSamples )
+    {
+        ea.rendered = due - maxSamples;
+        owed = maxSamples;
+    }
+
+    int i, j;
+    for( i = 0; i < (int)owed; i++ )
+    {
+        double v = 0;
+        switch( ea.type )
+        {
+            case EA_WAV:
+            {
+                v = ea.wav[ea.wavPos];
+                ea.wavPos = ( ea.wavPos + 1 ) % ea.wavLen;
+                break;
+            }
+            case EA_SWEEP:
+            {
+                //Where this sample is in the sweep, which repeats
+                uint64_t sweepLen = (uint64_t)( ea.sweepSec * DFREQ );
+                double t = (double)( ( ea.rendered + i ) % ( sweepLen ? sweepLen : 1 ) ) / DFREQ;
+                ea.freqs[0] = ea.sweepFrom * pow( ea.sweepTo / ea.sweepFrom, t / ea.sweepSec );
+            }
+            // fall through
+            case EA_TONE:
+            {
+                for( j = 0; j < ea.numTones; j++ )
+                {
+                    v += sin( 2 * M_PI * ea.phases[j] );
+                    ea.phases[j] += ea.freqs[j] / DFREQ;
+                    ea.phases[j] -= floor( ea.phases[j] );
+                }
+                v *= EMU_AUDIO_AMP / ea.numTones;
+                break;
+            }
+            case EA_MIC:
+            case EA_SILENCE:
+            default:
+            {
+                break;
+            }
+        }
+
+        if( ea.noiseRms > 0 )
+        {
+            v += ea.noiseRms * emuAudioNoise();
+        }
+
+        if( v > 32767 )
+        {
+            v = 32767;
+        }
+        else if( v < -32768 )
+        {
+            v = -32768;
+        }
+        out[i] = (int16_t)v;
+    }
+
+    ea.rendered += owed;
+    return owed;
+}
+
+/**
+ * Load a WAV, mix it to mono and resample it to DFREQ
+ *
+ * @param fname The WAV file
+ * @return true if it was loaded, false otherwise
+ */
+static bool emuAudioLoadWav( const char* fname )
+{
+    FILE* f = fopen( fname, "rb" );
+    if( !f )
+    {
+        fprintf( stderr, "Couldn't open %s\n", fname );
+        return false;
+    }
+    fseek( f, 0, SEEK_END );
+    long len = ftell( f );
+    fseek( f, 0, SEEK_SET );
+    uint8_t* file = malloc( len );
+    if( !file || len != (long)fread( file, 1, len, f ) )
+    {
+        fprintf( stderr, "Couldn't read %s\n", fname );
+        free( file );
+        fclose( f );
+        return false;
+    }
+    fclose( f );
+
+#define RD16(p) ( (p)[0] | ( (p)[1] << 8 ) )
+#define RD32(p) ( RD16(p) | ( (uint32_t)RD16( (p) + 2 ) << 16 ) )
+    int channels = 0, bits = 0, rate = 0;
+    uint8_t* data = NULL;
+    uint32_t dataLen = 0;
+    if( len >= 12 && 0 == memcmp( file, "RIFF", 4 ) && 0 == memcmp( file + 8, "WAVE", 4 ) )
+    {
+        long pos = 12;
+        while( pos + 8 <= len )
+        {
+            uint32_t clen = RD32( file + pos + 4 );
+            if( clen > (uint32_t)( len - pos - 8 ) )
+            {
+                clen = len - pos - 8;
+            }
+            if( 0 == memcmp( file + pos, "fmt ", 4 ) && clen >= 16 )
+            {
+                channels = RD16( file + pos + 10 );
+                rate = RD32( file + pos + 12 );
+                bits = RD16( file + pos + 22 );
+            }
+            else if( 0 == memcmp( file + pos, "data", 4 ) )
+            {
+                data = file + pos + 8;
+                dataLen = clen;
+                break;
+            }
+            pos += 8 + clen + ( clen & 1 );
+        }
+    }
+#undef RD16
+#undef RD32
+
+    if( !data || channels < 1 || rate < 1 || ( 8 != bits && 16 != bits ) )
+    {
+        fprintf( stderr, "%s isn't an 8 or 16 bit PCM WAV\n", fname );
+        free( file );
+        return false;
+    }
+
+    //Mix down to mono
+    uint32_t frameBytes = channels * bits / 8;
+    uint32_t numFrames = dataLen / frameBytes;
+    int32_t* mono = malloc( ( numFrames + 1 ) * sizeof( int32_t ) );
+    uint32_t i;
+    int c;
+    for( i = 0; i < numFrames; i++ )
+    {
+        int32_t sum = 0;
+        for( c = 0; c < channels; c++ )
+        {
+            uint8_t* s = data + ( i * frameBytes ) + ( c * bits / 8 );
+            sum += ( 8 == bits ) ? ( ( s[0] - 128 ) << 8 ) : (int16_t)( s[0] | ( s[1] << 8 ) );
+        }
+        mono[i] = sum / channels;
+    }
+    mono[numFrames] = numFrames ? mono[0] : 0;
+    free( file );
+
+    //Linearly resample to DFREQ
+    free( ea.wav );
+    ea.wavLen = (uint32_t)( ( (uint64_t)numFrames * DFREQ ) / rate );
+    if( 0 == ea.wavLen )
+    {
+        fprintf( stderr, "%s is empty\n", fname );
+        free( mono );
+        ea.wav = NULL;
+        return false;
+    }
+    ea.wav = malloc( ea.wavLen * sizeof( int16_t ) );
+    for( i = 0; i < ea.wavLen; i++ )
+    {
+        double src = (double)i * rate / DFREQ;
+        uint32_t idx = (uint32_t)src;
+        double frac = src - idx;
+        ea.wav[i] = (int16_t)( mono[idx] + ( mono[idx + 1] - mono[idx] ) * frac );
+    }
+    free( mono );
+    return true;
+}
+
+/**
+ * @return the RMS of the current source without noise, for setting the SNR
+ */
+static double emuAudioSignalRms( void )
+{
+    switch( ea.type )
+    {
+        case EA_WAV:
+        {
+            double sum = 0;
+            uint32_t i;
+            for( i = 0; i < ea.wavLen; i++ )
+            {
+                sum += (double)ea.wav[i] * ea.wav[i];
+            }
+            return sqrt( sum / ea.wavLen );
+        }
+        case EA_TONE:
+        case EA_SWEEP:
+        {
+            //Each tone is a sine with a peak of EMU_AUDIO_AMP / numTones
+            return ( EMU_AUDIO_AMP / ea.numTones ) * sqrt( ea.numTones / 2.0 );
+        }
+        case EA_MIC:
+        case EA_SILENCE:
+        default:
+        {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @return gaussian white noise with an RMS of 1, from a fixed seed so it's
+ * the same every run
+ */
+static double emuAudioNoise( void )
+{
+    //The sum of 12 uniforms is close to gaussian, with a variance of 1
+    double sum = 0;
+    int i;
+    for( i = 0; i < 12; i++ )
+    {
+        //xorshift32
+        ea.noiseSeed ^= ea.noiseSeed << 13;
+        ea.noiseSeed ^= ea.noiseSeed >> 17;
+        ea.noiseSeed ^= ea.noiseSeed << 5;
+        sum += ea.noiseSeed / 4294967296.0;
+    }
+    return sum - 6;
+}
@@ -0,0 +1,31 @@
+#ifndef _EMU_AUDIO_H
+#define _EMU_AUDIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//What the emulator's mic hears. Pick one with "swadgemu --audio SPEC"
+//
+// mic                      The sound card's capture device (default)
+// silence                  Nothing at all
+// wav:FILE                 A WAV file, looped
+// tone:HZ                  A sine wave
+// chord:HZ,HZ,...          Up to EMU_AUDIO_MAX_TONES sine waves at once
+// sweep:FROM,TO,SECONDS    An exponential sine sweep, repeated
+//
+//Every frequency must be above 0 and below DFREQ / 2, or the source is
+//rejected.
+//
+//Any of them but mic may end with @DB to add white noise at that SNR, i.e.
+//"chord:261.63,329.63,392@20". Everything but mic is made on the emulator's
+//clock at exactly DFREQ and is the same every run, so it works without a
+//sound card.
+
+#define EMU_AUDIO_MAX_TONES 8
+
+bool emuAudioSetSource( const char* spec );
+bool emuAudioIsMic( void );
+void emuAudioStart( uint32_t nowUs );
+int emuAudioRender( uint32_t nowUs, int16_t* out, int maxSamples );
+
+#endif
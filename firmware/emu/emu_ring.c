@@ -0,0 +1,129 @@
+//Lock-free SPSC ring buffer, see emu_ring.h
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "emu_ring.h"
+
+/**
+ * Copy elements into or out of the ring, in up to two chunks around the end
+ *
+ * @param ring  The ring
+ * @param idx   The free running index of the first element in the ring
+ * @param elems The elements outside the ring
+ * @param n     The number of elements
+ * @param in    true to copy into the ring, false to copy out of it
+ */
+static void emuRingCopy( emuRing_t* ring, uint32_t idx, uint8_t* elems, uint32_t n, bool in )
+{
+    uint32_t start = idx & ring->mask;
+    uint32_t first = ring->mask + 1 - start;
+    if( first > n )
+    {
+        first = n;
+    }
+    uint8_t* r = &ring->data[start * ring->elemSize];
+    if( in )
+    {
+        memcpy( r, elems, first * ring->elemSize );
+        memcpy( ring->data, elems + first * ring->elemSize, ( n - first ) * ring->elemSize );
+    }
+    else
+    {
+        memcpy( elems, r, first * ring->elemSize );
+        memcpy( elems + first * ring->elemSize, ring->data, ( n - first ) * ring->elemSize );
+    }
+}
+
+/**
+ * Push elements onto the ring. Only call this from the producer's thread
+ *
+ * @param ring  The ring
+ * @param elems The elements to push
+ * @param n     The number of elements to push
+ * @return the number of elements pushed, the rest are dropped and counted as
+ * overruns
+ */
+uint32_t emuRingPush( emuRing_t* ring, const void* elems, uint32_t n )
+{
+    uint32_t head = atomic_load_explicit( &ring->head, memory_order_relaxed );
+    uint32_t tail = atomic_load_explicit( &ring->tail, memory_order_acquire );
+    uint32_t space = ring->mask + 1 - ( head - tail );
+    if( n > space )
+    {
+        atomic_fetch_add_explicit( &ring->overruns, n - space, memory_order_relaxed );
+        n = space;
+    }
+    emuRingCopy( ring, head, (uint8_t*)elems, n, true );
+    atomic_store_explicit( &ring->head, head + n, memory_order_release );
+    return n;
+}
+
+/**
+ * Pop elements off the ring. Only call this from the consumer's thread
+ *
+ * @param ring  The ring
+ * @param elems Where to write the elements
+ * @param n     The most elements to pop
+ * @return the number of elements popped
+ */
+uint32_t emuRingPop( emuRing_t* ring, void* elems, uint32_t n )
+{
+    uint32_t tail = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+    uint32_t head = atomic_load_explicit( &ring->head, memory_order_acquire );
+    uint32_t count = head - tail;
+    if( n > count )
+    {
+        n = count;
+    }
+    emuRingCopy( ring, tail, (uint8_t*)elems, n, false );
+    atomic_store_explicit( &ring->tail, tail + n, memory_order_release );
+    return n;
+}
+
+/**
+ * Drop every element before idx, so the consumer skips elements the producer
+ * replaced. Only call this from the consumer's thread
+ *
+ * @param ring The ring
+ * @param idx  A free running index from emuRingHead(). Nothing happens if the
+ *             consumer is already past it
+ */
+void emuRingSkipTo( emuRing_t* ring, uint32_t idx )
+{
+    uint32_t tail = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+    uint32_t head = atomic_load_explicit( &ring->head, memory_order_acquire );
+    if( idx - tail <= head - tail )
+    {
+        atomic_store_explicit( &ring->tail, idx, memory_order_release );
+    }
+}
+
+/**
+ * @param ring The ring
+ * @return the free running index of the next element pushed. Only call this
+ * from the producer's thread
+ */
+uint32_t emuRingHead( emuRing_t* ring )
+{
+    return atomic_load_explicit( &ring->head, memory_order_relaxed );
+}
+
+/**
+ * @param ring The ring
+ * @return the number of elements the consumer may pop
+ */
+uint32_t emuRingCount( emuRing_t* ring )
+{
+    return atomic_load_explicit( &ring->head, memory_order_acquire ) -
+           atomic_load_explicit( &ring->tail, memory_order_acquire );
+}
+
+/**
+ * @param ring The ring
+ * @return the number of elements the producer may push
+ */
+uint32_t emuRingSpace( emuRing_t* ring )
+{
+    return ring->mask + 1 - emuRingCount( ring );
+}
@@ -0,0 +1,39 @@
+#ifndef _EMU_RING_H
+#define _EMU_RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+//A lock-free single producer, single consumer ring buffer. One thread may
+//push and one other thread may pop at the same time without locks, which is
+//what the sound driver's real-time callback needs.
+//
+//head and tail count elements forever and wrap at 2^32, so the ring must be
+//a power of two long. The producer owns head and the consumer owns tail.
+//Each one publishes its counter with a release store after touching the
+//data, and reads the other's with an acquire load before touching it.
+
+typedef struct
+{
+    uint8_t* data;
+    uint32_t elemSize;
+    uint32_t mask;
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint overruns; //Elements dropped because the ring was full
+} emuRing_t;
+
+//Define a static ring of len elements of elemType, len must be a power of two
+#define EMU_RING_DEFINE(name, elemType, len) \
+    _Static_assert( ( (len) & ( (len) - 1 ) ) == 0, #name " must be a power of two long" ); \
+    static elemType name##Data[len]; \
+    static emuRing_t name = { (uint8_t*)name##Data, sizeof(elemType), (len) - 1, 0, 0, 0 }
+
+uint32_t emuRingPush( emuRing_t* ring, const void* elems, uint32_t n );
+uint32_t emuRingPop( emuRing_t* ring, void* elems, uint32_t n );
+uint32_t emuRingCount( emuRing_t* ring );
+uint32_t emuRingSpace( emuRing_t* ring );
+void emuRingSkipTo( emuRing_t* ring, uint32_t idx );
+uint32_t emuRingHead( emuRing_t* ring );
+
+#endif
@@ -102,6 +102,37 @@ void drawPixelUnsafeC( int x, int y, color c )
             *addy ^= mask;
 }
 
+void drawColumnBits( int x, const uint32_t* colorBits, const uint32_t* maskBits )
+{
+	if( x < 0 || x >= OLED_WIDTH )
+	{
+		fprintf( stderr, "ERROR: COLUMN OUT OF RANGE in drawColumnBits %d\n", x );
+		return;
+	}
+    uint8_t* addy = &currentFb[x * (OLED_HEIGHT / 8)];
+    for( uint8_t page = 0; page < (OLED_HEIGHT / 8); page++ )
+    {
+        uint8_t mask = maskBits[page >> 2] >> ((page & 3) * 8);
+        uint8_t bits = colorBits[page >> 2] >> ((page & 3) * 8);
+        addy[page] = (addy[page] & ~mask) | (bits & mask);
+    }
+}
+
+void getColumnBits( int x, uint32_t* colorBits )
+{
+	if( x < 0 || x >= OLED_WIDTH )
+	{
+		fprintf( stderr, "ERROR: COLUMN OUT OF RANGE in getColumnBits %d\n", x );
+		return;
+	}
+    uint8_t* addy = &currentFb[x * (OLED_HEIGHT / 8)];
+    for( uint8_t word = 0; word < (OLED_HEIGHT / 32); word++ )
+    {
+        colorBits[word] = addy[0] | (addy[1] << 8) | (addy[2] << 16) | ((uint32_t)addy[3] << 24);
+        addy += 4;
+    }
+}
+
 color getPixel(int16_t x, int16_t y)
 {
     if ((0 <= x) && (x < OLED_WIDTH) &&
@@ -20,6 +20,9 @@
 #include "../user/hdw/buzzer.h"
 #include "../user/hdw/buttons.h"
 #include "../user/utils/assets.h"
+#include "../user/modes/mode_raycaster.h"
+#include "emu_audio.h"
+#include "emu_ring.h"
 #include "spi_flash.h"
 
 #define BACKGROUND_COLOR  0x000000
@@ -309,7 +312,7 @@ void emuCheckResize()
 // }
 
 #ifndef ANDROID
-    int main()
+    int main(int argc, char** argv)
 #else
     int emumain()
 #endif
@@ -322,6 +325,26 @@ void emuCheckResize()
     double SecToWait;
     int linesegs = 0;
 
+#ifndef ANDROID
+    // "swadgemu --audio SPEC" picks what the mic hears, see emu_audio.h
+    int argi = 1;
+    if( argc > argi + 1 && 0 == strcmp( argv[argi], "--audio" ) )
+    {
+        if( !emuAudioSetSource( argv[argi + 1] ) )
+        {
+            return -1;
+        }
+        argi += 2;
+    }
+
+    // "swadgemu raybench [frames]" renders the raycaster benchmark without a window, then exits
+    if( argc > argi && 0 == strcmp( argv[argi], "raybench" ) )
+    {
+        raycasterBenchmark( ( argc > argi + 1 ) ? atoi( argv[argi + 1] ) : 300 );
+        return 0;
+    }
+#endif
+
     CNFGBGColor = 0x800000;
     // CNFGDialogColor = 0x444444;
     CNFGSetup( "swadgemu", OLED_WIDTH * px_scale, px_scale * ( HEADER_PIXELS + OLED_HEIGHT + FOOTER_PIXELS ) );
@@ -649,26 +672,39 @@ void os_free( void* x )
 // Sound system (need to write)
 #include "sound/sound.h"
 struct SoundDriver* sounddriver;
+// Mic samples, pushed by the sound driver's thread and popped by getSamples()
 #define SSBUF 8192
-uint8_t ssamples[SSBUF];
-int sshead;
-int sstail;
-void ICACHE_FLASH_ATTR songTimerCb(void* arg __attribute__((unused)));
+EMU_RING_DEFINE( micRing, uint8_t, SSBUF );
+// The buzzer's sample rate, this must match the sound driver's rate
+#define BZR_RATE 16000
+#define BZR_SAMPLES_PER_MS (BZR_RATE / 1000)
+// How far ahead to render, enough to ride out the main thread stalling
+#define BZR_LEAD 4096
+// How often to top the ring back up to BZR_LEAD
+#define BZR_FILL_MS 5
+// The oscillator's wavetable, one cycle of a sine
+#define BZR_WAVE_BITS 8
+#define BZR_AMP 16384
+// Buzzer samples, rendered ahead by the main thread and popped by the sound driver's thread
+EMU_RING_DEFINE( bzrRing, int16_t, 2 * BZR_LEAD );
+// Samples before this index were replaced, the sound driver's thread skips them
+static atomic_uint bzrFlushIdx;
+static int16_t bzrWave[1 << BZR_WAVE_BITS];
+void ICACHE_FLASH_ATTR bzrFillTimerCb(void* arg __attribute__((unused)));
 void stopBuzzerSong(void);
 void ICACHE_FLASH_ATTR loadNextNote(void);
 struct
 {
-    uint16_t currNote; // Actually a clock divisor
-    uint16_t currDuration;
     const song_t* song;
     bool songShouldLoop;
-    uint32_t noteTime;
     uint32_t noteIdx;
-    timer_t songTimer;
+    uint32_t noteSamples;  // Samples left in this note, including the pause
+    uint32_t pauseSamples; // The last this many samples of the note are silent
+    uint32_t phase;        // The oscillator, a full cycle is 2^32
+    uint32_t phaseInc;     // How far phase goes each sample, 0 for silence
+    timer_t fillTimer;
 } bzr = {0};
 
-uint16_t buzzernote;
-og_mutex_t* buzzernotemutex;
 int getIsMutedOption();
 
 #ifndef ANDROID
@@ -677,84 +713,87 @@ int getIsMutedOption();
     #define BZR_PRINTF LOGI
 #endif
 
-void EMUSoundCBType( struct SoundDriver* sd, short* in, short* out, int samplesr, int samplesp )
+// Queue 16 bit samples for getSamples() as 8 bit ADC readings, drop any that don't fit
+static void emuQueueMicSamples( const short* in, int n )
 {
-    int i;
-    if( samplesr )
+    uint8_t adc[256];
+    while( n > 0 )
     {
-        for( i = 0; i < samplesr; i++ )
+        int i;
+        int chunk = ( n > (int)sizeof( adc ) ) ? (int)sizeof( adc ) : n;
+        for( i = 0; i < chunk; i++ )
         {
-            if( sstail != (( sshead + 1 ) % SSBUF) )
-            {
-                int v = in[i];
+            int v = in[i];
 #ifdef ANDROID
-                v *= 5;
-                if( v > 32767 )
-                {
-                    v = 32767;
-                }
-                else if( v < -32768 )
-                {
-                    v = -32768;
-                }
-#endif
-                ssamples[sshead] = (v / 256) + 128;
-                sshead = ( sshead + 1 ) % SSBUF;
+            v *= 5;
+            if( v > 32767 )
+            {
+                v = 32767;
+            }
+            else if( v < -32768 )
+            {
+                v = -32768;
             }
+#endif
+            adc[i] = (v / 256) + 128;
         }
+        emuRingPush( &micRing, adc, chunk );
+        in += chunk;
+        n -= chunk;
     }
+}
 
-    if( samplesp && out )
+void EMUSoundCBType( struct SoundDriver* sd, short* in, short* out, int samplesr, int samplesp )
+{
+    // Only listen to the sound card if it's the audio source
+    if( samplesr && emuAudioIsMic() )
     {
-        static uint16_t iplaceinwave;
+        emuQueueMicSamples( in, samplesr );
+    }
 
-        OGLockMutex( buzzernotemutex );
-        if ( buzzernote )
-        {
-            for( i = 0; i < samplesp; i++ )
-            {
-                out[i] = 16384 * sin( (3.1415926 * 2.0 * iplaceinwave) / ((float)(buzzernote)) ); //sineaev
-                iplaceinwave += 156; //Actually 156.255 5682/(16000/440)
-                iplaceinwave = iplaceinwave % buzzernote;
-            }
-        }
-        else
-        {
-            memset( out, 0, samplesp * 2 );
-        }
-        OGUnlockMutex( buzzernotemutex );
+    if( samplesp && out )
+    {
+        // Skip anything rendered before the last note change, then play what's
+        // left. If the main thread fell behind, fill the gap with silence
+        emuRingSkipTo( &bzrRing, atomic_load_explicit( &bzrFlushIdx, memory_order_acquire ) );
+        int played = emuRingPop( &bzrRing, out, samplesp );
+        memset( out + played, 0, ( samplesp - played ) * sizeof( short ) );
     }
 }
 
 void initMic(void)
 {
-    if( !buzzernotemutex )
+    if( !emuAudioIsMic() )
     {
-        buzzernotemutex = OGCreateMutex();
+        // Other sources don't need a sound card, they're made on the emulator clock
+        emuAudioStart( system_get_time() );
     }
-    if( !sounddriver )
+    else if( !sounddriver )
     {
         sounddriver = InitSound( 0, EMUSoundCBType, 16000, 1, 1, 256, 0, 0 );
     }
 }
 
-uint8_t getSample(void)
+uint16_t getSamples(uint8_t* samples, uint16_t maxSamples)
 {
-    if( sshead != sstail )
+    if( !emuAudioIsMic() )
     {
-        uint8_t r = ssamples[sstail];
-        sstail = (sstail + 1) % SSBUF;
-        return r;
+        // Queue everything which is due by now, at DFREQ
+        short synth[SSBUF];
+        int numSynth = emuAudioRender( system_get_time(), synth, emuRingSpace( &micRing ) );
+        emuQueueMicSamples( synth, numSynth );
     }
-    else
+
+    // Report dropped samples, they mean the main loop isn't keeping up
+    static uint32_t lastOverruns = 0;
+    uint32_t overruns = atomic_load_explicit( &micRing.overruns, memory_order_relaxed );
+    if( overruns != lastOverruns )
     {
-        return 0;
+        BZR_PRINTF( "Mic overrun, %u samples dropped\n", overruns - lastOverruns );
+        lastOverruns = overruns;
     }
-}
 
-bool sampleAvailable(void)
-{
-    return sstail != sshead;
+    return emuRingPop( &micRing, samples, maxSamples );
 }
 
 void initBuzzer(void)
@@ -773,10 +812,141 @@ void initBuzzer(void)
         return;
     }
 
+    timerDisarm(&bzr.fillTimer);
     ets_memset(&bzr, 0, sizeof(bzr));
-    timerSetFn(&bzr.songTimer, songTimerCb, NULL);
+
+    // Build the wavetable once, so rendering doesn't need sin()
+    for( int i = 0; i < (1 << BZR_WAVE_BITS); i++ )
+    {
+        bzrWave[i] = BZR_AMP * sin( ( 2 * M_PI * i ) / (1 << BZR_WAVE_BITS) );
+    }
+
+    // Keep the ring topped up. Timer jitter doesn't matter, the sound card's
+    // clock sets the tempo
+    timerSetFn(&bzr.fillTimer, bzrFillTimerCb, NULL);
+    timerArm(&bzr.fillTimer, BZR_FILL_MS, true);
 }
 
+/**
+ * Point the oscillator at a note. The phase carries on so there's no click
+ *
+ * @param note The note's period, see notePeriod_t, or SILENCE
+ */
+static void bzrSetOscillator( uint16_t note )
+{
+    // A note's frequency is 5,000,000 / (2 * note)
+    bzr.phaseInc = note ? ( ( (uint64_t)2500000 << 32 ) / ( (uint64_t)BZR_RATE * note ) ) : 0;
+}
+
+/**
+ * Throw away everything rendered but not played yet, so the next samples
+ * rendered play right away
+ */
+static void bzrFlush( void )
+{
+    atomic_store_explicit( &bzrFlushIdx, emuRingHead( &bzrRing ), memory_order_release );
+}
+
+/**
+ * Render the song or note into the ring until it's BZR_LEAD samples ahead of
+ * the sound card. Songs are rendered sample by sample, so notes start and stop
+ * exactly on time
+ */
+static void bzrRender( void )
+{
+    if( !sounddriver )
+    {
+        return;
+    }
+
+    while( bzr.song || bzr.phaseInc )
+    {
+        // Samples before the flush don't count, they'll be skipped
+        uint32_t queued = emuRingCount( &bzrRing );
+        uint32_t sinceFlush = emuRingHead( &bzrRing ) - atomic_load_explicit( &bzrFlushIdx, memory_order_relaxed );
+        if( sinceFlush < queued )
+        {
+            queued = sinceFlush;
+        }
+        if( queued >= BZR_LEAD )
+        {
+            return;
+        }
+
+        // Notes changing faster than the sound card plays them can leave the
+        // ring full of samples to skip, wait for it to catch up
+        int16_t buf[256];
+        uint32_t n = BZR_LEAD - queued;
+        if( n > emuRingSpace( &bzrRing ) )
+        {
+            n = emuRingSpace( &bzrRing );
+        }
+        if( 0 == n )
+        {
+            return;
+        }
+        if( n > sizeof( buf ) / sizeof( buf[0] ) )
+        {
+            n = sizeof( buf ) / sizeof( buf[0] );
+        }
+
+        // Stop at the end of the note, or the start of its pause
+        bool silent = false;
+        if( bzr.song )
+        {
+            if( 0 == bzr.noteSamples )
+            {
+                // This note's time elapsed, try playing the next one
+                bzr.noteIdx++;
+                if(bzr.noteIdx < bzr.song->numNotes)
+                {
+                    // There's another note to play, so play it
+                    loadNextNote();
+                }
+                else if(bzr.songShouldLoop)
+                {
+                    BZR_PRINTF("Loop\n");
+                    // Song over, but should loop, so start again
+                    bzr.noteIdx = 0;
+                    loadNextNote();
+                }
+                else
+                {
+                    BZR_PRINTF("Don't loop\n");
+                    // Song over, not looping, stop rendering
+                    bzr.song = NULL;
+                    bzrSetOscillator(SILENCE);
+                    return;
+                }
+            }
+
+            if( bzr.noteSamples > bzr.pauseSamples )
+            {
+                if( n > bzr.noteSamples - bzr.pauseSamples )
+                {
+                    n = bzr.noteSamples - bzr.pauseSamples;
+                }
+            }
+            else
+            {
+                // Pause a little between notes
+                silent = true;
+                if( n > bzr.noteSamples )
+                {
+                    n = bzr.noteSamples;
+                }
+            }
+            bzr.noteSamples -= n;
+        }
+
+        for( uint32_t i = 0; i < n; i++ )
+        {
+            buf[i] = ( silent || !bzr.phaseInc ) ? 0 : bzrWave[bzr.phase >> ( 32 - BZR_WAVE_BITS )];
+            bzr.phase += bzr.phaseInc;
+        }
+        emuRingPush( &bzrRing, buf, n );
+    }
+}
 
 /**
  * Set the song currently played by the buzzer. The pointer will be saved, but
@@ -801,22 +971,22 @@ void ICACHE_FLASH_ATTR startBuzzerSong(const song_t* song, bool shouldLoop)
     bzr.song = song;
     bzr.songShouldLoop = shouldLoop;
 
-    // Set the timer to call every 1ms
-    timerArm(&bzr.songTimer, 1, true);
-
-    // Start playing the first note
+    // Start playing the first note, and render ahead right away
     loadNextNote();
+    bzrRender();
 }
 
+/**
+ * Play a note until told otherwise. This replaces any song playing
+ *
+ * @param note The note's period, see notePeriod_t, or SILENCE
+ */
 void setBuzzerNote( uint16_t note )
 {
-    if( !buzzernotemutex )
-    {
-        buzzernotemutex = OGCreateMutex();
-    }
-    OGLockMutex( buzzernotemutex );
-    buzzernote = note;
-    OGUnlockMutex( buzzernotemutex );
+    bzr.song = NULL;
+    bzrSetOscillator( note );
+    bzrFlush();
+    bzrRender();
 }
 
 /**
@@ -825,10 +995,18 @@ void setBuzzerNote( uint16_t note )
 void ICACHE_FLASH_ATTR loadNextNote(void)
 {
     uint32_t noteAndDuration = bzr.song->notes[bzr.noteIdx];
-    bzr.currDuration = (noteAndDuration >> 16) & 0xFFFF;
-    setBuzzerNote(noteAndDuration & 0xFFFF);
+    uint32_t durationMs = (noteAndDuration >> 16) & 0xFFFF;
+    bzrSetOscillator(noteAndDuration & 0xFFFF);
+
+    // Every note lasts at least a millisecond, even zero length ones
+    bzr.noteSamples = (durationMs ? durationMs : 1) * BZR_SAMPLES_PER_MS;
+    bzr.pauseSamples = 0;
+    if(durationMs > bzr.song->interNotePause)
+    {
+        bzr.pauseSamples = bzr.song->interNotePause * BZR_SAMPLES_PER_MS;
+    }
 
-    BZR_PRINTF("%s n:%5d d:%5d\n", __func__, bzr.currNote, bzr.currDuration);
+    BZR_PRINTF("%s n:%5d d:%5d\n", __func__, noteAndDuration & 0xFFFF, durationMs);
 }
 
 /**
@@ -839,19 +1017,16 @@ void ICACHE_FLASH_ATTR stopBuzzerSong(void)
     BZR_PRINTF("%s\n", __func__);
 
     setBuzzerNote(SILENCE);
-    bzr.song = NULL;
-    bzr.noteTime = 0;
     bzr.noteIdx = 0;
-    timerDisarm(&bzr.songTimer);
 }
 
 /**
- * A function called every millisecond. It advances through the song_t struct
- * and plays notes. It will loop the song if shouldLoop is set
+ * A function called every few milliseconds to keep the song or note rendered
+ * ahead of the sound card
  *
  * @param arg unused
  */
-void ICACHE_FLASH_ATTR songTimerCb(void* arg __attribute__((unused)))
+void ICACHE_FLASH_ATTR bzrFillTimerCb(void* arg __attribute__((unused)))
 {
     // If it's muted, don't set anything
     if(getIsMutedOption())
@@ -859,45 +1034,7 @@ void ICACHE_FLASH_ATTR songTimerCb(void* arg __attribute__((unused)))
         return;
     }
 
-    // Increment the time
-    bzr.noteTime++;
-
-    // Check if it's time for a new note
-    if(bzr.noteTime >= bzr.currDuration)
-    {
-        // This note's time elapsed, try playing the next one
-        bzr.noteIdx++;
-        bzr.noteTime = 0;
-        if(bzr.noteIdx < bzr.song->numNotes)
-        {
-            // There's another note to play, so play it
-            loadNextNote();
-        }
-        else
-        {
-            // No more notes
-            if(bzr.songShouldLoop)
-            {
-                BZR_PRINTF("Loop\n");
-                // Song over, but should loop, so start again
-                bzr.noteIdx = 0;
-                loadNextNote();
-            }
-            else
-            {
-                BZR_PRINTF("Don't loop\n");
-                // Song over, not looping, stop the timer and the note
-                setBuzzerNote(SILENCE);
-                timerDisarm(&bzr.songTimer);
-            }
-        }
-    }
-    else if ((bzr.currDuration > bzr.song->interNotePause) &&
-             (bzr.noteTime >= bzr.currDuration - bzr.song->interNotePause))
-    {
-        // Pause a little between notes
-        setBuzzerNote(SILENCE);
-    }
+    bzrRender();
 }
 
 
@@ -1424,10 +1561,6 @@ void HandleDestroy()
     exitCurrentSwadgeMode();
 
     CloseSound(sounddriver);
-    if(buzzernotemutex)
-    {
-        OGDeleteMutex(buzzernotemutex);
-    }
 
 #ifdef LINUX
     // Unmap old memory
@@ -498,6 +498,48 @@ void drawPixelUnsafeC( int x, int y, color c )
     }
 }
 
+/**
+ * Draw a column of pixels unsafely but quickly. Only pixels set in maskBits
+ * are drawn, with the color in colorBits.
+ *
+ * This intentionally does not have ICACHE_FLASH_ATTR because it may be called often
+ *
+ * @param x         Column of display, 0 is at the left
+ * @param colorBits OLED_HEIGHT / 32 words, bit (y & 31) of word (y >> 5) is
+ *                  row y, 1 for white or 0 for black
+ * @param maskBits  Same layout as colorBits, 1 to draw the pixel or 0 to leave it
+ */
+void drawColumnBits( int x, const uint32_t* colorBits, const uint32_t* maskBits )
+{
+    uint8_t* addy = &currentFb[x * (OLED_HEIGHT / 8)];
+    for( uint8_t page = 0; page < (OLED_HEIGHT / 8); page++ )
+    {
+        uint8_t mask = maskBits[page >> 2] >> ((page & 3) * 8);
+        if( mask )
+        {
+            uint8_t bits = colorBits[page >> 2] >> ((page & 3) * 8);
+            addy[page] = (addy[page] & ~mask) | (bits & mask);
+        }
+    }
+}
+
+/**
+ * Read a column of pixels unsafely but quickly, in the layout drawColumnBits() takes
+ *
+ * @param x         Column of display, 0 is at the left
+ * @param colorBits OLED_HEIGHT / 32 words to write the column to, bit (y & 31)
+ *                  of word (y >> 5) is row y, 1 for white or 0 for black
+ */
+void getColumnBits( int x, uint32_t* colorBits )
+{
+    uint8_t* addy = &currentFb[x * (OLED_HEIGHT / 8)];
+    for( uint8_t word = 0; word < (OLED_HEIGHT / 32); word++ )
+    {
+        colorBits[word] = addy[0] | (addy[1] << 8) | (addy[2] << 16) | ((uint32_t)addy[3] << 24);
+        addy += 4;
+    }
+}
+
 /**
  * @brief Get a pixel at the current location
  *
@@ -37,6 +37,8 @@ void drawPixel(int16_t x, int16_t y, color c);
 void drawPixelUnsafe( int x, int y );
 void drawPixelUnsafeBlack( int x, int y );
 void drawPixelUnsafeC( int x, int y, color c );
+void drawColumnBits( int x, const uint32_t* colorBits, const uint32_t* maskBits );
+void getColumnBits( int x, uint32_t* colorBits );
 
 color getPixel(int16_t x, int16_t y);
 bool ICACHE_FLASH_ATTR setOLEDparams(bool turnOnOff);
@@ -240,25 +240,33 @@ void ICACHE_FLASH_ATTR initMic(void)
 }
 
 /**
- * @return true if a sample has been read from the ADC and is queued for
- * processing
- */
-bool ICACHE_FLASH_ATTR sampleAvailable(void)
-{
-    return mic.soundhead != mic.soundtail;
-}
-
-/**
- * Get a sample from the ADC in the queue, return it, and increment the queue so
- * the next sample is returned the next time this is called
+ * Copy samples read from the ADC out of the queue, in at most two contiguous
+ * chunks, and advance the queue past them
  *
- * @return the sample which was read from the ADC
+ * @param samples    A buffer to copy the samples into
+ * @param maxSamples The number of samples the buffer can hold
+ * @return the number of samples copied, 0 if none were queued
  */
-uint8_t ICACHE_FLASH_ATTR getSample(void)
+uint16_t ICACHE_FLASH_ATTR getSamples(uint8_t* samples, uint16_t maxSamples)
 {
-    uint8_t samp = mic.sounddata[mic.soundtail];
-    mic.soundtail = (mic.soundtail + 1) % (HPABUFFSIZE);
-    return samp;
+    // Snapshot the head, the ISR may keep writing past it
+    uint16_t head = mic.soundhead;
+    uint16_t tail = mic.soundtail;
+    uint16_t numSamples = 0;
+    while(tail != head && numSamples < maxSamples)
+    {
+        // Copy up to the head or the end of the ring, whichever comes first
+        uint16_t chunk = (head > tail) ? (head - tail) : (HPABUFFSIZE - tail);
+        if(chunk > maxSamples - numSamples)
+        {
+            chunk = maxSamples - numSamples;
+        }
+        ets_memcpy(&samples[numSamples], (const uint8_t*)&mic.sounddata[tail], chunk);
+        numSamples += chunk;
+        tail = (tail + chunk) & (HPABUFFSIZE - 1);
+    }
+    mic.soundtail = tail;
+    return numSamples;
 }
 
 #endif
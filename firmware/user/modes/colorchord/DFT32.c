@@ -10,6 +10,24 @@
     static float* goutbins;
 #endif
 
+//Hosts with SSE2 (the emulator, desktop tools) get a block based DFT which
+//works on many samples at once.  The device always uses the scalar path.
+#if !defined(ICACHE_FLASH) && defined(__SSE2__)
+    #define DFT32_SIMD 1
+    #include <emmintrin.h>
+    #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        #define DFT32_AVX2 1
+        #include <immintrin.h>
+    #endif
+    //Intrinsics are slower than scalar code when they aren't optimized, so
+    //keep the block path fast in the emulator's debug builds too.
+    #if defined(__GNUC__) && !defined(__clang__)
+        #define DFT32_OPTIMIZE __attribute__((optimize("O2")))
+    #else
+        #define DFT32_OPTIMIZE
+    #endif
+#endif
+
 uint16_t embeddedbins32[FIXBINS];
 
 //NOTES to self:
@@ -105,6 +123,12 @@ static uint8_t Sdo_this_octave[BINCYCLE];
 static int32_t Saccum_octavebins[OCTAVES];
 static uint8_t Swhichoctaveplace;
 
+//When Ssparse32 is set, HandleInt() only evaluates the bins listed here for
+//each octave, see SetActiveBins32().  The rest stay at zero.
+static uint8_t Ssparse32;
+static uint8_t Sactivebins32[OCTAVES][FIXBPERO];
+static uint8_t Snumactivebins32[OCTAVES];
+
 //
 uint16_t embeddedbins[FIXBINS];
 
@@ -207,6 +231,25 @@ void ICACHE_FLASH_ATTR UpdateOutputBins32(void)
     }
 }
 
+static void ICACHE_FLASH_ATTR UpdateAllBins32( void )
+{
+    int i;
+    int32_t* bins = &Sdatspace32B[0];
+    int32_t* binsOut = &Sdatspace32BOut[0];
+
+    for( i = 0; i < FIXBINS; i++ )
+    {
+        //First for the SIN then the COS.
+        int32_t val = *(bins);
+        *(binsOut++) = val;
+        *(bins++) -= val >> DFTIIR;
+
+        val = *(bins);
+        *(binsOut++) = val;
+        *(bins++) -= val >> DFTIIR;
+    }
+}
+
 static void ICACHE_FLASH_ATTR HandleInt( int16_t sample )
 {
     int i;
@@ -230,20 +273,7 @@ static void ICACHE_FLASH_ATTR HandleInt( int16_t sample )
         // which is half as many samples
         //It handles updating part of the DFT.
         //It should happen at the very first call to HandleInit
-        int32_t* bins = &Sdatspace32B[0];
-        int32_t* binsOut = &Sdatspace32BOut[0];
-
-        for( i = 0; i < FIXBINS; i++ )
-        {
-            //First for the SIN then the COS.
-            int32_t val = *(bins);
-            *(binsOut++) = val;
-            *(bins++) -= val >> DFTIIR;
-
-            val = *(bins);
-            *(binsOut++) = val;
-            *(bins++) -= val >> DFTIIR;
-        }
+        UpdateAllBins32();
         return;
     }
 
@@ -254,6 +284,24 @@ static void ICACHE_FLASH_ATTR HandleInt( int16_t sample )
     filteredsample = Saccum_octavebins[oct] >> (OCTAVES - oct);
     Saccum_octavebins[oct] = 0;
 
+    if( Ssparse32 )
+    {
+        //Same as below, but only for the active bins
+        const uint8_t* active = Sactivebins32[oct];
+        for( i = 0; i < Snumactivebins32[oct]; i++ )
+        {
+            int bin = active[i] * 2;
+            adv = dsA[bin];
+            localipl = dsA[bin + 1] >> 8;
+            dsA[bin + 1] += adv;
+
+            dsB[bin] += (Ssinonlytable[localipl] * filteredsample);
+            localipl += 64;
+            dsB[bin + 1] += (Ssinonlytable[localipl] * filteredsample);
+        }
+        return;
+    }
+
     for( i = 0; i < FIXBPERO; i++ )
     {
         adv = *(dsA++);
@@ -267,12 +315,198 @@ static void ICACHE_FLASH_ATTR HandleInt( int16_t sample )
     }
 }
 
+#ifdef DFT32_SIMD
+
+//Between two UpdateAllBins32() steps each octave's state is independent of
+//the others, so HandleIntBlock() queues up the filtered samples for every
+//octave and then runs each octave's queue through all of its bins at once.
+//The bins are copied out to a structure-of-arrays so a vector holds the same
+//field of 8 bins.  It's the same integer math as HandleInt(), so the results
+//are bit-exact.
+
+//Bins per octave, rounded up to a whole number of 8 lane vectors.
+#define SOABINS ((FIXBPERO + 7) & ~7)
+
+//Ssinonlytable widened to 32 bits, with the first quarter repeated at the end
+//so the cosine is always at [place + 64].
+static int32_t Ssinwidetable[256 + 64];
+
+typedef void (*dft32Kernel_t)( const uint16_t* advs, uint16_t* places, int32_t* sins, int32_t* coss,
+                               const int16_t* samples, int nsamples );
+
+DFT32_OPTIMIZE static void DFT32KernelSSE2( const uint16_t* advs, uint16_t* places, int32_t* sins, int32_t* coss,
+                             const int16_t* samples, int nsamples )
+{
+    int i, j;
+    for( i = 0; i < SOABINS; i += 8 )
+    {
+        __m128i adv = _mm_load_si128( (const __m128i*)&advs[i] );
+        __m128i place = _mm_load_si128( (const __m128i*)&places[i] );
+        __m128i sinlo = _mm_load_si128( (const __m128i*)&sins[i] );
+        __m128i sinhi = _mm_load_si128( (const __m128i*)&sins[i + 4] );
+        __m128i coslo = _mm_load_si128( (const __m128i*)&coss[i] );
+        __m128i coshi = _mm_load_si128( (const __m128i*)&coss[i + 4] );
+
+        for( j = 0; j < nsamples; j++ )
+        {
+            //SSE2 has no gather, so look up the table one lane at a time
+            uint16_t ipl[8] __attribute__((aligned(16)));
+            _mm_store_si128( (__m128i*)ipl, _mm_srli_epi16( place, 8 ) );
+            place = _mm_add_epi16( place, adv );
+
+            __m128i sample = _mm_set1_epi16( samples[j] );
+            __m128i sv = _mm_setr_epi16(
+                             Ssinwidetable[ipl[0]], Ssinwidetable[ipl[1]], Ssinwidetable[ipl[2]], Ssinwidetable[ipl[3]],
+                             Ssinwidetable[ipl[4]], Ssinwidetable[ipl[5]], Ssinwidetable[ipl[6]], Ssinwidetable[ipl[7]] );
+            __m128i cv = _mm_setr_epi16(
+                             Ssinwidetable[ipl[0] + 64], Ssinwidetable[ipl[1] + 64], Ssinwidetable[ipl[2] + 64],
+                             Ssinwidetable[ipl[3] + 64], Ssinwidetable[ipl[4] + 64], Ssinwidetable[ipl[5] + 64],
+                             Ssinwidetable[ipl[6] + 64], Ssinwidetable[ipl[7] + 64] );
+
+            //16x16 -> 32 bit products from the low and high halves
+            __m128i lo = _mm_mullo_epi16( sv, sample );
+            __m128i hi = _mm_mulhi_epi16( sv, sample );
+            sinlo = _mm_add_epi32( sinlo, _mm_unpacklo_epi16( lo, hi ) );
+            sinhi = _mm_add_epi32( sinhi, _mm_unpackhi_epi16( lo, hi ) );
+
+            lo = _mm_mullo_epi16( cv, sample );
+            hi = _mm_mulhi_epi16( cv, sample );
+            coslo = _mm_add_epi32( coslo, _mm_unpacklo_epi16( lo, hi ) );
+            coshi = _mm_add_epi32( coshi, _mm_unpackhi_epi16( lo, hi ) );
+        }
+
+        _mm_store_si128( (__m128i*)&places[i], place );
+        _mm_store_si128( (__m128i*)&sins[i], sinlo );
+        _mm_store_si128( (__m128i*)&sins[i + 4], sinhi );
+        _mm_store_si128( (__m128i*)&coss[i], coslo );
+        _mm_store_si128( (__m128i*)&coss[i + 4], coshi );
+    }
+}
+
+#ifdef DFT32_AVX2
+__attribute__((target("avx2"))) DFT32_OPTIMIZE
+static void DFT32KernelAVX2( const uint16_t* advs, uint16_t* places, int32_t* sins, int32_t* coss,
+                             const int16_t* samples, int nsamples )
+{
+    int i, j;
+    const __m256i mask = _mm256_set1_epi32( 0xFFFF );
+    for( i = 0; i < SOABINS; i += 8 )
+    {
+        //Places are 16 bit, but widen them to 32 bits to use them as indices
+        __m256i adv = _mm256_cvtepu16_epi32( _mm_load_si128( (const __m128i*)&advs[i] ) );
+        __m256i place = _mm256_cvtepu16_epi32( _mm_load_si128( (const __m128i*)&places[i] ) );
+        __m256i sinacc = _mm256_load_si256( (const __m256i*)&sins[i] );
+        __m256i cosacc = _mm256_load_si256( (const __m256i*)&coss[i] );
+
+        for( j = 0; j < nsamples; j++ )
+        {
+            __m256i sample = _mm256_set1_epi32( samples[j] );
+            __m256i ipl = _mm256_srli_epi32( place, 8 );
+            place = _mm256_and_si256( _mm256_add_epi32( place, adv ), mask );
+
+            __m256i sv = _mm256_i32gather_epi32( (const int*)Ssinwidetable, ipl, 4 );
+            __m256i cv = _mm256_i32gather_epi32( (const int*)&Ssinwidetable[64], ipl, 4 );
+            sinacc = _mm256_add_epi32( sinacc, _mm256_mullo_epi32( sv, sample ) );
+            cosacc = _mm256_add_epi32( cosacc, _mm256_mullo_epi32( cv, sample ) );
+        }
+
+        _mm_store_si128( (__m128i*)&places[i], _mm_packus_epi32( _mm256_castsi256_si128( place ),
+                         _mm256_extracti128_si256( place, 1 ) ) );
+        _mm256_store_si256( (__m256i*)&sins[i], sinacc );
+        _mm256_store_si256( (__m256i*)&coss[i], cosacc );
+    }
+}
+#endif
+
+//Picked by SetupDFTProgressive32() for the CPU we're running on.
+static dft32Kernel_t DFT32Kernel = DFT32KernelSSE2;
+
+DFT32_OPTIMIZE static void FlushOctave32( int oct, const int16_t* samples, int nsamples )
+{
+    int i;
+    uint16_t advs[SOABINS] __attribute__((aligned(32))) = {0};
+    uint16_t places[SOABINS] __attribute__((aligned(32))) = {0};
+    int32_t sins[SOABINS] __attribute__((aligned(32))) = {0};
+    int32_t coss[SOABINS] __attribute__((aligned(32))) = {0};
+    uint16_t* dsA = &Sdatspace32A[oct * FIXBPERO * 2];
+    int32_t* dsB = &Sdatspace32B[oct * FIXBPERO * 2];
+
+    for( i = 0; i < FIXBPERO; i++ )
+    {
+        advs[i] = dsA[i * 2];
+        places[i] = dsA[i * 2 + 1];
+        sins[i] = dsB[i * 2];
+        coss[i] = dsB[i * 2 + 1];
+    }
+
+    DFT32Kernel( advs, places, sins, coss, samples, nsamples );
+
+    for( i = 0; i < FIXBPERO; i++ )
+    {
+        dsA[i * 2 + 1] = places[i];
+        dsB[i * 2] = sins[i];
+        dsB[i * 2 + 1] = coss[i];
+    }
+}
+
+static void FlushOctaves32( int16_t octsamples[OCTAVES][BINCYCLE / 2], uint8_t* octcount )
+{
+    int i;
+    for( i = 0; i < OCTAVES; i++ )
+    {
+        if( octcount[i] )
+        {
+            FlushOctave32( i, octsamples[i], octcount[i] );
+            octcount[i] = 0;
+        }
+    }
+}
+
+DFT32_OPTIMIZE static void HandleIntBlock( const int16_t* dat, int n )
+{
+    //An octave is handled at most every other step, so it can't queue up
+    //more than BINCYCLE/2 samples before the next UpdateAllBins32()
+    int16_t octsamples[OCTAVES][BINCYCLE / 2];
+    uint8_t octcount[OCTAVES] = {0};
+    int i, j;
+
+    //Every sample is handled twice, same as PushSample32()
+    for( i = 0; i < n * 2; i++ )
+    {
+        int16_t sample = dat[i >> 1];
+        uint8_t oct = Sdo_this_octave[Swhichoctaveplace];
+        Swhichoctaveplace ++;
+        Swhichoctaveplace &= BINCYCLE - 1;
+
+        for( j = 0; j < OCTAVES; j++ )
+        {
+            Saccum_octavebins[j] += sample;
+        }
+
+        if( oct > 128 )
+        {
+            //Catch every octave up before the bins are copied out and decayed
+            FlushOctaves32( octsamples, octcount );
+            UpdateAllBins32();
+            continue;
+        }
+
+        octsamples[oct][octcount[oct]++] = Saccum_octavebins[oct] >> (OCTAVES - oct);
+        Saccum_octavebins[oct] = 0;
+    }
+
+    FlushOctaves32( octsamples, octcount );
+}
+
+#endif
+
 int ICACHE_FLASH_ATTR SetupDFTProgressive32(void)
 {
     int i;
     int j;
 
     Sdonefirstrun = 1;
+    Ssparse32 = 0;
     Sdo_this_octave[0] = 0xff;
     for( i = 0; i < BINCYCLE - 1; i++ )
     {
@@ -298,6 +532,19 @@ int ICACHE_FLASH_ATTR SetupDFTProgressive32(void)
         }
         Sdo_this_octave[i + 1] = OCTAVES - j - 1;
     }
+#ifdef DFT32_SIMD
+    for( i = 0; i < 256 + 64; i++ )
+    {
+        Ssinwidetable[i] = Ssinonlytable[i & 0xff];
+    }
+#ifdef DFT32_AVX2
+    if( __builtin_cpu_supports( "avx2" ) )
+    {
+        DFT32Kernel = DFT32KernelAVX2;
+    }
+#endif
+#endif
+
     return 0;
 }
 
@@ -318,12 +565,68 @@ void ICACHE_FLASH_ATTR UpdateBins32( const uint16_t* frequencies )
     }
 }
 
+void ICACHE_FLASH_ATTR SetActiveBins32( const uint16_t* bins, int nbins )
+{
+    int i;
+    uint8_t active[FIXBINS];
+
+    if( !bins )
+    {
+        Ssparse32 = 0;
+        return;
+    }
+
+    ets_memset( active, 0, sizeof( active ) );
+    for( i = 0; i < nbins; i++ )
+    {
+        if( bins[i] < FIXBINS )
+        {
+            active[bins[i]] = 1;
+        }
+    }
+
+    ets_memset( Snumactivebins32, 0, sizeof( Snumactivebins32 ) );
+    for( i = 0; i < FIXBINS; i++ )
+    {
+        int octave = i / FIXBPERO;
+        if( active[i] )
+        {
+            Sactivebins32[octave][Snumactivebins32[octave]++] = i % FIXBPERO;
+        }
+        else
+        {
+            //Inactive bins stop updating, so don't leave stale output behind
+            Sdatspace32B[i * 2] = Sdatspace32B[i * 2 + 1] = 0;
+            Sdatspace32BOut[i * 2] = Sdatspace32BOut[i * 2 + 1] = 0;
+        }
+    }
+    Ssparse32 = 1;
+}
+
 void ICACHE_FLASH_ATTR PushSample32( int16_t dat )
 {
     HandleInt( dat );
     HandleInt( dat );
 }
 
+void ICACHE_FLASH_ATTR PushSamples32( const int16_t* dat, int n )
+{
+    int i;
+#ifdef DFT32_SIMD
+    //A handful of scalar bins beats every bin in vectors
+    if( !Ssparse32 )
+    {
+        HandleIntBlock( dat, n );
+        return;
+    }
+#endif
+    for( i = 0; i < n; i++ )
+    {
+        HandleInt( dat[i] );
+        HandleInt( dat[i] );
+    }
+}
+
 
 #ifndef CCEMBEDDED
 
@@ -61,11 +61,20 @@ void DoDFTProgressive32( float* outbins, float* frequencies, int bins,
 int SetupDFTProgressive32(void);  //Call at start. Returns nonzero if error.
 void UpdateBins32( const uint16_t* frequencies );
 
+//Only evaluate some of the bins, i.e. for a tuner which reads a few notes.
+//bins lists nbins indices from 0 to FIXBINS-1, the rest read as zero.  Pass
+//NULL to evaluate every bin again, which SetupDFTProgressive32() also does.
+//The cost per sample is proportional to the number of active bins.
+void SetActiveBins32( const uint16_t* bins, int nbins );
+
 //Call this to push on new frames of sound.
 //Though it accepts an int16, it actually only takes -4095 to +4095. (13-bit)
 //Any more and you will exceed the accumulators and it will cause an overflow.
 void PushSample32( int16_t dat );
 
+//Same as PushSample32, but for a whole block of samples at once.
+void PushSamples32( const int16_t* dat, int n );
+
 #ifndef CCEMBEDDED
     //ColorChord regular uses this to pass in floats.
     void UpdateBinsForDFT32( const float* frequencies );  //Update the frequencies
@@ -0,0 +1,221 @@
+//Beat tracking on top of ColorChord's spectrum, see embeddedbeat.h
+
+#include "embeddedbeat.h"
+#include "osapi.h"
+
+//Onsets are kept this long, it must be a power of two longer than the
+//longest lag.
+#define BEAT_HISTORY 128
+
+//How slowly the average flux follows the music, in frames, as a power of two
+#define BEAT_MEAN_IIR_BITS 6
+
+//Flux below this is silence, so quiet noise doesn't look like onsets
+#define BEAT_FLUX_FLOOR 64
+
+//The beat is split into this many slices to find where onsets usually land
+#define BEAT_PHASE_BINS 16
+
+//How slowly the phase histogram forgets, in frames, as a power of two
+#define BEAT_PHASE_IIR_BITS 7
+
+_Static_assert( BEAT_HISTORY > BEAT_MAX_LAG, "BEAT_HISTORY must be longer than the longest lag" );
+_Static_assert( ( BEAT_HISTORY & ( BEAT_HISTORY - 1 ) ) == 0, "BEAT_HISTORY must be a power of two" );
+_Static_assert( BEAT_PHASE_BINS == 16, "UpdatePhase() shifts by 4 bits for BEAT_PHASE_BINS" );
+
+uint16_t beat_bpm;
+uint16_t beat_phase;
+uint32_t beat_count;
+uint8_t  beat_confidence;
+uint16_t beat_onset;
+
+static uint16_t lastbins[FIXBINS];
+static uint16_t onsets[BEAT_HISTORY];
+static uint8_t  onsetplace;
+static uint32_t fluxmean;            //<< BEAT_MEAN_IIR_BITS
+static uint32_t acf[BEAT_NUM_LAGS];  //<< BEAT_ACF_IIR_BITS
+static uint32_t phaseacc;            //beat_phase in the top 16 bits
+static uint32_t phaseinc;            //How far phaseacc goes each frame
+static uint32_t phasehist[BEAT_PHASE_BINS]; //Onsets by where in the beat they landed
+
+void ICACHE_FLASH_ATTR InitBeatDetect(void)
+{
+    ets_memset( lastbins, 0, sizeof( lastbins ) );
+    ets_memset( onsets, 0, sizeof( onsets ) );
+    ets_memset( acf, 0, sizeof( acf ) );
+    ets_memset( phasehist, 0, sizeof( phasehist ) );
+    onsetplace = 0;
+    fluxmean = 0;
+    phaseacc = 0;
+    phaseinc = 0;
+
+    beat_bpm = 0;
+    beat_phase = 0;
+    beat_count = 0;
+    beat_confidence = 0;
+    beat_onset = 0;
+}
+
+//If onsets keep landing somewhere other than on the beat, i.e. when we
+//locked on to the off beat, jump the phase to where they land.
+static void ICACHE_FLASH_ATTR UpdatePhase( uint32_t onset )
+{
+    int i;
+    uint32_t rotated[BEAT_PHASE_BINS];
+
+    for( i = 0; i < BEAT_PHASE_BINS; i++ )
+    {
+        phasehist[i] -= phasehist[i] >> BEAT_PHASE_IIR_BITS;
+    }
+    phasehist[beat_phase / ( 65536 / BEAT_PHASE_BINS )] += onset;
+
+    //Onsets land just before and after a beat, so look at pairs of slices
+    int best = 0;
+    uint32_t bestscore = phasehist[0] + phasehist[BEAT_PHASE_BINS - 1];
+    uint32_t onbeat = bestscore;
+    for( i = 1; i < BEAT_PHASE_BINS; i++ )
+    {
+        uint32_t score = phasehist[i] + phasehist[i - 1];
+        if( score > bestscore )
+        {
+            bestscore = score;
+            best = i;
+        }
+    }
+
+    //Only jump when it's clearly better, then the PLL takes it from there
+    if( best && bestscore > onbeat + ( onbeat >> 1 ) )
+    {
+        phaseacc -= (uint32_t)best << ( 32 - 4 );
+        for( i = 0; i < BEAT_PHASE_BINS; i++ )
+        {
+            rotated[i] = phasehist[( i + best ) % BEAT_PHASE_BINS];
+        }
+        ets_memcpy( phasehist, rotated, sizeof( phasehist ) );
+    }
+}
+
+//Find the strongest tempo in the autocorrelation and set beat_bpm,
+//beat_confidence and phaseinc from it.
+static void ICACHE_FLASH_ATTR UpdateTempo(void)
+{
+    const int preflag = ( 60 * BEAT_FPS ) / BEAT_PREFERRED_BPM;
+    int i;
+    int best = -1;
+    uint32_t bestscore = 0;
+    uint32_t total = 0;
+    uint32_t scores[BEAT_NUM_LAGS];
+
+    for( i = 0; i < BEAT_NUM_LAGS; i++ )
+    {
+        //Lean towards the preferred tempo, which mostly picks between half
+        //and double time.  An octave away is weighted by half.
+        int lag = BEAT_MIN_LAG + i;
+        int dist = ( lag > preflag ) ? ( lag - preflag ) : ( preflag - lag );
+        int weight = 256 - ( dist * 128 ) / preflag;
+        if( weight < 64 )
+        {
+            weight = 64;
+        }
+
+        scores[i] = ( acf[i] >> 8 ) * weight;
+        total += acf[i] >> 8;
+        if( scores[i] > bestscore )
+        {
+            bestscore = scores[i];
+            best = i;
+        }
+    }
+
+    if( best < 0 )
+    {
+        beat_confidence = 0;
+        return;
+    }
+
+    //How far the peak stands above the average lag
+    uint32_t peak = acf[best] >> 8;
+    uint32_t mean = total / BEAT_NUM_LAGS;
+    beat_confidence = ( peak > mean ) ? ( ( peak - mean ) * 255 ) / peak : 0;
+
+    //Fit a parabola through the peak and its neighbours for a fractional lag
+    int32_t lagq8 = ( BEAT_MIN_LAG + best ) << 8;
+    if( best > 0 && best < BEAT_NUM_LAGS - 1 )
+    {
+        int64_t l = scores[best - 1];
+        int64_t c = scores[best];
+        int64_t r = scores[best + 1];
+        int64_t den = 2 * c - l - r;
+        if( den > 0 )
+        {
+            lagq8 += ( ( r - l ) * 128 ) / den;
+        }
+    }
+
+    beat_bpm = ( ( 60 * BEAT_FPS * 256 ) + ( lagq8 / 2 ) ) / lagq8;
+    phaseinc = ( (uint64_t)1 << 40 ) / lagq8;
+}
+
+void ICACHE_FLASH_ATTR HandleBeatFrame(void)
+{
+    int i;
+
+    //Spectral flux, how much louder every bin got since the last frame
+    uint32_t flux = 0;
+    for( i = 0; i < FIXBINS; i++ )
+    {
+        if( fuzzed_bins[i] > lastbins[i] )
+        {
+            flux += fuzzed_bins[i] - lastbins[i];
+        }
+        lastbins[i] = fuzzed_bins[i];
+    }
+
+    //An onset is flux well over the average, relative to the average so it
+    //doesn't matter how loud the music is
+    fluxmean = fluxmean + flux - ( fluxmean >> BEAT_MEAN_IIR_BITS );
+    uint32_t mean = fluxmean >> BEAT_MEAN_IIR_BITS;
+    uint32_t onset = 0;
+    if( flux > mean )
+    {
+        onset = ( ( flux - mean ) * 512 ) / ( mean + BEAT_FLUX_FLOOR );
+        if( onset > 4095 )
+        {
+            onset = 4095;
+        }
+    }
+    beat_onset = onset;
+
+    onsetplace = ( onsetplace + 1 ) & ( BEAT_HISTORY - 1 );
+    onsets[onsetplace] = onset;
+
+    //Run the autocorrelation of the onsets at every lag we care about
+    for( i = 0; i < BEAT_NUM_LAGS; i++ )
+    {
+        uint32_t then = onsets[( onsetplace - BEAT_MIN_LAG - i ) & ( BEAT_HISTORY - 1 )];
+        acf[i] = acf[i] + ( ( onset * then ) >> 4 ) - ( acf[i] >> BEAT_ACF_IIR_BITS );
+    }
+
+    UpdateTempo();
+
+    //Count the beats
+    uint32_t lastphase = phaseacc;
+    phaseacc += phaseinc;
+    if( phaseacc < lastphase )
+    {
+        beat_count++;
+    }
+
+    //Pull the phase towards strong onsets near a beat.  The pull is at most a
+    //quarter of the way, so it can never push the phase back over a beat.
+    int16_t err = phaseacc >> 16;
+    if( onset > 256 && err > -16384 && err < 16384 )
+    {
+        int32_t pull = ( err * (int32_t)onset ) / 16384;
+        phaseacc -= (uint32_t)pull << 16;
+    }
+
+    beat_phase = phaseacc >> 16;
+    UpdatePhase( onset );
+    beat_phase = phaseacc >> 16;
+}
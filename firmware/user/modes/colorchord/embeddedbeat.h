@@ -0,0 +1,62 @@
+#ifndef _EMBEDDEDBEAT_H
+#define _EMBEDDEDBEAT_H
+
+#include "embeddednf.h"
+
+//A beat tracker which runs on the same spectrum as the rest of ColorChord.
+//Call HandleBeatFrame() right after HandleFrameInfo(), once every
+//BEAT_FRAME_SAMPLES samples.
+//
+//Onsets are found with spectral flux, how much fuzzed_bins[] got louder since
+//the last frame.  The tempo is the strongest lag in a running autocorrelation
+//of the onsets, and a phase locked counter follows the beats.  It's all
+//integer math, and costs about FIXBINS + the number of lags per frame.
+
+#ifndef BEAT_FRAME_SAMPLES
+    #define BEAT_FRAME_SAMPLES 128
+#endif
+
+//The range of tempos to look for.  Anything outside it shows up as half or
+//double time.
+#ifndef BEAT_MIN_BPM
+    #define BEAT_MIN_BPM 60
+#endif
+
+#ifndef BEAT_MAX_BPM
+    #define BEAT_MAX_BPM 180
+#endif
+
+//The tempo which wins when two are about as strong, i.e. half and double time
+#ifndef BEAT_PREFERRED_BPM
+    #define BEAT_PREFERRED_BPM 120
+#endif
+
+//How slowly the autocorrelation forgets, in frames, as a power of two.  Higher
+//is steadier but slower to follow a tempo change.
+#ifndef BEAT_ACF_IIR_BITS
+    #define BEAT_ACF_IIR_BITS 8
+#endif
+
+//Don't configure these.
+#define BEAT_FPS     (DFREQ / BEAT_FRAME_SAMPLES)
+#define BEAT_MIN_LAG ((60 * BEAT_FPS) / BEAT_MAX_BPM)
+#define BEAT_MAX_LAG ((60 * BEAT_FPS + BEAT_MIN_BPM - 1) / BEAT_MIN_BPM)
+#define BEAT_NUM_LAGS (BEAT_MAX_LAG - BEAT_MIN_LAG + 1)
+
+//beat_confidence over this means the tempo and beats can be trusted.  Noise
+//alone stays well under it.
+#define BEAT_CONFIDENT 128
+
+extern uint16_t beat_bpm;        //The tempo, 0 until there is one
+extern uint16_t beat_phase;      //Where we are in the beat, 0 is on the beat, wraps at 65536
+extern uint32_t beat_count;      //Goes up by one on every beat
+extern uint8_t  beat_confidence; //How sure the tempo is, 0..255
+extern uint16_t beat_onset;      //How strong an onset this frame was, 0..4095
+
+//Call this when starting.  InitColorChord() does.
+void ICACHE_FLASH_ATTR InitBeatDetect(void);
+
+//Call this every frame, after HandleFrameInfo()
+void ICACHE_FLASH_ATTR HandleBeatFrame(void);
+
+#endif
@@ -1,8 +1,10 @@
 //Copyright 2015 <>< Charles Lohr under the ColorChord License.
 
 #include "embeddednf.h"
+#include "embeddedbeat.h"
 #include "osapi.h"
 #include "DFT32.h"
+#include "user_main.h"
 
 uint16_t folded_bins[FIXBPERO];
 uint16_t fuzzed_bins[FIXBINS];
@@ -46,16 +48,46 @@ int main()
 
 
 
-void ICACHE_FLASH_ATTR UpdateFreqs()
+//The A4 the bins are tuned to, in Hz. BASE_FREQ is A1 at the default.
+static uint16_t a4Calibration = A4_CAL_DEFAULT;
+
+#ifdef PRECOMPUTE_FREQUENCY_TABLE
+
+#define PCOMP( f, a4 )  (uint32_t)((65536.0)/(DFREQ) * (f * ((a4) / 8.0)) * 16 + 0.5)
+
+#define PCOMP_OCTAVE( a4 ) \
+    { \
+        PCOMP( 1.000000, a4 ), PCOMP( 1.029302, a4 ), PCOMP( 1.059463, a4 ), PCOMP( 1.090508, a4 ), \
+        PCOMP( 1.122462, a4 ), PCOMP( 1.155353, a4 ), PCOMP( 1.189207, a4 ), PCOMP( 1.224054, a4 ), \
+        PCOMP( 1.259921, a4 ), PCOMP( 1.296840, a4 ), PCOMP( 1.334840, a4 ), PCOMP( 1.373954, a4 ), \
+        PCOMP( 1.414214, a4 ), PCOMP( 1.455653, a4 ), PCOMP( 1.498307, a4 ), PCOMP( 1.542211, a4 ), \
+        PCOMP( 1.587401, a4 ), PCOMP( 1.633915, a4 ), PCOMP( 1.681793, a4 ), PCOMP( 1.731073, a4 ), \
+        PCOMP( 1.781797, a4 ), PCOMP( 1.834008, a4 ), PCOMP( 1.887749, a4 ), PCOMP( 1.943064, a4 ) \
+    }
+
+//One octave of bins for every A4 from A4_CAL_MIN to A4_CAL_MAX, all worked
+//out by the compiler. They're uint32_t so reads from flash stay aligned.
+static const uint32_t fbinsTable[A4_CAL_MAX - A4_CAL_MIN + 1][FIXBPERO] RODATA_ATTR =
 {
+    PCOMP_OCTAVE( 432 ), PCOMP_OCTAVE( 433 ), PCOMP_OCTAVE( 434 ), PCOMP_OCTAVE( 435 ), PCOMP_OCTAVE( 436 ),
+    PCOMP_OCTAVE( 437 ), PCOMP_OCTAVE( 438 ), PCOMP_OCTAVE( 439 ), PCOMP_OCTAVE( 440 ), PCOMP_OCTAVE( 441 ),
+    PCOMP_OCTAVE( 442 ), PCOMP_OCTAVE( 443 ), PCOMP_OCTAVE( 444 ), PCOMP_OCTAVE( 445 ), PCOMP_OCTAVE( 446 )
+};
 
-#ifndef PRECOMPUTE_FREQUENCY_TABLE
+_Static_assert( sizeof( fbinsTable ) / sizeof( fbinsTable[0] ) == A4_CAL_MAX - A4_CAL_MIN + 1,
+                "fbinsTable needs a row for every A4 calibration" );
 
-#define BUILD_BUG_ON(condition) ((void)sizeof(char[1 - 2*!!(condition)]))
+#endif
 
+void ICACHE_FLASH_ATTR UpdateFreqs()
+{
     uint16_t fbins[FIXBPERO];
     int i;
 
+#ifndef PRECOMPUTE_FREQUENCY_TABLE
+
+#define BUILD_BUG_ON(condition) ((void)sizeof(char[1 - 2*!!(condition)]))
+
     BUILD_BUG_ON( sizeof(bf_table) != FIXBPERO * 4 );
 
     //Warning: This does floating point.  Avoid doing this frequently.  If you
@@ -65,20 +97,16 @@ void ICACHE_FLASH_ATTR UpdateFreqs()
 
     for( i = 0; i < FIXBPERO; i++ )
     {
-        float frq =  ( bf_table[i] * BASE_FREQ );
+        float frq =  ( bf_table[i] * a4Calibration / 8.0 );
         fbins[i] = ( 65536.0 ) / ( DFREQ ) * frq * 16 + 0.5;
     }
 #else
-
-#define PCOMP( f )  (uint16_t)((65536.0)/(DFREQ) * (f * BASE_FREQ) * 16 + 0.5)
-
-    static const uint16_t fbins[FIXBPERO] =
+    //Just a table lookup, no floating point
+    const uint32_t* row = fbinsTable[a4Calibration - A4_CAL_MIN];
+    for( i = 0; i < FIXBPERO; i++ )
     {
-        PCOMP( 1.000000 ), PCOMP( 1.029302 ), PCOMP( 1.059463 ), PCOMP( 1.090508 ), PCOMP( 1.122462 ), PCOMP( 1.155353 ),
-        PCOMP( 1.189207 ), PCOMP( 1.224054 ), PCOMP( 1.259921 ), PCOMP( 1.296840 ), PCOMP( 1.334840 ), PCOMP( 1.373954 ),
-        PCOMP( 1.414214 ), PCOMP( 1.455653 ), PCOMP( 1.498307 ), PCOMP( 1.542211 ), PCOMP( 1.587401 ), PCOMP( 1.633915 ),
-        PCOMP( 1.681793 ), PCOMP( 1.731073 ), PCOMP( 1.781797 ), PCOMP( 1.834008 ), PCOMP( 1.887749 ), PCOMP( 1.943064 )
-    };
+        fbins[i] = row[i];
+    }
 #endif
 
 #ifdef USE_32DFT
@@ -88,6 +116,92 @@ void ICACHE_FLASH_ATTR UpdateFreqs()
 #endif
 }
 
+/**
+ * Retune the DFT so A4 is at a4Hz. This is cheap enough to call while audio
+ * is running, the DFT keeps going with the new bins
+ *
+ * @param a4Hz The frequency of A4, clamped to A4_CAL_MIN..A4_CAL_MAX
+ */
+void ICACHE_FLASH_ATTR SetA4Calibration( uint16_t a4Hz )
+{
+    if( a4Hz < A4_CAL_MIN )
+    {
+        a4Hz = A4_CAL_MIN;
+    }
+    else if( a4Hz > A4_CAL_MAX )
+    {
+        a4Hz = A4_CAL_MAX;
+    }
+    a4Calibration = a4Hz;
+    UpdateFreqs();
+}
+
+/**
+ * @return The frequency of A4 the DFT is tuned to, in Hz
+ */
+uint16_t ICACHE_FLASH_ATTR GetA4Calibration( void )
+{
+    return a4Calibration;
+}
+
+/**
+ * Estimate where a peak really is from the bin it landed in and that bin's
+ * neighbours, to a small fraction of a bin.
+ *
+ * The DFT's bins decay exponentially, so a pure tone's magnitude falls off
+ * around it like a Lorentzian, m^2 = 1 / (1 + (d/w)^2). That makes 1/m^2 a
+ * parabola in the distance d, and the vertex of the parabola through three
+ * bins' 1/m^2 is where the tone is. Everything is multiplied through by
+ * l^2 c^2 r^2, so it's one integer divide and no reciprocals.
+ *
+ * @param left   The magnitude of the bin below
+ * @param center The magnitude of the bin with the peak
+ * @param right  The magnitude of the bin above
+ * @return How far the peak is from center, in cents. Positive is sharp. It's
+ *         clamped to one bin, (1200 / FIXBPERO) cents, either way
+ */
+int16_t ICACHE_FLASH_ATTR PeakOffsetCents( uint16_t left, uint16_t center, uint16_t right )
+{
+    const int16_t binCents = 1200 / FIXBPERO;
+
+    //Keep everything to 12 bits so fourth powers fit in 64 bits
+    while( ( left | center | right ) >= ( 1 << 12 ) )
+    {
+        left >>= 1;
+        center >>= 1;
+        right >>= 1;
+    }
+
+    int64_t l2 = (int64_t)left * left;
+    int64_t c2 = (int64_t)center * center;
+    int64_t r2 = (int64_t)right * right;
+
+    int64_t num = binCents * c2 * ( r2 - l2 );
+    int64_t den = 2 * ( c2 * r2 + c2 * l2 - 2 * l2 * r2 );
+
+    //Not shaped like a peak, so it's at least a bin away
+    if( den <= 0 )
+    {
+        if( right == left )
+        {
+            return 0;
+        }
+        return ( right > left ) ? binCents : -binCents;
+    }
+
+    //Round to the nearest cent
+    int64_t cents = ( num + ( ( num < 0 ) ? -den : den ) / 2 ) / den;
+    if( cents > binCents )
+    {
+        return binCents;
+    }
+    else if( cents < -binCents )
+    {
+        return -binCents;
+    }
+    return cents;
+}
+
 void ICACHE_FLASH_ATTR InitColorChord(void)
 {
     int i;
@@ -110,8 +224,13 @@ void ICACHE_FLASH_ATTR InitColorChord(void)
 #endif
 
     //Step 2: Set up the frequency list.  You could do this multiple times
-    //if you want to change the loadout of the frequencies.
+    //if you want to change the loadout of the frequencies.  Every mode
+    //starts at the default calibration.
+    a4Calibration = A4_CAL_DEFAULT;
     UpdateFreqs();
+
+    //Step 3: Start tracking beats from scratch.
+    InitBeatDetect();
 }
 
 void ICACHE_FLASH_ATTR HandleFrameInfo(void)
@@ -19,6 +19,13 @@
 //runtime.
 #define BASE_FREQ 55.0
 
+//The range of A4 calibrations, in Hz, which SetA4Calibration() can tune to.
+//There's a precomputed table of bins for each, so keep it small. BASE_FREQ is
+//A1 at A4_CAL_DEFAULT.
+#define A4_CAL_MIN     432
+#define A4_CAL_MAX     446
+#define A4_CAL_DEFAULT 440
+
 //The higher the number the slackier your FFT will be come.
 #ifndef FUZZ_IIR_BITS
     #define FUZZ_IIR_BITS  1
@@ -101,6 +108,15 @@ extern uint8_t  note_jumped_to[MAXNOTES]; // When a note combines into another o
 void ICACHE_FLASH_ATTR UpdateFreqs(void);        //Not user-useful on most systems.
 void ICACHE_FLASH_ATTR HandleFrameInfo(void);    //Not user-useful on most systems
 
+//Retune to a different A4, from A4_CAL_MIN to A4_CAL_MAX Hz. This swaps in a
+//precomputed table, so it's fine to call at any time.
+void ICACHE_FLASH_ATTR SetA4Calibration(uint16_t a4Hz);
+uint16_t ICACHE_FLASH_ATTR GetA4Calibration(void);
+
+//Estimate how far a peak is from the center of three adjacent bins, in cents.
+//Positive is sharp.
+int16_t ICACHE_FLASH_ATTR PeakOffsetCents(uint16_t left, uint16_t center, uint16_t right);
+
 
 
 //Call this when starting.
@@ -1,6 +1,7 @@
 //Copyright 2015 <>< Charles Lohr under the ColorChord License.
 
 #include "embeddedout.h"
+#include "embeddedbeat.h"
 #include "hsv_utils.h"
 
 //uint8_t ledArray[NUM_LIN_LEDS]; //Points to which notes correspond to these LEDs
@@ -293,6 +294,56 @@ void ICACHE_FLASH_ATTR UpdateAllSameLEDs(void)
 
 
 
+void ICACHE_FLASH_ATTR UpdateBeatLEDs(void)
+{
+    int i;
+    uint8_t freq = 0;
+    uint16_t amp = 0;
+
+    for( i = 0; i < MAXNOTES; i++ )
+    {
+        uint16_t ist = note_peak_amps2[i];
+        uint8_t ifrq = note_peak_freqs[i];
+        if( ist > amp && ifrq != 255 )
+        {
+            freq = ifrq;
+            amp = ist;
+        }
+    }
+
+    //Flash on the beat and fade out over it, squared so it's more of a hit.
+    //Until there's a steady tempo, flash on the onsets instead.
+    uint32_t flash;
+    if( beat_confidence > BEAT_CONFIDENT )
+    {
+        flash = 255 - ( beat_phase >> 8 );
+        flash = ( flash * flash ) >> 8;
+    }
+    else
+    {
+        flash = beat_onset >> 4;
+    }
+
+    //Keep a little of the note's own brightness between beats
+    uint32_t noteamp = (((uint32_t)(amp)) * NOTE_FINAL_AMP) >> 10;
+    uint32_t val = ( noteamp >> 2 ) + flash;
+
+    if( val > 255 )
+    {
+        val = 255;
+    }
+    uint32_t color = ECCtoHEX( (freq + RootNoteOffset) % NOTERANGE, 255, val );
+
+    for( i = 0; i < NUM_LIN_LEDS; i++ )
+    {
+        ledOut[i * 3 + 0] = ( color >> 0 ) & 0xff;
+        ledOut[i * 3 + 1] = ( color >> 8 ) & 0xff;
+        ledOut[i * 3 + 2] = ( color >> 16 ) & 0xff;
+    }
+}
+
+
+
 uint32_t ICACHE_FLASH_ATTR ECCtoHEX( uint8_t note, uint8_t sat, uint8_t val )
 {
     uint16_t hue = 0;
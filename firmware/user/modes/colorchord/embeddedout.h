@@ -41,6 +41,9 @@ void ICACHE_FLASH_ATTR UpdateLinearLEDs(void);
 //For making all the LEDs the same and quickest.  Good for solo instruments?
 void ICACHE_FLASH_ATTR UpdateAllSameLEDs(void);
 
+//All the LEDs the same color, flashing on every beat.  Needs HandleBeatFrame().
+void ICACHE_FLASH_ATTR UpdateBeatLEDs(void);
+
 uint32_t ICACHE_FLASH_ATTR ECCtoHEX( uint8_t note, uint8_t sat, uint8_t val );
 
 
@@ -19,6 +19,7 @@
 #include "oled.h"
 #include "cndraw.h"
 #include "embeddednf.h"
+#include "embeddedbeat.h"
 #include "embeddedout.h"
 #include "font.h"
 #include "buttons.h"
@@ -36,7 +37,7 @@
 
 void ICACHE_FLASH_ATTR colorchordEnterMode(void);
 void ICACHE_FLASH_ATTR colorchordExitMode(void);
-void ICACHE_FLASH_ATTR colorchordSampleHandler(int32_t samp);
+void ICACHE_FLASH_ATTR colorchordSampleHandler(const int16_t* samples, int n);
 void ICACHE_FLASH_ATTR colorchordButtonCallback(uint8_t state, int button, int down);
 bool ICACHE_FLASH_ATTR ccRenderTask(void);
 void ICACHE_FLASH_ATTR ccExitTimerFn(void* arg);
@@ -51,7 +52,7 @@ swadgeMode colorchordMode =
     .fnEnterMode = colorchordEnterMode,
     .fnExitMode = colorchordExitMode,
     .fnButtonCallback = colorchordButtonCallback,
-    .fnAudioCallback = colorchordSampleHandler,
+    .fnAudioBlockCallback = colorchordSampleHandler,
     .fnRenderTask = ccRenderTask,
     .wifiMode = NO_WIFI,
     .fnEspNowRecvCb = NULL,
@@ -166,6 +167,11 @@ bool ICACHE_FLASH_ATTR ccRenderTask(void)
             ets_strncpy(text, "Solid", sizeof(text));
             break;
         }
+        case 2:
+        {
+            ets_strncpy(text, "Beat", sizeof(text));
+            break;
+        }
     }
     uint16_t width = textWidth(text, IBM_VGA_8);
     fillDisplayArea(OLED_WIDTH - width - 1, 0, OLED_WIDTH, FONT_HEIGHT_IBMVGA8, BLACK);
@@ -200,50 +206,73 @@ void ICACHE_FLASH_ATTR colorchordExitMode(void)
 }
 
 /**
- * This is called every time an audio sample is read from the ADC
- * This processes the sample and will display update the LEDs every
+ * This is called every time a block of audio samples is read from the ADC
+ * This processes the samples and will display update the LEDs every
  * 128 samples
  *
- * @param samp A 32 bit audio sample read from the ADC (microphone)
+ * @param samples A block of audio samples read from the ADC (microphone)
+ * @param n       The number of samples in the block
  */
-void ICACHE_FLASH_ATTR colorchordSampleHandler(int32_t samp)
+void ICACHE_FLASH_ATTR colorchordSampleHandler(const int16_t* samples, int n)
 {
-    PushSample32( samp );
-    cc.samplesProcessed++;
-
-    // If at least 128 samples have been processed
-    if( cc.samplesProcessed >= 128 )
+    while( n > 0 )
     {
-        // Don't bother if colorchord is inactive
-        if( !COLORCHORD_ACTIVE )
+        // Push samples up to the end of the current 128 sample frame
+        int toPush = 128 - cc.samplesProcessed;
+        if( toPush < 1 )
         {
-            return;
+            // The last frame was skipped, push one at a time until it isn't
+            toPush = 1;
         }
+        else if( toPush > n )
+        {
+            toPush = n;
+        }
+        PushSamples32( samples, toPush );
+        samples += toPush;
+        n -= toPush;
+        cc.samplesProcessed += toPush;
 
-        // Colorchord magic
-        HandleFrameInfo();
-
-        // Update the LEDs as necessary
-        switch( COLORCHORD_OUTPUT_DRIVER )
+        // If at least 128 samples have been processed
+        if( cc.samplesProcessed >= 128 )
         {
-            default:
-            case 0:
+            // Don't bother if colorchord is inactive
+            if( !COLORCHORD_ACTIVE )
             {
-                UpdateLinearLEDs();
-                break;
+                continue;
             }
-            case 1:
-            {
-                UpdateAllSameLEDs();
-                break;
-            }
-        };
 
-        // Push out the LED data
-        setLeds( (led_t*)ledOut, NUM_LIN_LEDS * 3 );
+            // Colorchord magic
+            HandleFrameInfo();
+            HandleBeatFrame();
 
-        // Reset the sample count
-        cc.samplesProcessed = 0;
+            // Update the LEDs as necessary
+            switch( COLORCHORD_OUTPUT_DRIVER )
+            {
+                default:
+                case 0:
+                {
+                    UpdateLinearLEDs();
+                    break;
+                }
+                case 1:
+                {
+                    UpdateAllSameLEDs();
+                    break;
+                }
+                case 2:
+                {
+                    UpdateBeatLEDs();
+                    break;
+                }
+            };
+
+            // Push out the LED data
+            setLeds( (led_t*)ledOut, NUM_LIN_LEDS * 3 );
+
+            // Reset the sample count
+            cc.samplesProcessed = 0;
+        }
     }
 }
 
@@ -341,8 +370,8 @@ void ICACHE_FLASH_ATTR ccExitTimerFn(void* arg __attribute__((unused)))
 void ICACHE_FLASH_ATTR cycleColorchordOutput(void)
 {
     // gCOLORCHORD_OUTPUT_DRIVER can be either 0 for multiple LED
-    // colors or 1 for all the same LED color
-    CCS.gCOLORCHORD_OUTPUT_DRIVER = (CCS.gCOLORCHORD_OUTPUT_DRIVER + 1) % 2;
+    // colors, 1 for all the same LED color or 2 for flashing on the beat
+    CCS.gCOLORCHORD_OUTPUT_DRIVER = (CCS.gCOLORCHORD_OUTPUT_DRIVER + 1) % 3;
 }
 
 /**
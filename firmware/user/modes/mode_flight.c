@@ -40,6 +40,9 @@
 #include "gpio.h"
 #include "esp_niceness.h"
 #include "hsv_utils.h"
+#ifndef EMU
+#include "maxtime.h"
+#endif
 
 #include "embeddednf.h"
 #include "embeddedout.h"
@@ -55,6 +58,17 @@
 #define MAX_DONUTS 14
 #define MAX_BEANS 69
 
+//The most screen space vertex coordinates kept across frames, see tdDrawModel(). All of
+//3denv.obj would need about 11k of them, 22 KB of heap held for as long as the mode runs,
+//so the cache is capped at 6 KB and given to whatever is in view whenever the view changes.
+#define FLIGHT_VERT_CACHE_MAX 3072
+
+//The environment is bucketed into a grid of square cells on X and Z, see flightBuildGrid()
+#define FLIGHT_GRID_CELL 512
+
+//The farthest a donut, bean or the gazebo can be collected from
+#define FLIGHT_PICKUP_RANGE 200
+
 
 typedef enum
 {
@@ -77,6 +91,14 @@ typedef struct
 } tdModel;
 
 
+typedef struct
+{
+    int16_t lo[3];      //Bounding box of every model in the cell
+    int16_t hi[3];
+    uint16_t first;     //Index of the cell's first model in gridmodels
+    uint16_t count;
+} flGridCell;
+
 typedef enum
 {
     FLIGHT_LED_NONE,
@@ -106,6 +128,24 @@ typedef struct
     int enviromodels;
     tdModel ** environment;
 
+    int16_t * vertcache;
+    int vertcachelen;
+    int vertcacheused;
+    int16_t ** mdlverts;        //Each model's slice of vertcache, or NULL if it has none yet
+    uint32_t * mdlvertgen;      //The viewgen each model's slice was transformed with
+    uint32_t viewgen;           //Incremented whenever ViewProjectionMatrix changes
+    int32_t lastviewproj[16];
+
+    flGridCell * grid;
+    uint16_t * gridmodels;      //Model indices, grouped by cell
+    int16_t gridorigin[2];      //The X and Z of the grid's corner
+    int gridw, gridh;
+
+    uint16_t * draworder;       //Visible models, farthest first, kept sorted across frames
+    int draworderct;
+    int32_t * mdlrange;         //Each model's depth this frame, from tdModelVisibilitycheck()
+    uint32_t * mdlvisframe;     //The tframes each model was last found visible on
+
     menu_t* menu;
     linkedInfo_t* invYmnu;
 
@@ -142,16 +182,18 @@ static bool ICACHE_FLASH_ATTR flightRender(void);
 static void ICACHE_FLASH_ATTR flightGameUpdate( flight_t * tflight );
 static void ICACHE_FLASH_ATTR flightUpdateLEDs(flight_t * tflight);
 static void ICACHE_FLASH_ATTR flightLEDAnimate( flLEDAnimation anim );
+static void ICACHE_FLASH_ATTR flightBuildGrid( flight_t * tflight );
+static int ICACHE_FLASH_ATTR flightLabelLogic( flight_t * tflight, tdModel * m, bool pickup );
+static int ICACHE_FLASH_ATTR tdCellVisibilitycheck( const flGridCell * c );
+static void ICACHE_FLASH_ATTR flightSortDrawOrder( flight_t * tflight );
 int ICACHE_FLASH_ATTR tdModelVisibilitycheck( const tdModel * m );
-void ICACHE_FLASH_ATTR tdDrawModel( const tdModel * m );
+void ICACHE_FLASH_ATTR tdDrawModel( const tdModel * m, int mdlidx );
 static int ICACHE_FLASH_ATTR flightTimeHighScorePlace( int wintime, bool is100percent );
 static void ICACHE_FLASH_ATTR flightTimeHighScoreInsert( int insertplace, bool is100percent, char * name, int timeCentiseconds );
 
 void iplotRectB( int x1, int y1, int x2, int y2 );
 
 //Forward libc declarations.
-void qsort(void *base, size_t nmemb, size_t size,
-          int (*compar)(const void *, const void *));
 int abs(int j);
 
 
@@ -170,7 +212,7 @@ swadgeMode flightMode =
     .fnEspNowSendCb = NULL,
     .fnRenderTask = flightRender,
     .fnAccelerometerCallback = NULL,
-    .fnAudioCallback = NULL,
+    .fnAudioBlockCallback = NULL,
     .menuImg = "flight-menu.gif"
 };
 
@@ -212,16 +254,41 @@ void ICACHE_FLASH_ATTR flightEnterMode(void)
 
     uint32_t retlen;
     uint16_t * data = (uint16_t*)getAsset( "3denv.obj", &retlen );
-    data+=2; //header
-    flight->enviromodels = *(data++);
+    if( data )
+    {
+        data+=2; //header
+        flight->enviromodels = *(data++);
+    }
+    else
+    {
+        //No environment in assets.bin, fly around an empty world rather than crash
+        os_printf( "3denv.obj is missing\n" );
+        flight->enviromodels = 0;
+    }
     flight->environment = os_malloc( sizeof(tdModel *) * flight->enviromodels );
     int i;
+    int totalverts = 0;
     for( i = 0; i < flight->enviromodels; i++ )
     {
         tdModel * m = flight->environment[i] = (tdModel*)data;
         data += 8 + m->nrvertnums + m->nrfaces * m->indices_per_face;
+        totalverts += m->nrvertnums;
     }
 
+    //The scenery never moves, so its screen space vertices stay valid until the view does
+    flight->vertcachelen = ( totalverts < FLIGHT_VERT_CACHE_MAX ) ? totalverts : FLIGHT_VERT_CACHE_MAX;
+    flight->vertcache = os_malloc( sizeof(int16_t) * flight->vertcachelen );
+    flight->vertcacheused = 0;
+    flight->mdlverts = os_zalloc( sizeof(int16_t *) * flight->enviromodels );
+    flight->mdlvertgen = os_zalloc( sizeof(uint32_t) * flight->enviromodels );
+    flight->viewgen = 1;
+
+    flightBuildGrid( flight );
+    flight->draworder = os_malloc( sizeof(uint16_t) * flight->enviromodels );
+    flight->draworderct = 0;
+    flight->mdlrange = os_malloc( sizeof(int32_t) * flight->enviromodels );
+    flight->mdlvisframe = os_zalloc( sizeof(uint32_t) * flight->enviromodels );
+
     flight->menu = initMenu(fl_title, flightMenuCb);
     addRowToMenu(flight->menu);
     // addItemToRow(flight->menu, fl_flight_perf);
@@ -255,6 +322,14 @@ void ICACHE_FLASH_ATTR flightExitMode(void)
     timerDisarm(&(flight->updateTimer));
     timerFlush();
     deinitMenu(flight->menu);
+    os_free(flight->vertcache);
+    os_free(flight->mdlverts);
+    os_free(flight->mdlvertgen);
+    os_free(flight->grid);
+    os_free(flight->gridmodels);
+    os_free(flight->draworder);
+    os_free(flight->mdlrange);
+    os_free(flight->mdlvisframe);
     os_free(flight);
 }
 
@@ -495,6 +570,8 @@ void ICACHE_FLASH_ATTR tdMultiply( int16_t * fin1, int16_t * fin2, int16_t * fou
 void ICACHE_FLASH_ATTR tdRotateEA( int16_t * f, int16_t x, int16_t y, int16_t z );
 void ICACHE_FLASH_ATTR tdScale( int16_t * f, int16_t x, int16_t y, int16_t z );
 void ICACHE_FLASH_ATTR td4Transform( int16_t * pin, int16_t * f, int16_t * pout );
+void ICACHE_FLASH_ATTR tdComposeViewProjection( void );
+void ICACHE_FLASH_ATTR tdViewProjectionTransform( const int16_t * coords_3v, int16_t * pout );
 void ICACHE_FLASH_ATTR tdTranslate( int16_t * f, int16_t x, int16_t y, int16_t z );
 void ICACHE_FLASH_ATTR Draw3DSegment( const int16_t * c1, const int16_t * c2 );
 uint16_t ICACHE_FLASH_ATTR tdSQRT( uint32_t inval );
@@ -507,6 +584,7 @@ static const uint8_t sintable[128] = { 0, 6, 12, 18, 25, 31, 37, 43, 49, 55, 62,
 
 int16_t ModelviewMatrix[16];
 int16_t ProjectionMatrix[16];
+int32_t ViewProjectionMatrix[16];
 
 static int16_t ICACHE_FLASH_ATTR tdSIN( uint8_t iv )
 {
@@ -726,12 +804,40 @@ void ICACHE_FLASH_ATTR td4Transform( int16_t * pin, int16_t * f, int16_t * pout
     pout[2] = ptmp[2];
 }
 
+//Precompose ProjectionMatrix * ModelviewMatrix once per frame, so each vertex only needs
+//one transform. Entries are 32 bit so the translation can't overflow, and the translation
+//column isn't shifted down since it always gets multiplied by w = 256.
+void ICACHE_FLASH_ATTR tdComposeViewProjection( void )
+{
+    int i, j, k;
+    for( i = 0; i < 4; i++ )
+    {
+        for( j = 0; j < 4; j++ )
+        {
+            int32_t sum = 0;
+            for( k = 0; k < 4; k++ )
+            {
+                sum += (int32_t)ProjectionMatrix[i*4+k] * (int32_t)ModelviewMatrix[k*4+j];
+            }
+            ViewProjectionMatrix[i*4+j] = ( j == 3 ) ? sum : ( sum >> 8 );
+        }
+    }
+}
+
+//Transform a point with w = 256 by ViewProjectionMatrix.
+void ICACHE_FLASH_ATTR tdViewProjectionTransform( const int16_t * coords_3v, int16_t * pout )
+{
+    const int32_t * f = ViewProjectionMatrix;
+    pout[0] = (coords_3v[0] * f[m00] + coords_3v[1] * f[m01] + coords_3v[2] * f[m02] + f[m03])>>8;
+    pout[1] = (coords_3v[0] * f[m10] + coords_3v[1] * f[m11] + coords_3v[2] * f[m12] + f[m13])>>8;
+    pout[2] = (coords_3v[0] * f[m20] + coords_3v[1] * f[m21] + coords_3v[2] * f[m22] + f[m23])>>8;
+    pout[3] = (coords_3v[0] * f[m30] + coords_3v[1] * f[m31] + coords_3v[2] * f[m32] + f[m33])>>8;
+}
 
 int ICACHE_FLASH_ATTR LocalToScreenspace( const int16_t * coords_3v, int16_t * o1, int16_t * o2 )
 {
-    int16_t tmppt[4] = { coords_3v[0], coords_3v[1], coords_3v[2], 256 };
-    td4Transform( tmppt, ModelviewMatrix, tmppt );
-    td4Transform( tmppt, ProjectionMatrix, tmppt );
+    int16_t tmppt[4];
+    tdViewProjectionTransform( coords_3v, tmppt );
     if( tmppt[3] >= -4 ) { return -1; }
     int calcx = ((256 * tmppt[0] / tmppt[3])/16+(FBW/2));
     int calcy = ((256 * tmppt[1] / tmppt[3])/8+(FBH/2));
@@ -759,9 +865,8 @@ int ICACHE_FLASH_ATTR tdModelVisibilitycheck( const tdModel * m )
 {
 
     //For computing visibility check
-    int16_t tmppt[4] = { m->center[0], m->center[1], m->center[2], 256 }; //No multiplier seems to work right here.
-    td4Transform( tmppt, ModelviewMatrix, tmppt );
-    td4Transform( tmppt, ProjectionMatrix, tmppt );
+    int16_t tmppt[4]; //No multiplier seems to work right here.
+    tdViewProjectionTransform( m->center, tmppt );
     if( tmppt[3] < -2 )
     {
         int scx = ((256 * tmppt[0] / tmppt[3])/16+(OLED_WIDTH/2));
@@ -784,7 +889,35 @@ int ICACHE_FLASH_ATTR tdModelVisibilitycheck( const tdModel * m )
     }
 }
 
-void ICACHE_FLASH_ATTR tdDrawModel( const tdModel * m )
+//Like tdModelVisibilitycheck(), but for a whole grid cell. The cell is culled only if
+//all eight corners of its box are past the same edge of the screen or behind the camera.
+//The edges are pushed out a few pixels so any model tdModelVisibilitycheck() would keep
+//is in a kept cell. This is done in 32 bits, since far corners overflow int16_t.
+static int ICACHE_FLASH_ATTR tdCellVisibilitycheck( const flGridCell * c )
+{
+    const int32_t * f = ViewProjectionMatrix;
+    int behind = 0, left = 0, right = 0, top = 0, bottom = 0;
+    int i;
+    for( i = 0; i < 8; i++ )
+    {
+        int32_t x = (i & 1) ? c->hi[0] : c->lo[0];
+        int32_t y = (i & 2) ? c->hi[1] : c->lo[1];
+        int32_t z = (i & 4) ? c->hi[2] : c->lo[2];
+        int32_t cx = (x * f[m00] + y * f[m01] + z * f[m02] + f[m03])>>8;
+        int32_t cy = (x * f[m10] + y * f[m11] + z * f[m12] + f[m13])>>8;
+        int32_t forward = -((x * f[m30] + y * f[m31] + z * f[m32] + f[m33])>>8);
+
+        //On screen is |cx| <= 4 * forward and |cy| <= forward
+        if( forward <= 2 ) behind++;
+        if( 4 * cx < -17 * forward ) left++;
+        if( 4 * cx > 17 * forward ) right++;
+        if( 8 * cy < -9 * forward ) top++;
+        if( 8 * cy > 9 * forward ) bottom++;
+    }
+    return behind < 8 && left < 8 && right < 8 && top < 8 && bottom < 8;
+}
+
+void ICACHE_FLASH_ATTR tdDrawModel( const tdModel * m, int mdlidx )
 {
     int i;
 
@@ -799,17 +932,33 @@ void ICACHE_FLASH_ATTR tdDrawModel( const tdModel * m )
 
 
     //This looks a little odd, but what we're doing is caching our vertex computations
-    //so we don't have to re-compute every time round.
+    //so we don't have to re-compute every time round. The scenery is static, so the
+    //vertices are kept in vertcache until the view changes, when flightRender() gives
+    //every slice back. If the cache is full, they go on the stack for this frame only.
     //f( "%d\n", nrv );
-    int16_t cached_verts[nrv];
+    int16_t * cached_verts = flight->mdlverts[mdlidx];
+    if( !cached_verts && flight->vertcacheused + nrv <= flight->vertcachelen )
+    {
+        cached_verts = flight->mdlverts[mdlidx] = &flight->vertcache[flight->vertcacheused];
+        flight->vertcacheused += nrv;
+    }
+    int16_t stack_verts[cached_verts?1:nrv];
+    if( !cached_verts )
+    {
+        cached_verts = stack_verts;
+    }
 
-    for( i = 0; i < nrv; i+=3 )
+    if( cached_verts == stack_verts || flight->mdlvertgen[mdlidx] != flight->viewgen )
     {
-        int16_t * cv1 = &cached_verts[i];
-        if( LocalToScreenspace( &verticesmark[i], cv1, cv1+1 ) )
-            cv1[2] = 2;
-        else
-            cv1[2] = 1;
+        for( i = 0; i < nrv; i+=3 )
+        {
+            int16_t * cv1 = &cached_verts[i];
+            if( LocalToScreenspace( &verticesmark[i], cv1, cv1+1 ) )
+                cv1[2] = 2;
+            else
+                cv1[2] = 1;
+        }
+        flight->mdlvertgen[mdlidx] = flight->viewgen;
     }
 
     if( m->indices_per_face == 2 )
@@ -872,20 +1021,21 @@ void ICACHE_FLASH_ATTR tdDrawModel( const tdModel * m )
     }
 }
 
-
-struct ModelRangePair
-{
-    tdModel * model;
-    int       mrange;
-};
-
-//Do not put this in icache.
-int mdlctcmp( const void * va, const void * vb );
-int mdlctcmp( const void * va, const void * vb )
+//Insertion sort the draw order, farthest first. The order barely changes from one
+//frame to the next, so this is close to a single pass.
+static void ICACHE_FLASH_ATTR flightSortDrawOrder( flight_t * tflight )
 {
-    struct ModelRangePair * a = (struct ModelRangePair *)va;
-    struct ModelRangePair * b = (struct ModelRangePair *)vb;
-    return b->mrange - a->mrange;
+    int i, j;
+    for( i = 1; i < tflight->draworderct; i++ )
+    {
+        uint16_t mdlidx = tflight->draworder[i];
+        int32_t range = tflight->mdlrange[mdlidx];
+        for( j = i; j > 0 && tflight->mdlrange[tflight->draworder[j-1]] < range; j-- )
+        {
+            tflight->draworder[j] = tflight->draworder[j-1];
+        }
+        tflight->draworder[j] = mdlidx;
+    }
 }
 
 
@@ -893,6 +1043,136 @@ int mdlctcmp( const void * va, const void * vb )
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Bucket the environment's models into a grid of FLIGHT_GRID_CELL square cells
+ * on X and Z, by their centers. Each cell gets a bounding box of all its
+ * models, so whole cells can be culled at once
+ *
+ * @param tflight The flight sim, with its environment loaded
+ */
+static void ICACHE_FLASH_ATTR flightBuildGrid( flight_t * tflight )
+{
+    int i;
+    int minx = 32767, minz = 32767, maxx = -32768, maxz = -32768;
+    for( i = 0; i < tflight->enviromodels; i++ )
+    {
+        tdModel * m = tflight->environment[i];
+        if( m->center[0] < minx ) minx = m->center[0];
+        if( m->center[0] > maxx ) maxx = m->center[0];
+        if( m->center[2] < minz ) minz = m->center[2];
+        if( m->center[2] > maxz ) maxz = m->center[2];
+    }
+    if( tflight->enviromodels == 0 )
+    {
+        minx = maxx = minz = maxz = 0;
+    }
+
+    tflight->gridorigin[0] = minx;
+    tflight->gridorigin[1] = minz;
+    tflight->gridw = (maxx - minx) / FLIGHT_GRID_CELL + 1;
+    tflight->gridh = (maxz - minz) / FLIGHT_GRID_CELL + 1;
+    int ncells = tflight->gridw * tflight->gridh;
+    tflight->grid = os_zalloc( sizeof(flGridCell) * ncells );
+    tflight->gridmodels = os_malloc( sizeof(uint16_t) * (tflight->enviromodels + 1) );
+
+    //Count the models in each cell, then give each cell its range of gridmodels
+    uint16_t cellof[tflight->enviromodels + 1];
+    for( i = 0; i < tflight->enviromodels; i++ )
+    {
+        tdModel * m = tflight->environment[i];
+        cellof[i] = ((m->center[2] - minz) / FLIGHT_GRID_CELL) * tflight->gridw +
+            (m->center[0] - minx) / FLIGHT_GRID_CELL;
+        tflight->grid[cellof[i]].count++;
+    }
+    int first = 0;
+    for( i = 0; i < ncells; i++ )
+    {
+        tflight->grid[i].first = first;
+        first += tflight->grid[i].count;
+        tflight->grid[i].count = 0;
+    }
+    for( i = 0; i < tflight->enviromodels; i++ )
+    {
+        flGridCell * c = &tflight->grid[cellof[i]];
+        tflight->gridmodels[c->first + c->count] = i;
+        c->count++;
+    }
+
+    //Bound every model's sphere in each cell with a box
+    for( i = 0; i < ncells; i++ )
+    {
+        flGridCell * c = &tflight->grid[i];
+        int j, k;
+        for( k = 0; k < 3; k++ )
+        {
+            c->lo[k] = 32767;
+            c->hi[k] = -32768;
+        }
+        for( j = 0; j < c->count; j++ )
+        {
+            tdModel * m = tflight->environment[tflight->gridmodels[c->first + j]];
+            for( k = 0; k < 3; k++ )
+            {
+                if( m->center[k] - m->radius < c->lo[k] ) c->lo[k] = m->center[k] - m->radius;
+                if( m->center[k] + m->radius > c->hi[k] ) c->hi[k] = m->center[k] + m->radius;
+            }
+        }
+    }
+}
+
+/**
+ * Decide if a labeled model (donut, bean or gazebo) should be drawn, and if
+ * asked, collect it when the plane is close enough
+ *
+ * @param tflight The flight sim
+ * @param m       A model with a label
+ * @param pickup  true to collect the model if it's in range
+ * @return nonzero if the model should be drawn
+ */
+static int ICACHE_FLASH_ATTR flightLabelLogic( flight_t * tflight, tdModel * m, bool pickup )
+{
+    int label = m->label;
+    int draw = 0;
+    if( label >= 100 && (label - 100) == tflight->ondonut )
+    {
+        draw = 1;
+        if( pickup && tdDist( tflight->planeloc, m->center ) < 130 )
+        {
+            flightLEDAnimate( FLIGHT_LED_DONUT );
+            tflight->ondonut++;
+        }
+    }
+    //bean? 1000... groupings of 8.
+    int beansec = ((label-1000)/10);
+
+    if( label >= 1000 && ( beansec == tflight->ondonut || beansec == (tflight->ondonut-1) || beansec == (tflight->ondonut+1)) )
+    {
+        if( ! (tflight->beangotmask[beansec] & (1<<((label-1000)%10))) )
+        {
+            draw = 1;
+
+            if( pickup && tdDist( tflight->planeloc, m->center ) < 100 )
+            {
+                tflight->beans++;
+                tflight->beangotmask[beansec] |= (1<<((label-1000)%10));
+                flightLEDAnimate( FLIGHT_LED_BEAN );
+            }
+        }
+    }
+    if( label == 999 ) //gazebo
+    {
+        draw = 1;
+        if( pickup && flight->mode != FLIGHT_GAME_OVER && tdDist( tflight->planeloc, m->center ) < 200 && tflight->ondonut == MAX_DONUTS)
+        {
+            flightLEDAnimate( FLIGHT_LED_ENDING );
+            tflight->frames = 0;
+            tflight->wintime = (system_get_time() - tflight->timeOfStart)/10000;
+            tflight->mode = FLIGHT_GAME_OVER;
+        }
+    }
+    return draw;
+}
+
 static bool ICACHE_FLASH_ATTR flightRender(void)
 {
     flight_t * tflight = flight;
@@ -918,77 +1198,103 @@ static bool ICACHE_FLASH_ATTR flightRender(void)
     clearDisplay();
     tdRotateEA( ProjectionMatrix, tflight->hpr[1]/16, tflight->hpr[0]/16, 0 );
     tdTranslate( ModelviewMatrix, -tflight->planeloc[0], -tflight->planeloc[1], -tflight->planeloc[2] );
+    tdComposeViewProjection();
+
+    //Cached vertices are only stale when the camera moved. Then every slice would have to
+    //be recomputed anyway, so take them all back and let this frame's models claim them.
+    if( ets_memcmp( tflight->lastviewproj, ViewProjectionMatrix, sizeof( ViewProjectionMatrix ) ) != 0 )
+    {
+        ets_memcpy( tflight->lastviewproj, ViewProjectionMatrix, sizeof( ViewProjectionMatrix ) );
+        tflight->viewgen++;
+        tflight->vertcacheused = 0;
+        ets_memset( tflight->mdlverts, 0, sizeof(int16_t *) * tflight->enviromodels );
+    }
 
-    struct ModelRangePair mrp[tflight->enviromodels];
-    int mdlct = 0;
+    uint16_t newvis[tflight->enviromodels + 1];
+    int newvisct = 0;
 
 /////////////////////////////////////////////////////////////////////////////////////////
 ////GAME LOGIC GOES HERE (FOR COLLISIONS/////////////////////////////////////////////////
 
-    int i;
-    for( i = 0; i < tflight->enviromodels;i++ )
+    //Only the cells around the plane can have anything close enough to collect
+    int i, cx, cz;
+    int cx0 = (tflight->planeloc[0] - FLIGHT_PICKUP_RANGE - tflight->gridorigin[0]) / FLIGHT_GRID_CELL;
+    int cx1 = (tflight->planeloc[0] + FLIGHT_PICKUP_RANGE - tflight->gridorigin[0]) / FLIGHT_GRID_CELL;
+    int cz0 = (tflight->planeloc[2] - FLIGHT_PICKUP_RANGE - tflight->gridorigin[1]) / FLIGHT_GRID_CELL;
+    int cz1 = (tflight->planeloc[2] + FLIGHT_PICKUP_RANGE - tflight->gridorigin[1]) / FLIGHT_GRID_CELL;
+    if( cx0 < 0 ) cx0 = 0;
+    if( cz0 < 0 ) cz0 = 0;
+    if( cx1 >= tflight->gridw ) cx1 = tflight->gridw - 1;
+    if( cz1 >= tflight->gridh ) cz1 = tflight->gridh - 1;
+    for( cz = cz0; cz <= cz1; cz++ )
+    for( cx = cx0; cx <= cx1; cx++ )
     {
-        tdModel * m = tflight->environment[i];
-
-        int label = m->label;
-        int draw = 1;
-        if( label )
+        flGridCell * c = &tflight->grid[cz * tflight->gridw + cx];
+        for( i = c->first; i < c->first + c->count; i++ )
         {
-            draw = 0;
-            if( label >= 100 && (label - 100) == tflight->ondonut )
-            {
-                draw = 1;
-                if( tdDist( tflight->planeloc, m->center ) < 130 )
-                {
-                    flightLEDAnimate( FLIGHT_LED_DONUT );
-                    tflight->ondonut++;
-                }
-            }
-            //bean? 1000... groupings of 8.
-            int beansec = ((label-1000)/10);
-
-            if( label >= 1000 && ( beansec == tflight->ondonut || beansec == (tflight->ondonut-1) || beansec == (tflight->ondonut+1)) )
+            tdModel * m = tflight->environment[tflight->gridmodels[i]];
+            if( m->label )
             {
-                if( ! (tflight->beangotmask[beansec] & (1<<((label-1000)%10))) )
-                {
-                    draw = 1;
-
-                    if( tdDist( tflight->planeloc, m->center ) < 100 )
-                    {
-                        tflight->beans++;
-                        tflight->beangotmask[beansec] |= (1<<((label-1000)%10));
-                        flightLEDAnimate( FLIGHT_LED_BEAN );
-                    }
-                }
-            }
-            if( label == 999 ) //gazebo
-            {
-                draw = 1;
-                if( flight->mode != FLIGHT_GAME_OVER && tdDist( tflight->planeloc, m->center ) < 200 && tflight->ondonut == MAX_DONUTS)
-                {
-                    flightLEDAnimate( FLIGHT_LED_ENDING );
-                    tflight->frames = 0;
-                    tflight->wintime = (system_get_time() - tflight->timeOfStart)/10000;
-                    tflight->mode = FLIGHT_GAME_OVER;
-                }
+                flightLabelLogic( tflight, m, true );
             }
         }
+    }
 
-        if( draw == 0 ) continue;
+    //Then gather what's on screen, skipping whole cells which aren't
+    int ci;
+    for( ci = 0; ci < tflight->gridh * tflight->gridw; ci++ )
+    {
+        flGridCell * c = &tflight->grid[ci];
+        if( c->count == 0 || !tdCellVisibilitycheck( c ) ) continue;
+
+        for( i = c->first; i < c->first + c->count; i++ )
+        {
+            int mdlidx = tflight->gridmodels[i];
+            tdModel * m = tflight->environment[mdlidx];
 
-        int r = tdModelVisibilitycheck( m );
-        if( r < 0 ) continue;
-        mrp[mdlct].model = m;
-        mrp[mdlct].mrange = r;
-        mdlct++;
+            if( m->label && !flightLabelLogic( tflight, m, false ) ) continue;
+
+            int r = tdModelVisibilitycheck( m );
+            if( r < 0 ) continue;
+            tflight->mdlrange[mdlidx] = r;
+            tflight->mdlvisframe[mdlidx] = tflight->tframes;
+            newvis[newvisct++] = mdlidx;
+        }
     }
 
-    //Painter's algorithm
-    qsort( mrp, mdlct, sizeof( struct ModelRangePair ), mdlctcmp );
+    //Painter's algorithm. Keep last frame's order for whatever is still visible,
+    //add anything which just came into view, then touch it up.
+#ifndef EMU
+    static struct maxtime_t flight_sort_time = { .name = "flight_sort" };
+    maxTimeBegin( &flight_sort_time );
+#endif
+    int ct = 0;
+    for( i = 0; i < tflight->draworderct; i++ )
+    {
+        int mdlidx = tflight->draworder[i];
+        if( tflight->mdlvisframe[mdlidx] == (uint32_t)tflight->tframes )
+        {
+            tflight->draworder[ct++] = mdlidx;
+            tflight->mdlvisframe[mdlidx] = 0; //Already in the order
+        }
+    }
+    for( i = 0; i < newvisct; i++ )
+    {
+        if( tflight->mdlvisframe[newvis[i]] == (uint32_t)tflight->tframes )
+        {
+            tflight->draworder[ct++] = newvis[i];
+        }
+    }
+    tflight->draworderct = ct;
+    flightSortDrawOrder( tflight );
+#ifndef EMU
+    maxTimeEnd( &flight_sort_time );
+#endif
 
-    for( i = 0; i < mdlct; i++ )
+    for( i = 0; i < tflight->draworderct; i++ )
     {
-        tdModel * m = mrp[i].model;
+        int mdlidx = tflight->draworder[i];
+        tdModel * m = tflight->environment[mdlidx];
         int label = m->label;
         int draw = 1;
         if( label )
@@ -1018,14 +1324,14 @@ static bool ICACHE_FLASH_ATTR flightRender(void)
         //draw = 2 = flashing
         //draw = 3 = other flashing
         if( draw == 1 )
-            tdDrawModel( m );
+            tdDrawModel( m, mdlidx );
         else if( draw == 2 || draw == 3 )
         {
             if( draw == 2 )
                 renderlinecolor = (tflight->frames&1)?WHITE:BLACK;
             if( draw == 3 )
                 renderlinecolor = (tflight->frames&1)?BLACK:WHITE;
-            tdDrawModel( m );
+            tdDrawModel( m, mdlidx );
             renderlinecolor = WHITE;
         }
     }
@@ -6,6 +6,7 @@
 #include "osapi.h"
 #include "user_main.h"
 #include "assets.h"
+#include "asset_cache.h"
 #include "nvm_interface.h"
 #include "oled.h"
 #include "bresenham.h"
@@ -65,6 +66,8 @@ bool ICACHE_FLASH_ATTR stopScreensaver(void);
 
 void ICACHE_FLASH_ATTR startPanning(bool pLeft);
 static void ICACHE_FLASH_ATTR menuPanImages(void* arg __attribute__((unused)));
+static void ICACHE_FLASH_ATTR menuDrawGif(gifHandle* img, int16_t xp);
+static void ICACHE_FLASH_ATTR menuPrefetchNeighbors(void);
 void ICACHE_FLASH_ATTR mnuDrawArrows(void);
 
 /*============================================================================
@@ -86,8 +89,6 @@ typedef struct
     int16_t squareWaveScrollSpeed;
     bool drawOLEDScreensaver;
 
-    gifHandle img1;
-    gifHandle img2;
     gifHandle* curImg;
     gifHandle* nextImg;
 
@@ -144,10 +145,6 @@ void ICACHE_FLASH_ATTR menuInit(void)
     // expressed as pixels per frame.
     mnu->squareWaveScrollSpeed = -1;
 
-    // Assign pointers
-    mnu->curImg = &mnu->img1;
-    mnu->nextImg = &mnu->img2;
-
     // Get the list of mnu->modes
     mnu->numModes = getSwadgeModes(&mnu->modes);
     // Don't count the menu as a mode
@@ -157,9 +154,10 @@ void ICACHE_FLASH_ATTR menuInit(void)
     mnu->selectedMode = getMenuPos();
 
     // Load and draw the first image
-    loadGifFromAsset(mnu->modes[1 + mnu->selectedMode]->menuImg, mnu->curImg);
-    drawGifFromAsset(mnu->curImg, 0, 0, false, false, 0, false);
+    mnu->curImg = cacheAcquireGif(mnu->modes[1 + mnu->selectedMode]->menuImg);
+    menuDrawGif(mnu->curImg, 0);
     mnuDrawArrows();
+    menuPrefetchNeighbors();
 
     // Timer for starting a screensaver
     timerDisarm(&mnu->timerScreensaverStart);
@@ -204,8 +202,8 @@ void ICACHE_FLASH_ATTR menuExit(void)
     timerDisarm(&mnu->timerPanning);
     timerFlush();
 
-    freeGifAsset(mnu->curImg);
-    freeGifAsset(mnu->nextImg);
+    cacheReleaseGif(mnu->curImg);
+    cacheReleaseGif(mnu->nextImg);
 
     // Free screensavers
     screensavers[mnu->screensaverIdx]->destroyScreensaver();
@@ -240,7 +238,7 @@ void ICACHE_FLASH_ATTR menuButtonCallback(uint8_t state __attribute__((unused)),
             if (button == ACTION && stopScreensaver())
             {
                 // Draw what's under the screensaver
-                drawGifFromAsset(mnu->curImg, 0, 0, false, false, 0, false);
+                menuDrawGif(mnu->curImg, 0);
                 mnuDrawArrows();
                 // But don't process the button otherwise
                 return;
@@ -371,9 +369,9 @@ void ICACHE_FLASH_ATTR startPanning(bool pLeft)
     // Block button input until it's done
     mnu->menuIsPanning = true;
 
-    // Load the next image
-    freeGifAsset(mnu->nextImg);
-    loadGifFromAsset(mnu->modes[1 + mnu->selectedMode]->menuImg, mnu->nextImg);
+    // Load the next image. It's usually resident already from a prefetch
+    cacheReleaseGif(mnu->nextImg);
+    mnu->nextImg = cacheAcquireGif(mnu->modes[1 + mnu->selectedMode]->menuImg);
 
     // Start the timer to pan
     mnu->panningLeft = pLeft;
@@ -397,8 +395,8 @@ static void ICACHE_FLASH_ATTR menuPanImages(void* arg __attribute__((unused)))
         {
             mnu->panIdx = -OLED_WIDTH;
         }
-        drawGifFromAsset(mnu->curImg, mnu->panIdx, 0, false, false, 0, false);
-        drawGifFromAsset(mnu->nextImg, mnu->panIdx + OLED_WIDTH, 0, false, false, 0, false);
+        menuDrawGif(mnu->curImg, mnu->panIdx);
+        menuDrawGif(mnu->nextImg, mnu->panIdx + OLED_WIDTH);
     }
     else
     {
@@ -407,8 +405,8 @@ static void ICACHE_FLASH_ATTR menuPanImages(void* arg __attribute__((unused)))
         {
             mnu->panIdx = OLED_WIDTH;
         }
-        drawGifFromAsset(mnu->curImg, mnu->panIdx, 0, false, false, 0, false);
-        drawGifFromAsset(mnu->nextImg, mnu->panIdx - OLED_WIDTH, 0, false, false, 0, false);
+        menuDrawGif(mnu->curImg, mnu->panIdx);
+        menuDrawGif(mnu->nextImg, mnu->panIdx - OLED_WIDTH);
     }
     mnuDrawArrows();
 
@@ -424,7 +422,40 @@ static void ICACHE_FLASH_ATTR menuPanImages(void* arg __attribute__((unused)))
         // stop the timer
         timerDisarm(&mnu->timerPanning);
         mnu->menuIsPanning = false;
+
+        // Get the images on either side ready for the next pan
+        menuPrefetchNeighbors();
+    }
+}
+
+/**
+ * Draw a menu image, clearing the area if it couldn't be loaded
+ *
+ * @param img The image to draw, may be NULL
+ * @param xp  The x coordinate to draw the image at
+ */
+static void ICACHE_FLASH_ATTR menuDrawGif(gifHandle* img, int16_t xp)
+{
+    if(NULL != img)
+    {
+        drawGifFromAsset(img, xp, 0, false, false, 0, false);
     }
+    else
+    {
+        fillDisplayArea(xp, 0, xp + OLED_WIDTH - 1, OLED_HEIGHT - 1, BLACK);
+    }
+}
+
+/**
+ * Hint to the asset cache that the images for the modes on either side of the
+ * selected one will be needed soon, so they are loaded before a pan starts
+ */
+static void ICACHE_FLASH_ATTR menuPrefetchNeighbors(void)
+{
+    uint8_t next = (mnu->selectedMode + 1) % mnu->numModes;
+    uint8_t prev = (0 == mnu->selectedMode) ? (mnu->numModes - 1) : (mnu->selectedMode - 1);
+    cachePrefetch(mnu->modes[1 + next]->menuImg, CACHED_GIF);
+    cachePrefetch(mnu->modes[1 + prev]->menuImg, CACHED_GIF);
 }
 
 /*==============================================================================
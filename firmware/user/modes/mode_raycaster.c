@@ -32,12 +32,42 @@
 #define USEC_IN_DSEC 100000
 #define ABS(X)       (((X) < 0) ? -(X) : (X))
 
+// Fixed point ray casting, see castRaysFixed()
+#define RAY_FIXED_POINT               ///< Comment this out to cast rays with floats instead
+// #define RAY_BENCHMARK              ///< Uncomment this to compare both ray casters when a game starts
+#define FX_SHIFT     16               ///< Fractional bits in a q16_t
+#define FX_ONE       (1 << FX_SHIFT)  ///< 1.0 as a q16_t
+#define FX_MAX_DELTA (1 << 24)        ///< The longest distance between grid lines, 256 cells
+#define RECIP_BITS   7                ///< log2 of the number of reciprocal table segments
+
 // Map macros
 #define MAP_TILE(x, y) rc->map[(y) + ((x) * (rc->mapH))]
+#define FLOW_CELL(x, y) rc->flowField[(y) + ((x) * (rc->mapH))]
+
+// Flow field defines, see updateFlowField()
+#define FLOW_UNREACHABLE        0xFF ///< Flow field value for cells which can't reach the player
+#define FLOW_GOAL               0xFE ///< Flow field value for the player's cell
+
+// Potentially visible set defines, keep these in sync with mapconv.c
+#define RAY_PVS_RANGE              6 ///< Cells stored on either side of each cell, per axis
+#define RAY_PVS_BITS     (((2 * RAY_PVS_RANGE + 1) * RAY_PVS_RANGE) + RAY_PVS_RANGE)
+#define RAY_PVS_WORDS    ((RAY_PVS_BITS + 31) / 32) ///< Words per PVS bitmap
 
 // Texture defines (walls & sprites)
 #define TEX_WIDTH                 48 ///< texture width in px
 #define TEX_HEIGHT                48 ///< texture width in px
+#define TEX_WORDS    (((TEX_WIDTH * TEX_HEIGHT) + 31) / 32) ///< words per texture bit plane
+
+// Read a pixel's bit from a texture bit plane, see drawPngToPackedBuffer()
+#define TEX_BIT(bits, idx) (((bits)[(idx) >> 5] >> ((idx) & 31)) & 1)
+
+// Render quality, see raycasterGameRenderer()
+#define RAY_FRAME_BUDGET_US    20000 ///< Automatic quality interlaces when a frame takes longer than this
+
+// Scripted camera for the emulator benchmark, see raycasterBenchmark()
+#define RAY_BENCH_MOVE_STEP     0.1f ///< Cells the camera moves per benchmark frame
+#define RAY_BENCH_TURN_STEP (M_PI / 16) ///< Radians the camera turns per benchmark frame
+#define RAY_BENCH_FRAME_US     33333 ///< Simulated time per benchmark frame, for the HUD clock
 
 // Maximum number of sprites
 #define NUM_SPRITES               60 ///< maximum number of sprites
@@ -124,6 +154,23 @@ typedef enum
     RC_SCORES
 } raycasterMode_t;
 
+// How many columns are cast and textured each frame
+typedef enum
+{
+    RQ_AUTO,       ///< Full resolution, interlaced when frames take too long
+    RQ_FULL,       ///< Every column, every frame
+    RQ_HALF,       ///< Every other column, doubled
+    RQ_INTERLACED, ///< Alternating halves of the columns each frame
+} rayQuality_t;
+
+// Results of a potentially visible set lookup
+typedef enum
+{
+    PVS_NEVER,  ///< No point in one cell can see the other cell
+    PVS_MAYBE,  ///< Some points might, check with DDA
+    PVS_ALWAYS, ///< Every point in one cell sees every point in the other cell
+} rayPvs_t;
+
 // World map tiles. Make sure this is packed
 typedef enum  __attribute__((__packed__))
 {
@@ -140,6 +187,14 @@ WorldMapTile_t;
  * Structs
  *============================================================================*/
 
+typedef int32_t q16_t; ///< Signed 16.16 fixed point
+
+typedef struct
+{
+    uint32_t color[TEX_WORDS]; ///< 1 is white, 0 is black
+    uint32_t mask[TEX_WORDS];  ///< 1 is opaque, 0 is transparent
+} rayTex_t;
+
 typedef struct
 {
     uint8_t mapX;
@@ -161,7 +216,7 @@ typedef struct
     float dirY;
 
     // Sprite texture
-    color* texture;
+    rayTex_t* texture;
     int32_t texTimer;
     int8_t texFrame;
     bool mirror;
@@ -174,6 +229,7 @@ typedef struct
     int32_t health;
     int32_t invincibilityTimer;
     bool shotWillMiss;
+    bool followFlow; ///< true if walking along the flow field, false if walking randomly
 } raySprite_t;
 
 typedef struct
@@ -198,21 +254,31 @@ typedef struct
     uint32_t tRoundElapsed;
     raycasterDifficulty_t difficulty;
 
+    // For rendering
+    rayQuality_t quality;
+    rayQuality_t lastQuality;      ///< The quality the last frame was actually drawn at
+    bool autoInterlace;            ///< true if RQ_AUTO is currently interlacing
+    uint8_t interlaceCol;          ///< The first column to cast next, when interlacing
+    rayResult_t rays[OLED_WIDTH];  ///< Kept between frames so interlaced columns can be reused
+    uint32_t wallCols[OLED_WIDTH][OLED_HEIGHT / 32]; ///< Textured walls from the last frame, when interlacing
+
     // The enemies
     raySprite_t sprites[NUM_SPRITES];
+    uint8_t numSpawned;               ///< Sprites [0, numSpawned) were spawned this round
+    uint8_t spriteOrder[NUM_SPRITES]; ///< Spawned sprites, far to close as of the last frame
     uint8_t liveSprites;
     uint8_t kills;
 
     // Storage for textures
-    color stoneTex [TEX_WIDTH * TEX_HEIGHT];
-    color stripeTex[TEX_WIDTH * TEX_HEIGHT];
-    color brickTex [TEX_WIDTH * TEX_HEIGHT];
-    color sinTex   [TEX_WIDTH * TEX_HEIGHT];
+    rayTex_t stoneTex;
+    rayTex_t stripeTex;
+    rayTex_t brickTex;
+    rayTex_t sinTex;
 
-    color walk    [NUM_WALK_FRAMES][TEX_WIDTH * TEX_HEIGHT];
-    color shooting[NUM_SHOT_FRAMES][TEX_WIDTH * TEX_HEIGHT];
-    color hurt    [NUM_HURT_FRAMES][TEX_WIDTH * TEX_HEIGHT];
-    color dead                     [TEX_WIDTH * TEX_HEIGHT];
+    rayTex_t walk    [NUM_WALK_FRAMES];
+    rayTex_t shooting[NUM_SHOT_FRAMES];
+    rayTex_t hurt    [NUM_HURT_FRAMES];
+    rayTex_t dead;
 
     // Storage for HUD images
     pngHandle heart;
@@ -222,8 +288,23 @@ typedef struct
     // For the map
     uint16_t mapW;
     uint16_t mapH;
-    const WorldMapTile_t* map;
+    WorldMapTile_t* map;
     raycasterMap_t mapIdx;
+    const uint32_t* spawns; ///< Spawn points in the map asset, x | (y << 16)
+    uint16_t numSpawns;
+    uint8_t mapMinX; ///< Bounds of everything that isn't empty space
+    uint8_t mapMinY;
+    uint8_t mapMaxX;
+    uint8_t mapMaxY;
+    const uint32_t* pvs; ///< Potentially visible set rows in the map asset, NULL if there isn't one
+    const uint32_t* pvsRowIdxs; ///< Each cell's PVS row, two uint16_t indices per word
+    uint32_t numPvsRows;
+
+    // For enemy pathing
+    uint8_t* flowField; ///< Each cell's step towards the player's cell, see updateFlowField()
+    int16_t flowCellX;  ///< The player's cell when flowField was computed
+    int16_t flowCellY;
+    uint16_t* flowQueue; ///< BFS frontier, indices into flowField. Every cell fits, so it never wraps
 
     // For LEDs
     timer_t ledTimer;
@@ -263,14 +344,17 @@ void ICACHE_FLASH_ATTR raycasterDrawRoundOver(uint32_t tElapsedUs);
 void ICACHE_FLASH_ATTR moveEnemies(uint32_t tElapsed);
 void ICACHE_FLASH_ATTR handleRayInput(uint32_t tElapsed);
 
-void ICACHE_FLASH_ATTR castRays(rayResult_t* rayResult);
-void ICACHE_FLASH_ATTR drawTextures(rayResult_t* rayResult);
+void ICACHE_FLASH_ATTR castRays(rayResult_t* rayResult, int32_t firstCol, int32_t colStep);
+void ICACHE_FLASH_ATTR castRaysFloat(rayResult_t* rayResult, int32_t firstCol, int32_t colStep);
+void ICACHE_FLASH_ATTR castRaysFixed(rayResult_t* rayResult, int32_t firstCol, int32_t colStep);
+static inline uint32_t fxRecip(uint32_t x);
+void ICACHE_FLASH_ATTR drawTextures(rayResult_t* rayResult, int32_t firstCol, int32_t colStep);
 void ICACHE_FLASH_ATTR drawOutlines(rayResult_t* rayResult);
 void ICACHE_FLASH_ATTR drawSprites(rayResult_t* rayResult);
 void ICACHE_FLASH_ATTR drawHUD(void);
 
 void ICACHE_FLASH_ATTR raycasterInitGame(raycasterDifficulty_t difficulty);
-void ICACHE_FLASH_ATTR sortSprites(int32_t* order, float* dist, int32_t amount);
+void ICACHE_FLASH_ATTR sortSprites(uint8_t* order, float* dist, int32_t amount);
 float ICACHE_FLASH_ATTR Q_rsqrt( float number );
 bool ICACHE_FLASH_ATTR checkWallsBetweenPoints(float sX, float sY, float pX, float pY);
 void ICACHE_FLASH_ATTR setSpriteState(raySprite_t* sprite, enemyState_t state);
@@ -279,7 +363,17 @@ void ICACHE_FLASH_ATTR lightLedsFromAngle(led_t* leds, float angle, int hue, int
 
 void ICACHE_FLASH_ATTR raycasterMapSelectRenderer(uint32_t tElapsedUs);
 void ICACHE_FLASH_ATTR raycasterMapSelectButton(int32_t button);
-void ICACHE_FLASH_ATTR raycasterSetMap(void);
+bool ICACHE_FLASH_ATTR raycasterSetMap(void);
+static void ICACHE_FLASH_ATTR updateFlowField(void);
+static bool ICACHE_FLASH_ATTR followFlowField(raySprite_t* sprite);
+static rayPvs_t ICACHE_FLASH_ATTR pvsLookup(int32_t aX, int32_t aY, int32_t bX, int32_t bY);
+static void ICACHE_FLASH_ATTR loadRayTexture(const char* name, rayTex_t* tex);
+#if defined(EMU)
+static void ICACHE_FLASH_ATTR raycasterBenchmarkCamera(uint32_t frame);
+#endif
+#if defined(RAY_BENCHMARK)
+static void ICACHE_FLASH_ATTR raycasterBenchmarkRays(void);
+#endif
 
 /*==============================================================================
  * Variables
@@ -296,118 +390,69 @@ swadgeMode raycasterMode =
     .fnEspNowRecvCb = NULL,
     .fnEspNowSendCb = NULL,
     .fnAccelerometerCallback = NULL,
-    .fnAudioCallback = NULL,
+    .fnAudioBlockCallback = NULL,
     .menuImg = "ray-menu.gif"
 };
 
 raycaster_t* rc;
 
-#define MAP_L_W 48
-#define MAP_L_H 48
-static const WorldMapTile_t worldMap_l[MAP_L_W][MAP_L_H] =
+/**
+ * Steps to orthogonal neighbors in the flow field. Opposite steps differ only
+ * in the lowest bit
+ */
+static const int8_t flowSteps[4][2] =
 {
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 4, 4, 4, 4, 4, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 2, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 4, },
-    {0, 4, 4, 4, 4, 5, 4, 5, 4, 4, 4, 1, 4, 4, 4, 4, 4, 4, 4, 4, 5, 4, 1, 2, 4, 5, 4, 4, 4, 4, 2, 4, 4, 4, 4, 5, 4, 2, 2, 2, 1, 4, 1, 4, 4, 4, 4, 4, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 1, 4, 4, 3, 3, 4, 4, 3, 3, 4, 4, 1, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 1, 1, 1, 4, 1, 1, 1, 4, 4, 4, },
-    {0, 4, 4, 4, 3, 3, 4, 4, 4, 0, 4, 4, 4, 4, 3, 3, 4, 4, 3, 3, 4, 4, 1, 2, 4, 4, 4, 3, 4, 4, 5, 4, 4, 3, 4, 4, 4, 2, 1, 4, 4, 4, 4, 4, 1, 4, 4, 4, },
-    {0, 4, 4, 4, 3, 3, 4, 4, 4, 0, 4, 4, 4, 4, 4, 4, 4, 5, 4, 4, 4, 4, 1, 2, 4, 4, 4, 4, 3, 4, 4, 4, 3, 4, 4, 4, 4, 2, 1, 4, 3, 4, 3, 4, 1, 4, 4, 4, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 4, 0, 1, 1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 2, 4, 4, 4, 4, 4, 3, 4, 3, 4, 4, 4, 4, 4, 2, 1, 4, 5, 5, 5, 4, 1, 4, 4, 4, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 1, 4, 4, 3, 3, 4, 4, 3, 3, 4, 4, 1, 2, 2, 2, 4, 5, 4, 4, 3, 4, 4, 5, 4, 2, 2, 2, 1, 4, 3, 4, 3, 4, 1, 4, 4, 4, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 1, 4, 4, 3, 3, 4, 4, 3, 3, 4, 4, 1, 2, 4, 4, 4, 4, 4, 3, 4, 3, 4, 4, 4, 4, 4, 2, 1, 4, 4, 4, 4, 4, 1, 4, 4, 4, },
-    {0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 4, 1, 4, 4, 4, 4, 4, 4, 4, 4, 5, 4, 1, 2, 4, 4, 4, 4, 3, 4, 4, 4, 3, 4, 4, 4, 4, 2, 1, 4, 3, 4, 3, 4, 1, 4, 4, 4, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 2, 4, 4, 4, 3, 4, 4, 5, 4, 4, 3, 4, 4, 4, 2, 1, 4, 4, 4, 4, 4, 1, 4, 4, 4, },
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 1, 1, 1, 1, 1, 1, 1, 1, 1, 4, 4, 1, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 1, 4, 3, 4, 3, 4, 1, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 1, 2, 4, 5, 4, 4, 4, 4, 2, 4, 4, 4, 4, 5, 4, 2, 1, 4, 4, 4, 4, 4, 1, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 4, 4, 2, 2, 2, 2, 2, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 2, 1, 1, 1, 4, 1, 1, 1, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 4, 4, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 4, 4, 4, 4, 1, 4, 4, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 0, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, },
-    {4, 4, 4, 4, 4, 2, 4, 4, 4, 3, 4, 4, 4, 4, 4, 3, 4, 4, 4, 3, 4, 4, 2, 0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 4, 0, 0, 0, 0, 0, 4, 4, 0, },
-    {4, 4, 4, 4, 4, 2, 4, 4, 3, 3, 3, 4, 5, 4, 3, 3, 3, 4, 4, 4, 4, 4, 2, 0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 4, 0, 4, 4, 4, 0, 0, 0, 4, 4, 4, 0, },
-    {4, 4, 4, 4, 4, 2, 4, 4, 4, 3, 4, 4, 4, 4, 4, 3, 4, 4, 4, 4, 5, 4, 2, 0, 4, 4, 3, 3, 3, 4, 4, 3, 3, 4, 5, 5, 4, 0, 4, 5, 4, 4, 0, 4, 4, 5, 4, 0, },
-    {4, 4, 4, 4, 4, 2, 4, 5, 4, 4, 4, 4, 3, 4, 4, 4, 4, 4, 3, 4, 4, 4, 2, 0, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, },
-    {4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 3, 3, 3, 4, 4, 4, 3, 3, 3, 4, 4, 2, 0, 4, 4, 3, 4, 5, 5, 4, 4, 4, 4, 4, 4, 4, 0, 0, 4, 4, 4, 4, 4, 4, 4, 0, 0, },
-    {4, 4, 2, 2, 2, 2, 4, 4, 3, 4, 4, 4, 3, 4, 4, 5, 4, 4, 3, 4, 4, 4, 2, 0, 4, 4, 4, 4, 5, 5, 4, 4, 3, 3, 3, 4, 4, 0, 0, 0, 4, 4, 5, 4, 4, 0, 0, 0, },
-    {4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 3, 4, 4, 0, 0, 0, 0, 4, 5, 4, 0, 0, 0, 0, },
-    {0, 0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 3, 4, 4, 0, 0, 0, 4, 4, 5, 4, 4, 0, 0, 0, },
-    {0, 4, 4, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 4, 4, 4, 4, 0, 0, 4, 4, 4, 4, 4, 4, 4, 0, 0, },
-    {0, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 4, 5, 4, 5, 4, 0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 0, 4, 4, 3, 4, 4, 0, 4, 5, 4, 4, 0, 4, 4, 5, 4, 0, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 0, 4, 4, 3, 4, 4, 0, 4, 4, 4, 0, 0, 0, 4, 4, 4, 0, },
-    {0, 4, 4, 3, 4, 4, 3, 3, 3, 3, 4, 4, 0, 1, 4, 4, 3, 3, 3, 3, 3, 4, 4, 3, 3, 3, 3, 3, 4, 4, 1, 0, 4, 5, 4, 5, 4, 0, 4, 4, 0, 0, 0, 0, 0, 4, 4, 0, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 4, 3, 4, 4, 0, 1, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 3, 4, 4, 1, 0, 4, 4, 4, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, },
-    {0, 4, 4, 4, 4, 4, 5, 4, 4, 3, 4, 4, 0, 1, 4, 4, 3, 4, 5, 4, 4, 4, 4, 4, 4, 5, 4, 3, 4, 4, 1, 0, 0, 0, 0, 0, 0, 0, 4, 4, 4, 4, 4, 2, 4, 4, 4, 0, },
-    {0, 4, 4, 3, 3, 3, 3, 4, 4, 3, 4, 4, 0, 1, 4, 4, 3, 4, 4, 3, 3, 4, 4, 3, 3, 4, 4, 3, 4, 4, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 4, 2, 2, 2, },
-    {0, 4, 4, 3, 4, 4, 4, 4, 4, 3, 4, 4, 0, 1, 4, 4, 3, 4, 4, 3, 4, 4, 4, 4, 3, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 2, },
-    {0, 4, 4, 3, 4, 4, 5, 4, 4, 3, 4, 4, 0, 1, 4, 4, 3, 4, 4, 3, 4, 4, 5, 4, 3, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 3, 3, 3, 4, 4, 2, 4, 4, 4, 2, },
-    {0, 4, 4, 3, 4, 4, 3, 3, 3, 3, 4, 4, 0, 1, 4, 4, 3, 4, 4, 3, 4, 4, 4, 4, 3, 4, 4, 3, 4, 4, 1, 2, 4, 4, 4, 2, 4, 5, 4, 4, 4, 4, 4, 2, 4, 5, 4, 2, },
-    {0, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 0, 1, 4, 4, 4, 4, 4, 4, 4, 3, 3, 4, 4, 4, 4, 4, 4, 4, 1, 2, 4, 4, 4, 2, 4, 4, 4, 2, 4, 4, 4, 2, 4, 4, 4, 2, },
-    {0, 4, 4, 3, 4, 4, 5, 4, 4, 4, 5, 4, 0, 1, 4, 4, 4, 4, 4, 4, 4, 3, 3, 4, 4, 4, 4, 4, 4, 4, 1, 2, 4, 4, 4, 2, 4, 5, 4, 2, 4, 4, 4, 2, 4, 5, 4, 2, },
-    {0, 4, 4, 3, 3, 3, 3, 4, 4, 3, 4, 4, 0, 1, 4, 4, 3, 4, 4, 3, 4, 4, 4, 4, 3, 4, 4, 3, 4, 4, 1, 2, 4, 4, 4, 2, 4, 4, 4, 2, 4, 4, 4, 2, 4, 4, 4, 2, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 5, 4, 4, 4, 0, 1, 4, 4, 3, 4, 4, 3, 4, 5, 4, 4, 3, 4, 4, 3, 4, 4, 1, 2, 4, 3, 4, 2, 4, 3, 4, 2, 4, 3, 4, 2, 4, 3, 4, 2, },
-    {0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 1, 4, 4, 3, 4, 4, 3, 4, 4, 4, 4, 3, 4, 4, 3, 4, 4, 1, 2, 4, 3, 4, 2, 4, 3, 4, 2, 4, 3, 4, 2, 4, 3, 4, 2, },
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 4, 0, 0, 1, 4, 4, 3, 4, 4, 3, 3, 4, 4, 3, 3, 4, 4, 3, 4, 4, 1, 2, 4, 3, 4, 2, 4, 3, 4, 2, 4, 3, 4, 2, 4, 3, 4, 2, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 4, 0, 4, 1, 4, 4, 3, 4, 5, 4, 4, 4, 4, 4, 4, 5, 4, 3, 4, 4, 1, 2, 4, 4, 4, 2, 4, 4, 4, 2, 4, 4, 4, 2, 4, 4, 4, 2, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 4, 0, 4, 1, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 3, 4, 4, 1, 2, 4, 5, 4, 2, 4, 4, 4, 2, 4, 5, 4, 2, 4, 4, 4, 2, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 0, 4, 4, 4, 1, 1, 4, 4, 3, 3, 3, 3, 3, 4, 4, 3, 3, 3, 3, 3, 4, 4, 1, 2, 4, 4, 4, 2, 4, 4, 4, 2, 4, 4, 4, 2, 4, 4, 4, 2, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 0, 0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 2, 4, 4, 4, 4, 4, 4, 4, 2, 4, 5, 4, 4, 4, 4, 4, 2, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 2, 4, 4, 3, 3, 3, 4, 4, 2, 4, 4, 3, 3, 3, 4, 4, 2, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 2, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, },
+    { 1,  0},
+    {-1,  0},
+    { 0,  1},
+    { 0, -1}
 };
 
-#define MAP_M_W 30
-#define MAP_M_H 30
-static const WorldMapTile_t worldMap_m[MAP_M_W][MAP_M_H] =
+#if defined(EMU)
+/**
+ * The cells the benchmark camera walks through on RC_MAP_L, starting at the
+ * player's spawn. Each leg is a straight line clear of walls
+ */
+static const uint8_t rayBenchPath[][2] =
 {
-    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, },
-    {1, 4, 4, 4, 4, 4, 5, 4, 4, 4, 5, 4, 1, 4, 4, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 0, 5, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, },
-    {1, 4, 4, 3, 3, 3, 4, 3, 3, 3, 4, 4, 1, 4, 4, 4, 4, 0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5, 4, 0, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 0, 4, 4, 0, 0, 0, 4, 4, 3, 3, 4, 4, 0, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 0, 4, 4, 0, 4, 0, 4, 4, 3, 3, 4, 4, 0, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 0, 4, 4, 0, 4, 0, 4, 4, 3, 3, 4, 4, 0, },
-    {1, 4, 4, 1, 1, 1, 1, 1, 1, 1, 4, 4, 1, 0, 0, 0, 0, 0, 4, 4, 0, 4, 0, 4, 5, 4, 4, 5, 4, 0, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 4, 4, 4, 0, 5, 4, 0, 4, 0, 4, 4, 4, 4, 4, 4, 0, },
-    {1, 5, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 5, 4, 4, 4, 4, 0, 4, 4, 0, 4, 0, 0, 0, 0, 0, 4, 4, 0, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 4, 4, 4, 4, 0, 4, 4, 0, 2, 2, 2, 2, 2, 2, 4, 4, 2, },
-    {1, 4, 4, 1, 1, 1, 1, 1, 1, 1, 4, 4, 1, 0, 0, 4, 4, 0, 4, 4, 0, 2, 4, 3, 4, 4, 4, 4, 4, 2, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 0, 4, 4, 0, 4, 4, 0, 2, 4, 5, 3, 4, 4, 4, 4, 2, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 0, 4, 4, 0, 4, 5, 0, 2, 4, 4, 4, 3, 4, 4, 4, 2, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 0, 4, 5, 4, 4, 4, 0, 2, 4, 4, 4, 4, 3, 4, 4, 2, },
-    {1, 4, 4, 3, 3, 3, 4, 3, 3, 3, 4, 4, 1, 4, 0, 4, 4, 4, 4, 4, 0, 2, 4, 4, 4, 4, 4, 4, 4, 2, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 0, 0, 0, 0, 0, 0, 0, 2, 4, 4, 3, 4, 4, 4, 4, 2, },
-    {1, 4, 4, 4, 4, 4, 5, 4, 4, 4, 5, 4, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 4, 4, 4, 3, 4, 4, 4, 2, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5, 3, 4, 4, 2, },
-    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 3, 4, 2, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2, 2, 2, 2, 2, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 5, 5, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 5, 5, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 3, 4, 4, 4, 4, 3, 4, 2, 4, 4, 4, 4, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, },
-    {4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, },
+    {10,  8}, {10,  1}, { 2,  1}, { 2, 10}, { 5, 10}, { 5, 12},
+    {10, 13}, {10, 20}, {12, 20}, {12, 18}, {18, 18}, {18, 19},
+    {19, 20}, {23, 20}, {23,  2}, {39,  2}, {39,  9}, {44, 10},
+    {44, 28}, {33, 29}, {33, 32}, {44, 32}, {44, 36}, {34, 36},
+    {34, 40}, {44, 40}, {44, 44}, {30, 44}, {30, 46}, {25, 46},
+    {25, 45}, {23, 43}, {16, 38}, {14, 38}, {14, 41}, { 1, 41},
+    { 1, 32}
 };
+#endif
 
-#define MAP_S_W 12
-#define MAP_S_H 12
-static const WorldMapTile_t worldMap_s[MAP_S_W][MAP_S_H] =
+/**
+ * 2^31 / (1 + (i / 128)) for i in [0, 128], the reciprocal of a normalized
+ * mantissa. fxRecip() interpolates between neighboring entries
+ */
+static const uint32_t recipTable[(1 << RECIP_BITS) + 1] RODATA_ATTR =
 {
-    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, },
-    {1, 4, 5, 4, 4, 5, 3, 3, 4, 5, 4, 1, },
-    {1, 4, 3, 3, 4, 4, 4, 4, 4, 3, 4, 1, },
-    {1, 4, 4, 5, 4, 3, 4, 5, 4, 3, 5, 1, },
-    {1, 4, 3, 4, 4, 3, 4, 4, 4, 4, 4, 1, },
-    {1, 4, 3, 5, 4, 5, 4, 3, 3, 5, 4, 1, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, },
-    {1, 4, 5, 4, 3, 3, 4, 5, 4, 4, 5, 1, },
-    {1, 5, 3, 4, 5, 4, 4, 1, 1, 1, 4, 1, },
-    {1, 4, 4, 4, 4, 4, 4, 4, 4, 1, 5, 1, },
-    {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, },
+    0x80000000, 0x7F01FC08, 0x7E07E07E, 0x7D119679, 0x7C1F07C2, 0x7B301ECC,
+    0x7A44C6B0, 0x795CEB24, 0x78787878, 0x77975B90, 0x76B981DB, 0x75DED953,
+    0x75075075, 0x7432D63E, 0x73615A24, 0x7292CC15, 0x71C71C72, 0x70FE3C07,
+    0x70381C0E, 0x6F74AE26, 0x6EB3E453, 0x6DF5B0F7, 0x6D3A06D4, 0x6C80D902,
+    0x6BCA1AF3, 0x6B15C06B, 0x6A63BD82, 0x69B4069B, 0x69069069, 0x685B4FE6,
+    0x67B23A54, 0x670B453C, 0x66666666, 0x65C393E0, 0x6522C3F3, 0x6483ED27,
+    0x63E7063E, 0x634C0635, 0x62B2E43E, 0x621B97C3, 0x61861862, 0x60F25DEB,
+    0x60606060, 0x5FD017F4, 0x5F417D06, 0x5EB48824, 0x5E293206, 0x5D9F7391,
+    0x5D1745D1, 0x5C90A1FD, 0x5C0B8170, 0x5B87DDAD, 0x5B05B05B, 0x5A84F345,
+    0x5A05A05A, 0x5987B1A9, 0x590B2164, 0x588FE9DC, 0x58160581, 0x579D6EE3,
+    0x572620AE, 0x56B015AC, 0x563B48C2, 0x55C7B4F1, 0x55555555, 0x54E42524,
+    0x54741FAC, 0x54054054, 0x5397829D, 0x532AE21D, 0x52BF5A81, 0x5254E78F,
+    0x51EB851F, 0x51832F20, 0x511BE196, 0x50B59897, 0x50505050, 0x4FEC04FF,
+    0x4F88B2F4, 0x4F265692, 0x4EC4EC4F, 0x4E6470B0, 0x4E04E04E, 0x4DA637CF,
+    0x4D4873ED, 0x4CEB916D, 0x4C8F8D29, 0x4C346405, 0x4BDA12F7, 0x4B809701,
+    0x4B27ED36, 0x4AD012B4, 0x4A7904A8, 0x4A22C04A, 0x49CD42E2, 0x497889C2,
+    0x49249249, 0x48D159E2, 0x487EDE05, 0x482D1C32, 0x47DC11F7, 0x478BBCED,
+    0x473C1AB7, 0x46ED2901, 0x469EE584, 0x46514E02, 0x46046046, 0x45B81A25,
+    0x456C797E, 0x45217C38, 0x44D72045, 0x448D639D, 0x44444444, 0x43FBC044,
+    0x43B3D5B0, 0x436C82A2, 0x4325C53F, 0x42DF9BB1, 0x429A042A, 0x4254FCE4,
+    0x42108421, 0x41CC9829, 0x4189374C, 0x41465FDF, 0x41041041, 0x40C246D4,
+    0x40810204, 0x40404040, 0x40000000
 };
 
 static const char rc_title[]  = "SHREDDER";
@@ -415,6 +460,10 @@ static const char rc_easy[]   = "EASY";
 static const char rc_med[]    = "MEDIUM";
 static const char rc_hard[]   = "HARD";
 static const char rc_scores[] = "SCORES";
+static const char rc_q_auto[] = "AUTO RES";
+static const char rc_q_full[] = "FULL RES";
+static const char rc_q_half[] = "HALF RES";
+static const char rc_q_intr[] = "INTERLACE";
 static const char rc_quit[]   = "QUIT";
 
 static const char rc_small[]   = "SM";
@@ -445,6 +494,11 @@ void ICACHE_FLASH_ATTR raycasterEnterMode(void)
     addItemToRow(rc->menu, rc_med);
     addItemToRow(rc->menu, rc_hard);
     addRowToMenu(rc->menu);
+    addItemToRow(rc->menu, rc_q_auto);
+    addItemToRow(rc->menu, rc_q_full);
+    addItemToRow(rc->menu, rc_q_half);
+    addItemToRow(rc->menu, rc_q_intr);
+    addRowToMenu(rc->menu);
     addItemToRow(rc->menu, rc_scores);
     addRowToMenu(rc->menu);
     addItemToRow(rc->menu, rc_quit);
@@ -452,52 +506,20 @@ void ICACHE_FLASH_ATTR raycasterEnterMode(void)
     // Turn off debounce
     enableDebounce(false);
 
-    // Load the enemy texture to RAM
-    pngHandle tmpPngHandle;
-    allocPngAsset("h8_wlk1.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->walk[0]);
-    freePngAsset(&tmpPngHandle);
-
-    allocPngAsset("h8_wlk2.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->walk[1]);
-    freePngAsset(&tmpPngHandle);
-
-    allocPngAsset("h8_atk1.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->shooting[0]);
-    freePngAsset(&tmpPngHandle);
-
-    allocPngAsset("h8_atk2.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->shooting[1]);
-    freePngAsset(&tmpPngHandle);
-
-    allocPngAsset("h8_hrt1.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->hurt[0]);
-    freePngAsset(&tmpPngHandle);
-
-    allocPngAsset("h8_hrt2.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->hurt[1]);
-    freePngAsset(&tmpPngHandle);
-
-    allocPngAsset("h8_ded.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->dead);
-    freePngAsset(&tmpPngHandle);
+    // Load the enemy textures to RAM
+    loadRayTexture("h8_wlk1.png", &rc->walk[0]);
+    loadRayTexture("h8_wlk2.png", &rc->walk[1]);
+    loadRayTexture("h8_atk1.png", &rc->shooting[0]);
+    loadRayTexture("h8_atk2.png", &rc->shooting[1]);
+    loadRayTexture("h8_hrt1.png", &rc->hurt[0]);
+    loadRayTexture("h8_hrt2.png", &rc->hurt[1]);
+    loadRayTexture("h8_ded.png", &rc->dead);
 
     // Load the wall textures to RAM
-    allocPngAsset("txstone.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->stoneTex);
-    freePngAsset(&tmpPngHandle);
-
-    allocPngAsset("txstripe.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->stripeTex);
-    freePngAsset(&tmpPngHandle);
-
-    allocPngAsset("txbrick.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->brickTex);
-    freePngAsset(&tmpPngHandle);
-
-    allocPngAsset("txsinw.png", &tmpPngHandle);
-    drawPngToBuffer(&tmpPngHandle, rc->sinTex);
-    freePngAsset(&tmpPngHandle);
+    loadRayTexture("txstone.png", &rc->stoneTex);
+    loadRayTexture("txstripe.png", &rc->stripeTex);
+    loadRayTexture("txbrick.png", &rc->brickTex);
+    loadRayTexture("txsinw.png", &rc->sinTex);
 
     // Load the HUD assets
     allocPngAsset("heart.png", &(rc->heart));
@@ -522,6 +544,25 @@ void ICACHE_FLASH_ATTR raycasterEnterMode(void)
     RAY_PRINTF("system_get_free_heap_size %d\n", system_get_free_heap_size());
 }
 
+/**
+ * Load a 48x48 PNG into a texture's bit planes
+ *
+ * @param name The name of the PNG to load
+ * @param tex  The texture to load it into
+ */
+static void ICACHE_FLASH_ATTR loadRayTexture(const char* name, rayTex_t* tex)
+{
+    pngHandle tmpPngHandle;
+    if(allocPngAsset(name, &tmpPngHandle))
+    {
+        if(TEX_WIDTH == tmpPngHandle.width && TEX_HEIGHT == tmpPngHandle.height)
+        {
+            drawPngToPackedBuffer(&tmpPngHandle, tex->color, tex->mask);
+        }
+        freePngAsset(&tmpPngHandle);
+    }
+}
+
 /**
  * Free all resources allocated in raycasterEnterMode
  */
@@ -530,6 +571,20 @@ void ICACHE_FLASH_ATTR raycasterExitMode(void)
     // Free menu
     deinitMenu(rc->menu);
 
+    // Free the map
+    if(NULL != rc->map)
+    {
+        os_free(rc->map);
+    }
+    if(NULL != rc->flowField)
+    {
+        os_free(rc->flowField);
+    }
+    if(NULL != rc->flowQueue)
+    {
+        os_free(rc->flowQueue);
+    }
+
     // Free HUD assets (textures dont need freeing)
     freePngAsset(&(rc->heart));
     freePngAsset(&(rc->mnote));
@@ -597,52 +652,49 @@ void ICACHE_FLASH_ATTR raycasterInitGame(raycasterDifficulty_t difficulty)
     rc->kills = 0;
     uint16_t spawnIdx = 0;
 #ifndef TEST_GAME_OVER
-    // Look over the whole map
-    for(uint8_t x = 0; x < rc->mapW; x++)
-    {
-        for(uint8_t y = 0; y < rc->mapH; y++)
-        {
-            // If this is a spawn point
-            if(MAP_TILE(x, y) == WMT_S)
+    // Spawn points were found when the map was converted, in map order
+    for(uint16_t sp = 0; sp < rc->numSpawns; sp++)
+    {
+        uint8_t x = rc->spawns[sp] & 0xFFFF;
+        uint8_t y = rc->spawns[sp] >> 16;
+
+        // If a sprite should be spawned at this point
+        if(rc->liveSprites < NUM_SPRITES && (((spawnIdx % diffMod) > 0) || (RC_HARD == difficulty)))
+        {
+            // Spawn it here
+            rc->sprites[rc->liveSprites].posX = x;
+            rc->sprites[rc->liveSprites].posY = y;
+            rc->sprites[rc->liveSprites].dirX = 0;
+            rc->sprites[rc->liveSprites].dirX = 0;
+            rc->sprites[rc->liveSprites].shotCooldown = 0;
+            rc->sprites[rc->liveSprites].shotWillMiss = 0;
+            rc->sprites[rc->liveSprites].isBackwards = false;
+            rc->sprites[rc->liveSprites].invincibilityTimer = 0;
+            rc->sprites[rc->liveSprites].followFlow = false;
+            switch(rc->difficulty)
             {
-                // And a sprite should be spawned
-                if(rc->liveSprites < NUM_SPRITES && (((spawnIdx % diffMod) > 0) || (RC_HARD == difficulty)))
+                default:
+                case RC_NUM_DIFFICULTIES:
+                case RC_EASY:
                 {
-                    // Spawn it here
-                    rc->sprites[rc->liveSprites].posX = x;
-                    rc->sprites[rc->liveSprites].posY = y;
-                    rc->sprites[rc->liveSprites].dirX = 0;
-                    rc->sprites[rc->liveSprites].dirX = 0;
-                    rc->sprites[rc->liveSprites].shotCooldown = 0;
-                    rc->sprites[rc->liveSprites].shotWillMiss = 0;
-                    rc->sprites[rc->liveSprites].isBackwards = false;
-                    rc->sprites[rc->liveSprites].invincibilityTimer = 0;
-                    switch(rc->difficulty)
-                    {
-                        default:
-                        case RC_NUM_DIFFICULTIES:
-                        case RC_EASY:
-                        {
-                            rc->sprites[rc->liveSprites].health = ENEMY_HEALTH_E;
-                            break;
-                        }
-                        case RC_MED:
-                        {
-                            rc->sprites[rc->liveSprites].health = ENEMY_HEALTH_M;
-                            break;
-                        }
-                        case RC_HARD:
-                        {
-                            rc->sprites[rc->liveSprites].health = ENEMY_HEALTH_H;
-                            break;
-                        }
-                    }
-                    setSpriteState(&(rc->sprites[rc->liveSprites]), E_IDLE);
-                    rc->liveSprites++;
+                    rc->sprites[rc->liveSprites].health = ENEMY_HEALTH_E;
+                    break;
+                }
+                case RC_MED:
+                {
+                    rc->sprites[rc->liveSprites].health = ENEMY_HEALTH_M;
+                    break;
+                }
+                case RC_HARD:
+                {
+                    rc->sprites[rc->liveSprites].health = ENEMY_HEALTH_H;
+                    break;
                 }
-                spawnIdx++;
             }
+            setSpriteState(&(rc->sprites[rc->liveSprites]), E_IDLE);
+            rc->liveSprites++;
         }
+        spawnIdx++;
     }
 #else
     // For testing, just spawn one sprite
@@ -655,10 +707,18 @@ void ICACHE_FLASH_ATTR raycasterInitGame(raycasterDifficulty_t difficulty)
     rc->sprites[rc->liveSprites].isBackwards = false;
     rc->sprites[rc->liveSprites].invincibilityTimer = 0;
     rc->sprites[rc->liveSprites].health = ENEMY_HEALTH_E;
+    rc->sprites[rc->liveSprites].followFlow = false;
     setSpriteState(&(rc->sprites[rc->liveSprites]), E_IDLE);
     rc->liveSprites++;
 #endif
 
+    // Every spawned sprite starts in the draw order, which is sorted while drawing
+    rc->numSpawned = rc->liveSprites;
+    for(uint8_t i = 0; i < rc->numSpawned; i++)
+    {
+        rc->spriteOrder[i] = i;
+    }
+
     // Set health based on the number of enemies and difficulty
     if(RC_EASY == difficulty)
     {
@@ -693,6 +753,18 @@ void ICACHE_FLASH_ATTR raycasterInitGame(raycasterDifficulty_t difficulty)
     rc->closestAngle = 0;
     rc->radarObstructed = false;
 
+    // Draw a full frame first, in case of interlacing
+    rc->lastQuality = RQ_AUTO;
+    rc->autoInterlace = false;
+
+    // Compute the flow field the first time enemies move
+    rc->flowCellX = -1;
+    rc->flowCellY = -1;
+
+#if defined(RAY_BENCHMARK)
+    raycasterBenchmarkRays();
+#endif
+
     // Start the round clock
     rc->tRoundElapsed = 0;
     rc->tRoundStartedUs = system_get_time();
@@ -779,6 +851,22 @@ void ICACHE_FLASH_ATTR raycasterMenuButtonCallback(const char* selected)
     {
         rc->difficulty = RC_HARD;
     }
+    else if(rc_q_auto == selected)
+    {
+        rc->quality = RQ_AUTO;
+    }
+    else if(rc_q_full == selected)
+    {
+        rc->quality = RQ_FULL;
+    }
+    else if(rc_q_half == selected)
+    {
+        rc->quality = RQ_HALF;
+    }
+    else if(rc_q_intr == selected)
+    {
+        rc->quality = RQ_INTERLACED;
+    }
     else if (rc_scores == selected)
     {
         // Show some scores
@@ -848,8 +936,8 @@ bool ICACHE_FLASH_ATTR raycasterRenderTask(void)
                 break;
             }
         }
-        return true;
     }
+    // Let updateOLED() only send what changed
     return false;
 }
 
@@ -885,28 +973,120 @@ void ICACHE_FLASH_ATTR raycasterGameRenderer(uint32_t tElapsedUs)
         rc->killedSpriteTimer -= tElapsedUs;
     }
 
-    // Cast all the rays for the scene and save the result
-    rayResult_t rayResult[OLED_WIDTH] = {{0}};
-    castRays(rayResult);
+    uint32_t tRenderStartUs = system_get_time();
+    rc->tRoundElapsed = tRenderStartUs - rc->tRoundStartedUs;
+
+    // Pick which columns to cast and texture this frame
+    rayQuality_t quality = rc->quality;
+    if(RQ_AUTO == quality)
+    {
+        quality = rc->autoInterlace ? RQ_INTERLACED : RQ_FULL;
+    }
+    int32_t firstCol = 0;
+    int32_t colStep = 1;
+    if(RQ_HALF == quality)
+    {
+        colStep = 2;
+    }
+    else if(RQ_INTERLACED == quality && RQ_INTERLACED == rc->lastQuality)
+    {
+        // Interlacing reuses last frame's columns, so it has to start from a full frame
+        firstCol = rc->interlaceCol;
+        colStep = 2;
+        rc->interlaceCol = 1 - rc->interlaceCol;
+    }
+    rc->lastQuality = quality;
+
+    // Cast the rays for the scene and save the result
+    castRays(rc->rays, firstCol, colStep);
+    if(RQ_HALF == quality)
+    {
+        // Double the columns which were cast
+        for(int32_t x = 0; x < OLED_WIDTH; x += 2)
+        {
+            rc->rays[x + 1] = rc->rays[x];
+        }
+    }
 
     // Clear the display, then draw all the layers
     clearDisplay();
-    drawTextures(rayResult);
-    drawOutlines(rayResult);
-    drawSprites(rayResult);
+    drawTextures(rc->rays, firstCol, colStep);
+
+    // Fill in the walls for the columns which weren't textured
+    uint32_t opaque[OLED_HEIGHT / 32];
+    ets_memset(opaque, 0xFF, sizeof(opaque));
+    if(RQ_HALF == quality)
+    {
+        for(int32_t x = 0; x < OLED_WIDTH; x += 2)
+        {
+            uint32_t column[OLED_HEIGHT / 32];
+            getColumnBits(x, column);
+            drawColumnBits(x + 1, column, opaque);
+        }
+    }
+    else if(RQ_INTERLACED == quality)
+    {
+        // Save the new columns, and restore the old ones
+        for(int32_t x = 0; x < OLED_WIDTH; x++)
+        {
+            if(1 == colStep || firstCol == (x & 1))
+            {
+                getColumnBits(x, rc->wallCols[x]);
+            }
+            else
+            {
+                drawColumnBits(x, rc->wallCols[x], opaque);
+            }
+        }
+    }
+
+    drawOutlines(rc->rays);
+    drawSprites(rc->rays);
     drawHUD();
+
+    // Interlace automatically when frames are slow, and stop when there's time to spare
+    uint32_t tRenderUs = system_get_time() - tRenderStartUs;
+    if(tRenderUs > RAY_FRAME_BUDGET_US)
+    {
+        rc->autoInterlace = true;
+    }
+    else if(tRenderUs < RAY_FRAME_BUDGET_US / 2)
+    {
+        rc->autoInterlace = false;
+    }
+}
+
+/**
+ * Cast rays into the scene, iterating across the X axis, and save the
+ * results in the rayResult argument. This uses castRaysFixed() unless
+ * RAY_FIXED_POINT is commented out
+ *
+ * @param rayResult A pointer to an array of rayResult_t where this scene's
+ *                  information is stored
+ * @param firstCol  The first column to cast a ray for
+ * @param colStep   The distance between columns to cast rays for
+ */
+void ICACHE_FLASH_ATTR castRays(rayResult_t* rayResult, int32_t firstCol, int32_t colStep)
+{
+#if defined(RAY_FIXED_POINT)
+    castRaysFixed(rayResult, firstCol, colStep);
+#else
+    castRaysFloat(rayResult, firstCol, colStep);
+#endif
 }
 
 /**
- * Cast all the rays into the scene, iterating across the X axis, and save the
- * results in the rayResult argument
+ * Cast all the rays into the scene with floating point math, iterating across
+ * the X axis, and save the results in the rayResult argument
  *
  * @param rayResult A pointer to an array of rayResult_t where this scene's
  *                  information is stored
+ * @param firstCol  The first column to cast a ray for
+ * @param colStep   The distance between columns to cast rays for
  */
-void ICACHE_FLASH_ATTR castRays(rayResult_t* rayResult)
+void ICACHE_FLASH_ATTR castRaysFloat(rayResult_t* rayResult, int32_t firstCol, int32_t colStep)
 {
-    for(int32_t x = 0; x < OLED_WIDTH; x++)
+    for(int32_t x = firstCol; x < OLED_WIDTH; x += colStep)
     {
         // calculate ray position and direction
         // x-coordinate in camera space
@@ -1032,13 +1212,416 @@ void ICACHE_FLASH_ATTR castRays(rayResult_t* rayResult)
 }
 
 /**
- * With the data in rayResult, render all the wall textures to the scene
+ * Approximate the reciprocal of a positive 16.16 fixed point number, without
+ * a divide. The input is normalized so its leading one is the top bit, then
+ * the reciprocal is linearly interpolated from recipTable. This is accurate
+ * to about 2 parts in 100000
+ *
+ * @param x A positive 16.16 fixed point number
+ * @return 1 / x as a 16.16 fixed point number, saturated to INT32_MAX
+ */
+static inline uint32_t fxRecip(uint32_t x)
+{
+    // Inputs less than 4 / FX_ONE would overflow
+    if(x < 4)
+    {
+        return INT32_MAX;
+    }
+    uint32_t n = __builtin_clz(x);
+
+    // Normalize, then split the mantissa into a table index and a fraction
+    uint32_t m = x << n;
+    uint32_t i = (m >> (31 - RECIP_BITS)) & ((1 << RECIP_BITS) - 1);
+    uint32_t f = (m >> (23 - RECIP_BITS)) & 0xFF;
+
+    // Neighboring entries differ by less than 2^24, so this can't overflow
+    uint32_t r = recipTable[i] - (((recipTable[i] - recipTable[i + 1]) * f) >> 8);
+
+    // recipTable is scaled by 2^31, and normalizing scaled x by 2^n
+    return r >> (30 - n);
+}
+
+/**
+ * Cast all the rays into the scene with 16.16 fixed point math, iterating
+ * across the X axis, and save the results in the rayResult argument. The
+ * ESP8266 has no FPU or hardware divider, so this replaces the per-column
+ * soft float divides and multiplies of castRaysFloat() with integer math and
+ * a reciprocal table. The results should match castRaysFloat() to within a
+ * pixel
+ *
+ * @param rayResult A pointer to an array of rayResult_t where this scene's
+ *                  information is stored
+ * @param firstCol  The first column to cast a ray for
+ * @param colStep   The distance between columns to cast rays for
+ */
+void ICACHE_FLASH_ATTR castRaysFixed(rayResult_t* rayResult, int32_t firstCol, int32_t colStep)
+{
+    // Convert the camera to fixed point once per frame
+    q16_t posX   = (q16_t)(rc->posX * FX_ONE);
+    q16_t posY   = (q16_t)(rc->posY * FX_ONE);
+    q16_t dirX   = (q16_t)(rc->dirX * FX_ONE);
+    q16_t dirY   = (q16_t)(rc->dirY * FX_ONE);
+    q16_t planeX = (q16_t)(rc->planeX * FX_ONE);
+    q16_t planeY = (q16_t)(rc->planeY * FX_ONE);
+
+    // which box of the map we're in, and where in it, which is the same for every ray
+    int32_t startMapX = posX >> FX_SHIFT;
+    int32_t startMapY = posY >> FX_SHIFT;
+    q16_t fracX = posX - (startMapX << FX_SHIFT);
+    q16_t fracY = posY - (startMapY << FX_SHIFT);
+
+    for(int32_t x = firstCol; x < OLED_WIDTH; x += colStep)
+    {
+        // calculate ray position and direction
+        // x-coordinate in camera space is ((2 * x) / OLED_WIDTH) - 1, which
+        // is applied as an exact integer multiply and a divide by a power of two
+        int32_t cameraX = (2 * x) - OLED_WIDTH;
+        q16_t rayDirX = dirX + ((planeX * cameraX) / OLED_WIDTH);
+        q16_t rayDirY = dirY + ((planeY * cameraX) / OLED_WIDTH);
+
+        // which box of the map we're in
+        int32_t mapX = startMapX;
+        int32_t mapY = startMapY;
+
+        // length of ray from one x or y-side to next x or y-side
+        q16_t deltaDistX = fxRecip(ABS(rayDirX));
+        if(deltaDistX > FX_MAX_DELTA)
+        {
+            deltaDistX = FX_MAX_DELTA;
+        }
+
+        q16_t deltaDistY = fxRecip(ABS(rayDirY));
+        if(deltaDistY > FX_MAX_DELTA)
+        {
+            deltaDistY = FX_MAX_DELTA;
+        }
+
+        // what direction to step in x or y-direction (either +1 or -1)
+        int32_t stepX;
+        int32_t stepY;
+
+        // length of ray from current position to next x or y-side
+        q16_t sideDistX;
+        q16_t sideDistY;
+
+        int32_t hit = 0; // was there a wall hit?
+        int32_t side; // was a NS or a EW wall hit?
+        // calculate step and initial sideDist
+        if(rayDirX < 0)
+        {
+            stepX = -1;
+            sideDistX = ((int64_t)fracX * deltaDistX) >> FX_SHIFT;
+        }
+        else
+        {
+            stepX = 1;
+            sideDistX = ((int64_t)(FX_ONE - fracX) * deltaDistX) >> FX_SHIFT;
+        }
+
+        if(rayDirY < 0)
+        {
+            stepY = -1;
+            sideDistY = ((int64_t)fracY * deltaDistY) >> FX_SHIFT;
+        }
+        else
+        {
+            stepY = 1;
+            sideDistY = ((int64_t)(FX_ONE - fracY) * deltaDistY) >> FX_SHIFT;
+        }
+
+        // perform DDA
+        while (hit == 0)
+        {
+            // jump to next map square, OR in x-direction, OR in y-direction
+            if(sideDistX < sideDistY)
+            {
+                sideDistX += deltaDistX;
+                mapX += stepX;
+                side = 0;
+            }
+            else
+            {
+                sideDistY += deltaDistY;
+                mapY += stepY;
+                side = 1;
+            }
+
+            // Check if ray has hit a wall
+            if(MAP_TILE(mapX, mapY) <= WMT_C)
+            {
+                hit = 1;
+            }
+        }
+
+        // Calculate distance projected on camera direction. The last step
+        // overshot the wall by one delta, so back it off rather than divide
+        q16_t perpWallDist;
+        if(side == 0)
+        {
+            perpWallDist = sideDistX - deltaDistX;
+        }
+        else
+        {
+            perpWallDist = sideDistY - deltaDistY;
+        }
+
+        // Calculate height of line to draw on screen
+        int32_t lineHeight;
+        if(perpWallDist > 0)
+        {
+            lineHeight = ((int64_t)fxRecip(perpWallDist) * OLED_HEIGHT) >> FX_SHIFT;
+        }
+        else
+        {
+            lineHeight = 0;
+        }
+
+        // calculate lowest and highest pixel to fill in current stripe
+        int32_t drawStart = -lineHeight / 2 + OLED_HEIGHT / 2;
+        int32_t drawEnd = lineHeight / 2 + OLED_HEIGHT / 2;
+
+        // Save a bunch of data to render the scene later
+        rayResult[x].mapX = mapX;
+        rayResult[x].mapY = mapY;
+        rayResult[x].side = side;
+        rayResult[x].drawEnd = drawEnd;
+        rayResult[x].drawStart = drawStart;
+        rayResult[x].perpWallDist = perpWallDist * (1.0f / FX_ONE);
+        rayResult[x].rayDirX = rayDirX * (1.0f / FX_ONE);
+        rayResult[x].rayDirY = rayDirY * (1.0f / FX_ONE);
+    }
+}
+
+#if defined(RAY_BENCHMARK)
+/**
+ * Cast rays from the player's position in a full circle with both
+ * castRaysFloat() and castRaysFixed(), then print how long each took and how
+ * far apart their results were
+ */
+static void ICACHE_FLASH_ATTR raycasterBenchmarkRays(void)
+{
+    rayResult_t* floatResult = (rayResult_t*)os_malloc(sizeof(rayResult_t) * OLED_WIDTH);
+    rayResult_t* fixedResult = (rayResult_t*)os_malloc(sizeof(rayResult_t) * OLED_WIDTH);
+    if(NULL == floatResult || NULL == fixedResult)
+    {
+        os_free(floatResult);
+        os_free(fixedResult);
+        return;
+    }
+
+    // Save the camera to restore it afterwards
+    float dirX = rc->dirX;
+    float dirY = rc->dirY;
+    float planeX = rc->planeX;
+    float planeY = rc->planeY;
+
+    const int32_t numAngles = 64;
+    uint32_t floatUs = 0;
+    uint32_t fixedUs = 0;
+    int32_t maxPxDiff = 0;
+    int32_t cellMismatches = 0;
+    for(int32_t a = 0; a < numAngles; a++)
+    {
+        // Rotate the initial camera around the circle
+        float angle = (2 * M_PI * a) / numAngles;
+        float c = cosf(angle);
+        float s = sinf(angle);
+        rc->dirX   = dirX * c - dirY * s;
+        rc->dirY   = dirX * s + dirY * c;
+        rc->planeX = planeX * c - planeY * s;
+        rc->planeY = planeX * s + planeY * c;
+
+        uint32_t tStart = system_get_time();
+        castRaysFloat(floatResult, 0, 1);
+        uint32_t tMid = system_get_time();
+        castRaysFixed(fixedResult, 0, 1);
+        uint32_t tEnd = system_get_time();
+        floatUs += (tMid - tStart);
+        fixedUs += (tEnd - tMid);
+
+        for(int32_t x = 0; x < OLED_WIDTH; x++)
+        {
+            int32_t startDiff = ABS(floatResult[x].drawStart - fixedResult[x].drawStart);
+            int32_t endDiff   = ABS(floatResult[x].drawEnd - fixedResult[x].drawEnd);
+            maxPxDiff = (startDiff > maxPxDiff) ? startDiff : maxPxDiff;
+            maxPxDiff = (endDiff > maxPxDiff) ? endDiff : maxPxDiff;
+            if(floatResult[x].mapX != fixedResult[x].mapX || floatResult[x].mapY != fixedResult[x].mapY)
+            {
+                cellMismatches++;
+            }
+        }
+    }
+
+    rc->dirX = dirX;
+    rc->dirY = dirY;
+    rc->planeX = planeX;
+    rc->planeY = planeY;
+
+    os_printf("%s::%d float %dus, fixed %dus per frame, max %dpx apart, %d/%d cells differ\n",
+              __func__, __LINE__, floatUs / numAngles, fixedUs / numAngles, maxPxDiff,
+              cellMismatches, numAngles * OLED_WIDTH);
+
+    os_free(floatResult);
+    os_free(fixedResult);
+}
+#endif
+
+#if defined(EMU)
+/**
+ * Render a deterministic scene on RC_MAP_L for a number of frames, then exit.
+ * The camera walks along rayBenchPath, every spawn point holds an idle enemy,
+ * and nothing depends on input, randomness, or the wall clock. The time spent
+ * in each render stage and a checksum of the framebuffer are printed per frame,
+ * so changes to the renderer can be compared for both speed and output
+ *
+ * @param numFrames The number of frames to render
+ */
+void ICACHE_FLASH_ATTR raycasterBenchmark(uint32_t numFrames)
+{
+    // Set up the large map with enemies at every spawn point
+    raycasterEnterMode();
+    rc->mapIdx = RC_MAP_L;
+    if(!raycasterSetMap())
+    {
+        os_printf("%s::%d couldn't load the map\n", __func__, __LINE__);
+        raycasterExitMode();
+        return;
+    }
+    raycasterInitGame(RC_HARD);
+
+    uint32_t totalUs[5] = {0};
+    for(uint32_t frame = 0; frame < numFrames; frame++)
+    {
+        raycasterBenchmarkCamera(frame);
+        rc->tRoundElapsed = frame * RAY_BENCH_FRAME_US;
+
+        // Render all the stages, timing each one
+        uint32_t tStage[6];
+        tStage[0] = system_get_time();
+        castRays(rc->rays, 0, 1);
+        tStage[1] = system_get_time();
+        clearDisplay();
+        drawTextures(rc->rays, 0, 1);
+        tStage[2] = system_get_time();
+        drawOutlines(rc->rays);
+        tStage[3] = system_get_time();
+        drawSprites(rc->rays);
+        tStage[4] = system_get_time();
+        drawHUD();
+        tStage[5] = system_get_time();
+
+        // FNV-1a the framebuffer, a column at a time
+        uint32_t checksum = 2166136261u;
+        for(int32_t x = 0; x < OLED_WIDTH; x++)
+        {
+            uint32_t column[OLED_HEIGHT / 32];
+            getColumnBits(x, column);
+            for(uint8_t word = 0; word < (OLED_HEIGHT / 32); word++)
+            {
+                checksum = (checksum ^ column[word]) * 16777619u;
+            }
+        }
+
+        for(uint8_t stage = 0; stage < 5; stage++)
+        {
+            totalUs[stage] += tStage[stage + 1] - tStage[stage];
+        }
+        os_printf("frame %4d cast %5dus tex %5dus outline %5dus sprite %5dus hud %5dus fb %08x\n",
+                  frame, tStage[1] - tStage[0], tStage[2] - tStage[1], tStage[3] - tStage[2],
+                  tStage[4] - tStage[3], tStage[5] - tStage[4], checksum);
+    }
+
+    if(numFrames > 0)
+    {
+        os_printf("average cast %5dus tex %5dus outline %5dus sprite %5dus hud %5dus\n",
+                  totalUs[0] / numFrames, totalUs[1] / numFrames, totalUs[2] / numFrames,
+                  totalUs[3] / numFrames, totalUs[4] / numFrames);
+    }
+
+    raycasterExitMode();
+}
+
+/**
+ * Place the camera for a benchmark frame. The camera turns in place to face
+ * each leg of rayBenchPath, then walks down it at a constant speed. When the
+ * path runs out, it starts over from the beginning
+ *
+ * @param frame The benchmark frame to place the camera for
+ */
+static void ICACHE_FLASH_ATTR raycasterBenchmarkCamera(uint32_t frame)
+{
+    const int32_t numPoints = sizeof(rayBenchPath) / sizeof(rayBenchPath[0]);
+    float heading = atan2f(rayBenchPath[1][1] - rayBenchPath[0][1], rayBenchPath[1][0] - rayBenchPath[0][0]);
+    float posX = 0;
+    float posY = 0;
+    int32_t leg = 0;
+    while(true)
+    {
+        float fromX = rayBenchPath[leg][0] + 0.5f;
+        float fromY = rayBenchPath[leg][1] + 0.5f;
+        float dX = rayBenchPath[leg + 1][0] - rayBenchPath[leg][0];
+        float dY = rayBenchPath[leg + 1][1] - rayBenchPath[leg][1];
+
+        // Turn to face down the leg, the short way around
+        float legHeading = atan2f(dY, dX);
+        float turn = legHeading - heading;
+        if(turn > M_PI)
+        {
+            turn -= 2 * M_PI;
+        }
+        else if(turn < -M_PI)
+        {
+            turn += 2 * M_PI;
+        }
+        uint32_t turnFrames = (uint32_t)ceilf(ABS(turn) / RAY_BENCH_TURN_STEP);
+        if(frame < turnFrames)
+        {
+            posX = fromX;
+            posY = fromY;
+            heading += (turn * frame) / turnFrames;
+            break;
+        }
+        frame -= turnFrames;
+        heading = legHeading;
+
+        // Then walk down it
+        uint32_t walkFrames = (uint32_t)ceilf(sqrtf((dX * dX) + (dY * dY)) / RAY_BENCH_MOVE_STEP);
+        if(frame < walkFrames)
+        {
+            posX = fromX + (dX * frame) / walkFrames;
+            posY = fromY + (dY * frame) / walkFrames;
+            break;
+        }
+        frame -= walkFrames;
+
+        // Start over after the last leg
+        leg++;
+        if(leg == numPoints - 1)
+        {
+            leg = 0;
+        }
+    }
+
+    rc->posX = posX;
+    rc->posY = posY;
+    rc->dirX = cosf(heading);
+    rc->dirY = sinf(heading);
+    // The camera plane is perpendicular to the direction, like the initial (0, -1) and (-0.66, 0)
+    rc->planeX = rc->dirY * 0.66f;
+    rc->planeY = -rc->dirX * 0.66f;
+}
+#endif
+
+/**
+ * With the data in rayResult, render the wall textures to the scene
  *
  * @param rayResult The information for all the rays cast
+ * @param firstCol  The first column to texture
+ * @param colStep   The distance between columns to texture
  */
-void ICACHE_FLASH_ATTR drawTextures(rayResult_t* rayResult)
+void ICACHE_FLASH_ATTR drawTextures(rayResult_t* rayResult, int32_t firstCol, int32_t colStep)
 {
-    for(int32_t x = 0; x < OLED_WIDTH; x++)
+    for(int32_t x = firstCol; x < OLED_WIDTH; x += colStep)
     {
         // For convenience
         uint8_t mapX      = rayResult[x].mapX;
@@ -1070,27 +1653,27 @@ void ICACHE_FLASH_ATTR drawTextures(rayResult_t* rayResult)
             }
 
             // Pick a texture
-            color* wallTex = NULL;
+            rayTex_t* wallTex = NULL;
             switch(MAP_TILE(mapX, mapY))
             {
                 case WMT_W1:
                 {
-                    wallTex = rc->sinTex;
+                    wallTex = &rc->sinTex;
                     break;
                 }
                 case WMT_W2:
                 {
-                    wallTex = rc->brickTex;
+                    wallTex = &rc->brickTex;
                     break;
                 }
                 case WMT_W3:
                 {
-                    wallTex = rc->stripeTex;
+                    wallTex = &rc->stripeTex;
                     break;
                 }
                 case WMT_C:
                 {
-                    wallTex = rc->stoneTex;
+                    wallTex = &rc->stoneTex;
                     break;
                 }
                 default:
@@ -1145,8 +1728,12 @@ void ICACHE_FLASH_ATTR drawTextures(rayResult_t* rayResult)
                 // Increment the texture position by the step size
                 texPos += step;
 
-                // Draw the pixel specified by the texture
-                drawPixelUnsafeC(x, y, wallTex[(texX * TEX_HEIGHT) + texY ]);
+                // Draw the pixel specified by the texture, if it's opaque
+                uint32_t texIdx = (texX * TEX_HEIGHT) + texY;
+                if(TEX_BIT(wallTex->mask, texIdx))
+                {
+                    drawPixelUnsafeC(x, y, TEX_BIT(wallTex->color, texIdx) ? WHITE : BLACK);
+                }
             }
         }
     }
@@ -1210,52 +1797,72 @@ void ICACHE_FLASH_ATTR drawOutlines(rayResult_t* rayResult)
 void ICACHE_FLASH_ATTR drawSprites(rayResult_t* rayResult)
 {
     // Local memory for figuring out the draw order
-    int32_t spriteOrder[NUM_SPRITES];
+    uint8_t spriteOrder[NUM_SPRITES];
+    uint8_t spriteSlot[NUM_SPRITES];
     float spriteDistance[NUM_SPRITES];
+    float spriteTransformX[NUM_SPRITES];
+    float spriteTransformY[NUM_SPRITES];
+    int32_t numVisible = 0;
 
     // Track if any sprite was shot
     int16_t spriteIdxShot = -1;
 
-    // sort sprites from far to close
-    for(uint32_t i = 0; i < NUM_SPRITES; i++)
-    {
-        spriteOrder[i] = i;
-        // sqrt not taken, unneeded
-        spriteDistance[i] = ((rc->posX - rc->sprites[i].posX) * (rc->posX - rc->sprites[i].posX) +
-                             (rc->posY - rc->sprites[i].posY) * (rc->posY - rc->sprites[i].posY));
-    }
-    sortSprites(spriteOrder, spriteDistance, NUM_SPRITES);
+    // transform sprite with the inverse camera matrix
+    // [ planeX dirX ] -1                                  [ dirY     -dirX ]
+    // [             ]    =  1/(planeX*dirY-dirX*planeY) * [                ]
+    // [ planeY dirY ]                                     [ -planeY planeX ]
 
-    // after sorting the sprites, do the projection and draw them
-    for(uint32_t i = 0; i < NUM_SPRITES; i++)
-    {
-        // Skip over the sprite if posX is negative
-        if(rc->sprites[spriteOrder[i]].posX < 0)
-        {
-            continue;
-        }
-        // translate sprite position to relative to camera
-        float spriteX = rc->sprites[spriteOrder[i]].posX - rc->posX;
-        float spriteY = rc->sprites[spriteOrder[i]].posY - rc->posY;
+    // required for correct matrix multiplication
+    float invDet = 1.0 / (rc->planeX * rc->dirY - rc->dirX * rc->planeY);
 
-        // transform sprite with the inverse camera matrix
-        // [ planeX dirX ] -1                                  [ dirY     -dirX ]
-        // [             ]    =  1/(planeX*dirY-dirX*planeY) * [                ]
-        // [ planeY dirY ]                                     [ -planeY planeX ]
+    // Gather the sprites which could be on screen, in last frame's order.
+    // Unspawned sprites are never in rc->spriteOrder
+    for(int32_t slot = 0; slot < rc->numSpawned; slot++)
+    {
+        uint8_t idx = rc->spriteOrder[slot];
 
-        // required for correct matrix multiplication
-        float invDet = 1.0 / (rc->planeX * rc->dirY - rc->dirX * rc->planeY);
+        // translate sprite position to relative to camera
+        float spriteX = rc->sprites[idx].posX - rc->posX;
+        float spriteY = rc->sprites[idx].posY - rc->posY;
 
         float transformX = invDet * (rc->dirY * spriteX - rc->dirX * spriteY);
         // this is actually the depth inside the screen, that what Z is in 3D
         float transformY = invDet * (-rc->planeY * spriteX + rc->planeX * spriteY);
 
-        // If this is negative, the texture isn't going to be drawn, so just stop here
-        if(transformY < 0)
+        // Reject sprites behind the camera, or entirely left or right of the
+        // screen. A sprite is (OLED_HEIGHT / transformY) pixels wide, so this
+        // is the screen bounds check below with transformY multiplied through
+        if(transformY <= 0 ||
+                ABS(transformX) * (OLED_WIDTH / 2) >= (transformY * (OLED_WIDTH / 2)) + (OLED_HEIGHT / 2))
         {
             continue;
         }
 
+        spriteOrder[numVisible] = idx;
+        spriteSlot[numVisible] = slot;
+        // sqrt not taken, unneeded
+        spriteDistance[numVisible] = (spriteX * spriteX) + (spriteY * spriteY);
+        spriteTransformX[idx] = transformX;
+        spriteTransformY[idx] = transformY;
+        numVisible++;
+    }
+
+    // sort sprites from far to close. They were sorted last frame, so this is quick
+    sortSprites(spriteOrder, spriteDistance, numVisible);
+
+    // Put the sorted sprites back in the slots they came from for next frame.
+    // Rejected sprites keep their slots
+    for(int32_t i = 0; i < numVisible; i++)
+    {
+        rc->spriteOrder[spriteSlot[i]] = spriteOrder[i];
+    }
+
+    // after sorting the sprites, do the projection and draw them
+    for(int32_t i = 0; i < numVisible; i++)
+    {
+        float transformX = spriteTransformX[spriteOrder[i]];
+        float transformY = spriteTransformY[spriteOrder[i]];
+
         int32_t spriteScreenX = (int32_t)((OLED_WIDTH / 2) * (1 + transformX / transformY));
 
         // calculate height of the sprite on screen
@@ -1296,76 +1903,99 @@ void ICACHE_FLASH_ATTR drawSprites(rayResult_t* rayResult)
             drawEndX = OLED_WIDTH;
         }
 
-        // loop through every vertical stripe of the sprite on screen
+        // Shrink the columns to the ones in front of the walls, using the
+        // ZBuffer with perpendicular distance
+        while(drawStartX < drawEndX && transformY >= rayResult[drawStartX].perpWallDist)
+        {
+            drawStartX++;
+        }
+        while(drawEndX > drawStartX && transformY >= rayResult[drawEndX - 1].perpWallDist)
+        {
+            drawEndX--;
+        }
+
+        // If the sprite is entirely behind walls or too small to draw, don't
+        if(drawStartX >= drawEndX || drawStartY >= drawEndY)
+        {
+            continue;
+        }
+
+        raySprite_t* sprite = &rc->sprites[spriteOrder[i]];
+        rayTex_t* tex = sprite->texture;
+
+        // Flicker while invincible by inverting the texture
+        uint32_t invert = (sprite->invincibilityTimer > 0 &&
+                           (sprite->invincibilityTimer % INVINCIBILITY_HZ > (INVINCIBILITY_HZ / 2))) ? 1 : 0;
+
+        // Every column uses the same texture row for each screen row, so find
+        // them once. texY is floor(((y - OLED_HEIGHT / 2) + spriteHeight / 2) * TEX_HEIGHT / spriteHeight),
+        // stepped without dividing per row
+        uint8_t texYTable[OLED_HEIGHT];
+        int32_t texYNum = ((2 * (drawStartY - OLED_HEIGHT / 2)) + spriteHeight) * (TEX_HEIGHT / 2);
+        int32_t texY = texYNum / spriteHeight;
+        int32_t texYRem = texYNum % spriteHeight;
+        for(int32_t y = drawStartY; y < drawEndY; y++)
+        {
+            texYTable[y] = texY;
+            texYRem += TEX_HEIGHT;
+            while(texYRem >= spriteHeight)
+            {
+                texYRem -= spriteHeight;
+                texY++;
+            }
+        }
+
+        // texX is floor((stripe - left edge) * TEX_WIDTH / spriteWidth), also stepped
+        int32_t texXNum = (drawStartX - (-spriteWidth / 2 + spriteScreenX)) * TEX_WIDTH;
+        int32_t texX = texXNum / spriteWidth;
+        int32_t texXRem = texXNum % spriteWidth;
+
+        // loop through every visible vertical stripe of the sprite on screen
         for(int32_t stripe = drawStartX; stripe < drawEndX; stripe++)
         {
-            int32_t texX = (int32_t)(256 * (stripe - (-spriteWidth / 2 + spriteScreenX)) * TEX_WIDTH / spriteWidth) / 256;
-            // the conditions in the if are:
-            // 1) it's in front of camera plane so you don't see things behind you
-            // 2) it's on the screen (left)
-            // 3) it's on the screen (right)
-            // 4) ZBuffer, with perpendicular distance
+            // Columns in the middle may still be behind a wall
             if(transformY < rayResult[stripe].perpWallDist)
             {
-                // for every pixel of the current stripe
-                for(int32_t y = drawStartY; y < drawEndY; y++)
+                // If the sprite is mirrored, get the mirrored column
+                uint16_t texColIdx;
+                if(sprite->mirror)
                 {
-                    // 256 and 128 factors to avoid floats
-                    int32_t d = (y) * 256 - OLED_HEIGHT * 128 + spriteHeight * 128;
-                    int32_t texY = ((d * TEX_HEIGHT) / spriteHeight) / 256;
-                    // get current color from the texture
-                    uint16_t texIdx = 0;
-
-                    // If the sprite is mirrored, get the mirrored idx
-                    if(rc->sprites[spriteOrder[i]].mirror)
-                    {
-                        texIdx = ((TEX_WIDTH - texX - 1) * TEX_HEIGHT) + texY;
-                    }
-                    else
-                    {
-                        texIdx = (texX * TEX_HEIGHT) + texY;
-                    }
+                    texColIdx = (TEX_WIDTH - texX - 1) * TEX_HEIGHT;
+                }
+                else
+                {
+                    texColIdx = texX * TEX_HEIGHT;
+                }
 
-                    // draw the pixel for the texture, maybe inverted
-                    if(rc->sprites[spriteOrder[i]].invincibilityTimer > 0 &&
-                            (rc->sprites[spriteOrder[i]].invincibilityTimer % INVINCIBILITY_HZ > (INVINCIBILITY_HZ / 2)))
-                    {
-                        switch(rc->sprites[spriteOrder[i]].texture[texIdx])
-                        {
-                            case BLACK:
-                            {
-                                drawPixelUnsafeC(stripe, y, WHITE);
-                                break;
-                            }
-                            case WHITE:
-                            {
-                                drawPixelUnsafeC(stripe, y, BLACK);
-                                break;
-                            }
-                            case INVERSE:
-                            case TRANSPARENT_COLOR:
-                            case WHITE_F_TRANSPARENT_B:
-                            default:
-                            {
-                                // These don't draw
-                                break;
-                            }
-                        }
-                    }
-                    else
-                    {
-                        drawPixelUnsafeC(stripe, y, rc->sprites[spriteOrder[i]].texture[texIdx]);
-                    }
+                // Gather the whole stripe, then draw it at once
+                uint32_t colorBits[OLED_HEIGHT / 32] = {0};
+                uint32_t maskBits[OLED_HEIGHT / 32] = {0};
+                for(int32_t y = drawStartY; y < drawEndY; y++)
+                {
+                    uint16_t texIdx = texColIdx + texYTable[y];
+                    uint32_t opaque = TEX_BIT(tex->mask, texIdx);
+                    uint32_t texColor = TEX_BIT(tex->color, texIdx) ^ invert;
+                    maskBits[y >> 5] |= opaque << (y & 31);
+                    colorBits[y >> 5] |= texColor << (y & 31);
+                }
+                drawColumnBits(stripe, colorBits, maskBits);
 
-                    // If we should check a shot, and a sprite is centered
-                    if(true == rc->checkShot && (stripe == 63 || stripe == 64) &&
-                            rc->sprites[spriteOrder[i]].health > 0)
-                    {
-                        // Mark that sprite as shot
-                        spriteIdxShot = spriteOrder[i];
-                    }
+                // If we should check a shot, and a sprite is centered
+                if(true == rc->checkShot && (stripe == 63 || stripe == 64) &&
+                        sprite->health > 0)
+                {
+                    // Mark that sprite as shot
+                    spriteIdxShot = spriteOrder[i];
                 }
             }
+
+            // Step to the next texture column
+            texXRem += TEX_WIDTH;
+            while(texXRem >= spriteWidth)
+            {
+                texXRem -= spriteWidth;
+                texX++;
+            }
         }
     }
 
@@ -1417,34 +2047,31 @@ void ICACHE_FLASH_ATTR drawSprites(rayResult_t* rayResult)
 }
 
 /**
- * Bubble sort algorithm to which sorts both order and dist by the values in dist
+ * Insertion sort which sorts both order and dist by the values in dist, far to
+ * close. Sprites barely move between frames, so the input is nearly sorted and
+ * this is close to linear
  *
  * @param order  Sprite indices to be sorted by dist
  * @param dist   The distances from the camera to the sprites
  * @param amount The number of values to sort
  */
-void ICACHE_FLASH_ATTR sortSprites(int32_t* order, float* dist, int32_t amount)
+void ICACHE_FLASH_ATTR sortSprites(uint8_t* order, float* dist, int32_t amount)
 {
-    // Iterate over everything
-    for (int32_t i = 0; i < amount - 1; i++)
+    for (int32_t i = 1; i < amount; i++)
     {
-        // Last i elements are already in place
-        for (int32_t j = 0; j < amount - i - 1; j++)
+        float tmpDist = dist[i];
+        uint8_t tmpOrder = order[i];
+
+        // Shift closer sprites towards the end until this one fits
+        int32_t j = i - 1;
+        while (j >= 0 && dist[j] < tmpDist)
         {
-            // If the smaller distance is first
-            if (dist[j] < dist[j + 1])
-            {
-                // Swap the dist[] elements
-                float tmp = dist[j];
-                dist[j] = dist[j + 1];
-                dist[j + 1] = tmp;
-
-                // And also swap the order[] elements
-                int32_t tmp2 = order[j];
-                order[j] = order[j + 1];
-                order[j + 1] = tmp2;
-            }
+            dist[j + 1] = dist[j];
+            order[j + 1] = order[j];
+            j--;
         }
+        dist[j + 1] = tmpDist;
+        order[j + 1] = tmpOrder;
     }
 }
 
@@ -1703,6 +2330,9 @@ void ICACHE_FLASH_ATTR moveEnemies(uint32_t tElapsedUs)
     rc->closestAngle = 0;
     rc->radarObstructed = false;
 
+    // Make sure the flow field leads to the player's cell
+    updateFlowField();
+
     // Figure out the movement speed for this frame
     float moveSpeed;
     switch(rc->difficulty)
@@ -1808,6 +2438,7 @@ void ICACHE_FLASH_ATTR moveEnemies(uint32_t tElapsedUs)
 
                 // Have the sprite move foward
                 rc->sprites[i].isBackwards = false;
+                rc->sprites[i].followFlow = false;
 
                 // And let the sprite walk for a bit
                 setSpriteState(&(rc->sprites[i]), E_WALKING);
@@ -1827,6 +2458,15 @@ void ICACHE_FLASH_ATTR moveEnemies(uint32_t tElapsedUs)
                     // Take the shot!
                     setSpriteState(&(rc->sprites[i]), E_SHOOTING);
                 }
+                else if(followFlowField(&(rc->sprites[i])))
+                {
+                    // The flow field picked a direction around the walls towards the player
+                    rc->sprites[i].isBackwards = false;
+                    rc->sprites[i].followFlow = true;
+
+                    // And let the sprite walk for a bit
+                    setSpriteState(&(rc->sprites[i]), E_WALKING);
+                }
                 else // Pick a direction to walk in
                 {
                     // Normalize the vector
@@ -1863,6 +2503,7 @@ void ICACHE_FLASH_ATTR moveEnemies(uint32_t tElapsedUs)
                     rc->sprites[i].dirX = toPlayerX;
                     rc->sprites[i].dirY = toPlayerY;
                     rc->sprites[i].isBackwards = false;
+                    rc->sprites[i].followFlow = false;
 
                     // And let the sprite walk for a bit
                     setSpriteState(&(rc->sprites[i]), E_WALKING);
@@ -1890,7 +2531,7 @@ void ICACHE_FLASH_ATTR moveEnemies(uint32_t tElapsedUs)
                     rc->sprites[i].texTimer += STEP_ANIM_TIME;
                     // Pick the next texture
                     rc->sprites[i].texFrame = (rc->sprites[i].texFrame + 1) % NUM_WALK_FRAMES;
-                    rc->sprites[i].texture = rc->walk[rc->sprites[i].texFrame];
+                    rc->sprites[i].texture = &rc->walk[rc->sprites[i].texFrame];
                     // Mirror the texture if we're back to 0
                     if(0 == rc->sprites[i].texFrame)
                     {
@@ -1952,8 +2593,16 @@ void ICACHE_FLASH_ATTR moveEnemies(uint32_t tElapsedUs)
                 // If the move is valid, move there
                 if(moveIsValid)
                 {
+                    bool changedCell = ((int)rc->sprites[i].posX != newPosXi) ||
+                                       ((int)rc->sprites[i].posY != newPosYi);
                     rc->sprites[i].posX = newPosX;
                     rc->sprites[i].posY = newPosY;
+
+                    // When a sprite following the flow field enters a new cell, steer towards the next one
+                    if(changedCell && rc->sprites[i].followFlow && false == rc->sprites[i].isBackwards)
+                    {
+                        followFlowField(&(rc->sprites[i]));
+                    }
                 }
                 else
                 {
@@ -1980,7 +2629,7 @@ void ICACHE_FLASH_ATTR moveEnemies(uint32_t tElapsedUs)
 
                     // Pick the next texture
                     rc->sprites[i].texFrame = (rc->sprites[i].texFrame + 1) % NUM_SHOT_FRAMES;
-                    rc->sprites[i].texture = rc->shooting[rc->sprites[i].texFrame];
+                    rc->sprites[i].texture = &rc->shooting[rc->sprites[i].texFrame];
 
                     // Reset if we're back to zero
                     if(0 == rc->sprites[i].texFrame)
@@ -2040,7 +2689,7 @@ void ICACHE_FLASH_ATTR moveEnemies(uint32_t tElapsedUs)
 
                     // Pick the next texture
                     rc->sprites[i].texFrame = (rc->sprites[i].texFrame + 1) % NUM_HURT_FRAMES;
-                    rc->sprites[i].texture = rc->hurt[rc->sprites[i].texFrame];
+                    rc->sprites[i].texture = &rc->hurt[rc->sprites[i].texFrame];
 
                     // Reset if we're back to zero
                     if(0 == rc->sprites[i].texFrame)
@@ -2078,6 +2727,96 @@ void ICACHE_FLASH_ATTR moveEnemies(uint32_t tElapsedUs)
     }
 }
 
+/**
+ * Compute the flow field with a breadth first search over the map, outwards
+ * from the player's cell. Every open cell which can reach the player stores
+ * the index into flowSteps of its first step along a shortest path to the
+ * player. This only runs when the player enters a new cell, and lets every
+ * enemy find its way around walls with one lookup instead of tracing lines to
+ * the player. Storing steps rather than distances means path length isn't
+ * limited by the cell size
+ */
+static void ICACHE_FLASH_ATTR updateFlowField(void)
+{
+    int16_t pX = (int16_t)rc->posX;
+    int16_t pY = (int16_t)rc->posY;
+    if(NULL == rc->flowField || (pX == rc->flowCellX && pY == rc->flowCellY))
+    {
+        return;
+    }
+    rc->flowCellX = pX;
+    rc->flowCellY = pY;
+
+    ets_memset(rc->flowField, FLOW_UNREACHABLE, rc->mapW * rc->mapH);
+    if(pX < 0 || pX >= rc->mapW || pY < 0 || pY >= rc->mapH)
+    {
+        return;
+    }
+
+    // Start from the player's cell. Each cell is queued at most once, so the
+    // queue holds the whole map and the search always finishes
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    FLOW_CELL(pX, pY) = FLOW_GOAL;
+    rc->flowQueue[tail++] = pY + (pX * rc->mapH);
+
+    while(head != tail)
+    {
+        uint16_t cell = rc->flowQueue[head++];
+        int16_t cX = cell / rc->mapH;
+        int16_t cY = cell % rc->mapH;
+
+        for(uint8_t n = 0; n < 4; n++)
+        {
+            int16_t nX = cX + flowSteps[n][0];
+            int16_t nY = cY + flowSteps[n][1];
+
+            // Only visit cells in bounds, which aren't walls or columns, once
+            if(nX < 0 || nX >= rc->mapW || nY < 0 || nY >= rc->mapH ||
+                    MAP_TILE(nX, nY) <= WMT_C || FLOW_UNREACHABLE != FLOW_CELL(nX, nY))
+            {
+                continue;
+            }
+
+            // The neighbor steps back the way the search came
+            FLOW_CELL(nX, nY) = n ^ 1;
+            rc->flowQueue[tail++] = nY + (nX * rc->mapH);
+        }
+    }
+}
+
+/**
+ * Point a sprite at the center of its next cell along the flow field. Steps
+ * are orthogonal, so the sprite never cuts across the corner of a wall
+ *
+ * @param sprite The sprite to steer
+ * @return true if the sprite was steered, false if it is already in the
+ *         player's cell or can't reach it
+ */
+static bool ICACHE_FLASH_ATTR followFlowField(raySprite_t* sprite)
+{
+    int16_t sX = (int16_t)sprite->posX;
+    int16_t sY = (int16_t)sprite->posY;
+    if(NULL == rc->flowField || sX < 0 || sX >= rc->mapW || sY < 0 || sY >= rc->mapH)
+    {
+        return false;
+    }
+
+    uint8_t step = FLOW_CELL(sX, sY);
+    if(step >= 4)
+    {
+        return false;
+    }
+
+    // Walk towards the center of the next cell
+    float toCellX = (sX + flowSteps[step][0] + 0.5f) - sprite->posX;
+    float toCellY = (sY + flowSteps[step][1] + 0.5f) - sprite->posY;
+    float invMag = Q_rsqrt((toCellX * toCellX) + (toCellY * toCellY));
+    sprite->dirX = toCellX * invMag;
+    sprite->dirY = toCellY * invMag;
+    return true;
+}
+
 /**
  * Find the angle between a vector (position, direction) and a point
  * This is used to run the radar
@@ -2133,6 +2872,25 @@ bool ICACHE_FLASH_ATTR checkWallsBetweenPoints(float sX, float sY, float pX, flo
         return true;
     }
 
+    // Most of the time the precomputed PVS has the answer
+    switch(pvsLookup((int32_t)sX, (int32_t)sY, (int32_t)pX, (int32_t)pY))
+    {
+        case PVS_NEVER:
+        {
+            return false;
+        }
+        case PVS_ALWAYS:
+        {
+            return true;
+        }
+        default:
+        case PVS_MAYBE:
+        {
+            // Have to draw the line
+            break;
+        }
+    }
+
     // calculate ray position and direction
     // x-coordinate in camera space
     float rayDirX = sX - pX;
@@ -2217,6 +2975,63 @@ bool ICACHE_FLASH_ATTR checkWallsBetweenPoints(float sX, float sY, float pX, flo
     return false;
 }
 
+/**
+ * Look up if two cells can see each other in the map's potentially visible
+ * set, which is computed by mapconv. See mapconv.c for the layout
+ *
+ * @param aX The first cell's X coordinate
+ * @param aY The first cell's Y coordinate
+ * @param bX The second cell's X coordinate
+ * @param bY The second cell's Y coordinate
+ * @return PVS_NEVER or PVS_ALWAYS if the answer is known, PVS_MAYBE if a line
+ *         needs to be drawn, or if the cells are too far apart to know
+ */
+static rayPvs_t ICACHE_FLASH_ATTR pvsLookup(int32_t aX, int32_t aY, int32_t bX, int32_t bY)
+{
+    int32_t dX = bX - aX;
+    int32_t dY = bY - aY;
+    if(NULL == rc->pvs || ABS(dX) > RAY_PVS_RANGE || ABS(dY) > RAY_PVS_RANGE ||
+            aX < 0 || aX >= rc->mapW || aY < 0 || aY >= rc->mapH ||
+            bX < 0 || bX >= rc->mapW || bY < 0 || bY >= rc->mapH)
+    {
+        return PVS_MAYBE;
+    }
+
+    // Only half the offsets are stored, so look from the other cell if needed
+    if(dY < 0 || (0 == dY && dX < 0))
+    {
+        aX = bX;
+        aY = bY;
+        dX = -dX;
+        dY = -dY;
+    }
+    else if(0 == dX && 0 == dY)
+    {
+        return PVS_ALWAYS;
+    }
+
+    // Flash must be read a word at a time, so pick this cell's half of the word
+    uint32_t cell = aY + (aX * rc->mapH);
+    uint32_t row = (rc->pvsRowIdxs[cell >> 1] >> ((cell & 1) * 16)) & 0xFFFF;
+    if(row >= rc->numPvsRows)
+    {
+        return PVS_MAYBE;
+    }
+
+    int32_t bit = (0 == dY) ? (dX - 1) :
+                  RAY_PVS_RANGE + ((dY - 1) * (2 * RAY_PVS_RANGE + 1)) + (dX + RAY_PVS_RANGE);
+    const uint32_t* maybe = &rc->pvs[row * 2 * RAY_PVS_WORDS];
+    if(TEX_BIT(&maybe[RAY_PVS_WORDS], bit))
+    {
+        return PVS_ALWAYS;
+    }
+    else if(TEX_BIT(maybe, bit))
+    {
+        return PVS_MAYBE;
+    }
+    return PVS_NEVER;
+}
+
 /**
  * Set the sprite state and associated timers and textures
  *
@@ -2265,7 +3080,7 @@ void ICACHE_FLASH_ATTR setSpriteState(raySprite_t* sprite, enemyState_t state)
             if(!wasWalking || NULL == sprite->texture)
             {
                 // Set up the walking texture
-                sprite->texture = rc->walk[0];
+                sprite->texture = &rc->walk[0];
                 sprite->mirror = false;
                 sprite->texTimer = 0;
             }
@@ -2279,7 +3094,7 @@ void ICACHE_FLASH_ATTR setSpriteState(raySprite_t* sprite, enemyState_t state)
             if(!wasWalking || NULL == sprite->texture)
             {
                 // Set up the walking texture
-                sprite->texture = rc->walk[0];
+                sprite->texture = &rc->walk[0];
                 sprite->mirror = false;
                 sprite->texTimer = STEP_ANIM_TIME;
             }
@@ -2294,7 +3109,7 @@ void ICACHE_FLASH_ATTR setSpriteState(raySprite_t* sprite, enemyState_t state)
             {
                 sprite->stateTimer /= 2;
             }
-            sprite->texture = rc->shooting[0];
+            sprite->texture = &rc->shooting[0];
             sprite->texTimer = sprite->stateTimer;
 
             // Shot won't miss unless the player strafes
@@ -2315,7 +3130,7 @@ void ICACHE_FLASH_ATTR setSpriteState(raySprite_t* sprite, enemyState_t state)
             {
                 sprite->stateTimer /= 2;
             }
-            sprite->texture = rc->hurt[0];
+            sprite->texture = &rc->hurt[0];
             sprite->texTimer = sprite->stateTimer;
             // Set some invincibility frames
             sprite->invincibilityTimer = INVINCIBILITY_TIME;
@@ -2336,7 +3151,7 @@ void ICACHE_FLASH_ATTR setSpriteState(raySprite_t* sprite, enemyState_t state)
 
             // ALso set up the corpse texture
             sprite->stateTimer = 0;
-            sprite->texture = rc->dead;
+            sprite->texture = &rc->dead;
             sprite->texTimer = 0;
             sprite->invincibilityTimer = 0;
         }
@@ -2441,7 +3256,7 @@ void ICACHE_FLASH_ATTR drawHUD(void)
     if(RC_GAME == rc->mode)
     {
         // Plot the elapsed time
-        uint32_t tElapsed = system_get_time() - rc->tRoundStartedUs;
+        uint32_t tElapsed = rc->tRoundElapsed;
         uint32_t dSec = (tElapsed / USEC_IN_DSEC) % 10;
         uint32_t sec  = (tElapsed / (int)USEC_IN_SEC) % 60;
         uint32_t min  = (tElapsed / (USEC_IN_SEC * 60));
@@ -2845,14 +3660,18 @@ void ICACHE_FLASH_ATTR raycasterScoreDisplayButton(uint32_t button)
 void ICACHE_FLASH_ATTR raycasterMapSelectRenderer(uint32_t tElapsedUs __attribute__((unused)))
 {
     clearDisplay();
-    int16_t xOffset = (OLED_WIDTH - rc->mapW) / 2;
-    int16_t yOffset = FONT_HEIGHT_IBMVGA8 + (OLED_HEIGHT - rc->mapH - FONT_HEIGHT_IBMVGA8) / 2;
 
     int16_t textOffset = (OLED_WIDTH - textWidth("MAP SELECT", IBM_VGA_8)) / 2;
     plotText(textOffset, 0, "MAP SELECT", IBM_VGA_8, WHITE);
-    for(int16_t y = 0; y < rc->mapH; y++)
+
+    // Draw the part of the map which isn't empty space, centered
+    int16_t boundsW = (NULL == rc->map) ? 0 : (rc->mapMaxY - rc->mapMinY + 1);
+    int16_t boundsH = (NULL == rc->map) ? 0 : (rc->mapMaxX - rc->mapMinX + 1);
+    int16_t xOffset = (OLED_WIDTH - boundsW) / 2 - rc->mapMinY;
+    int16_t yOffset = FONT_HEIGHT_IBMVGA8 + (OLED_HEIGHT - boundsH - FONT_HEIGHT_IBMVGA8) / 2 - rc->mapMinX;
+    for(int16_t y = rc->mapMinX; y < rc->mapMinX + boundsH; y++)
     {
-        for(int16_t x = 0; x < rc->mapW; x++)
+        for(int16_t x = rc->mapMinY; x < rc->mapMinY + boundsW; x++)
         {
             switch(MAP_TILE(y, x))
             {
@@ -2919,45 +3738,188 @@ void ICACHE_FLASH_ATTR raycasterMapSelectButton(int32_t button)
         }
         case ACTION:
         {
-            raycasterSetMap();
-            raycasterInitGame(rc->difficulty);
+            // Only start if the map actually loaded
+            if(raycasterSetMap())
+            {
+                raycasterInitGame(rc->difficulty);
+            }
             break;
         }
     }
 }
 
 /**
- * Set the current map pointer and sizes from the current index
+ * Read a byte from a map asset. Assets may be in memory mapped flash, which
+ * must be read a word at a time
+ *
+ * @param data The map asset data, word aligned
+ * @param idx  The index of the byte to read
+ * @return The byte
  */
-void ICACHE_FLASH_ATTR raycasterSetMap(void)
+static inline uint8_t ICACHE_FLASH_ATTR mapAssetByte(const uint32_t* data, uint32_t idx)
 {
+    return (data[idx / 4] >> (8 * (idx % 4))) & 0xFF;
+}
+
+/**
+ * Load the map for the current index from assets. Maps are converted by
+ * mapconv, see mapconv.c for the format. The tiles are decoded to RAM, the
+ * spawn points are read from the asset when a game starts
+ *
+ * @return true if the map was loaded, false if it wasn't
+ */
+bool ICACHE_FLASH_ATTR raycasterSetMap(void)
+{
+    const char* mapName;
     switch(rc->mapIdx)
     {
         default:
         case RC_NUM_MAPS:
         case RC_MAP_S:
         {
-            // Set map vars
-            rc->mapW = MAP_S_W;
-            rc->mapH = MAP_S_H;
-            rc->map = &(worldMap_s[0][0]);
+            mapName = "map_s.rmp";
             break;
         }
         case RC_MAP_M:
         {
-            // Set map vars
-            rc->mapW = MAP_M_W;
-            rc->mapH = MAP_M_H;
-            rc->map = &(worldMap_m[0][0]);
+            mapName = "map_m.rmp";
             break;
         }
         case RC_MAP_L:
         {
-            // Set map vars
-            rc->mapW = MAP_L_W;
-            rc->mapH = MAP_L_H;
-            rc->map = &(worldMap_l[0][0]);
+            mapName = "map_l.rmp";
+            break;
+        }
+    }
+
+    // Free the old map
+    if(NULL != rc->map)
+    {
+        os_free(rc->map);
+    }
+    rc->map = NULL;
+    if(NULL != rc->flowField)
+    {
+        os_free(rc->flowField);
+    }
+    rc->flowField = NULL;
+    if(NULL != rc->flowQueue)
+    {
+        os_free(rc->flowQueue);
+    }
+    rc->flowQueue = NULL;
+    rc->mapW = 0;
+    rc->mapH = 0;
+    rc->numSpawns = 0;
+    rc->pvs = NULL;
+
+    // Find the new one
+    uint32_t assetLen = 0;
+    const uint32_t* asset = getAsset(mapName, &assetLen);
+    if(NULL == asset || assetLen < 5 * sizeof(uint32_t))
+    {
+        return false;
+    }
+
+    // Read the header
+    uint16_t mapW = asset[0] & 0xFFFF;
+    uint16_t mapH = asset[0] >> 16;
+    uint32_t numSpawns = asset[1];
+    uint32_t bounds = asset[2];
+    uint32_t rleLen = asset[3];
+    uint32_t pvsRange = asset[4];
+    const uint32_t* spawns = &asset[5];
+    const uint32_t* rle = &asset[5 + numSpawns];
+    if((uint32_t)(mapW * mapH) > 65536)
+    {
+        RAY_PRINTF("%s has more cells than the flow field can index\n", mapName);
+        return false;
+    }
+    if(((5 + numSpawns) * sizeof(uint32_t)) + rleLen > assetLen)
+    {
+        RAY_PRINTF("%s is truncated\n", mapName);
+        return false;
+    }
+
+    // The PVS follows the tiles, a row count, each cell's row, then the rows.
+    // Without it, line of sight is always checked with DDA
+    const uint32_t* pvsHeader = &rle[(rleLen + 3) / 4];
+    uint32_t pvsOffset = (const uint8_t*)pvsHeader - (const uint8_t*)asset;
+    const uint32_t* pvsRowIdxs = NULL;
+    const uint32_t* pvs = NULL;
+    uint32_t numPvsRows = 0;
+    if(RAY_PVS_RANGE == pvsRange && pvsOffset + sizeof(uint32_t) <= assetLen)
+    {
+        numPvsRows = pvsHeader[0];
+        pvsRowIdxs = &pvsHeader[1];
+        pvs = &pvsRowIdxs[(mapW * mapH + 1) / 2];
+        if(numPvsRows > 0xFFFF ||
+                pvsOffset + ((1 + ((mapW * mapH + 1) / 2) + (numPvsRows * 2 * RAY_PVS_WORDS)) * sizeof(uint32_t)) > assetLen)
+        {
+            pvs = NULL;
+        }
+    }
+    if(NULL == pvs)
+    {
+        RAY_PRINTF("%s has no usable PVS\n", mapName);
+    }
+
+    // Decode the tiles
+    rc->map = (WorldMapTile_t*)os_malloc(mapW * mapH * sizeof(WorldMapTile_t));
+    if(NULL == rc->map)
+    {
+        return false;
+    }
+    uint32_t tileIdx = 0;
+    for(uint32_t i = 0; i < rleLen; i++)
+    {
+        uint8_t rleByte = mapAssetByte(rle, i);
+        uint8_t runLen = (rleByte >> 4) + 1;
+        if(tileIdx + runLen > (uint32_t)(mapW * mapH))
+        {
             break;
         }
+        ets_memset(&rc->map[tileIdx], rleByte & 0x0F, runLen);
+        tileIdx += runLen;
+    }
+    if(tileIdx != (uint32_t)(mapW * mapH))
+    {
+        RAY_PRINTF("%s decoded to %d tiles, not %d\n", mapName, tileIdx, mapW * mapH);
+        os_free(rc->map);
+        rc->map = NULL;
+        return false;
     }
+
+    // Make room for the flow field, which is computed once the game starts
+    rc->flowField = (uint8_t*)os_malloc(mapW * mapH);
+    rc->flowQueue = (uint16_t*)os_malloc(mapW * mapH * sizeof(uint16_t));
+    if(NULL == rc->flowField || NULL == rc->flowQueue)
+    {
+        os_free(rc->map);
+        rc->map = NULL;
+        if(NULL != rc->flowField)
+        {
+            os_free(rc->flowField);
+            rc->flowField = NULL;
+        }
+        if(NULL != rc->flowQueue)
+        {
+            os_free(rc->flowQueue);
+            rc->flowQueue = NULL;
+        }
+        return false;
+    }
+
+    rc->mapW = mapW;
+    rc->mapH = mapH;
+    rc->spawns = spawns;
+    rc->numSpawns = numSpawns;
+    rc->pvs = pvs;
+    rc->pvsRowIdxs = pvsRowIdxs;
+    rc->numPvsRows = numPvsRows;
+    rc->mapMinX = (bounds >> 0) & 0xFF;
+    rc->mapMinY = (bounds >> 8) & 0xFF;
+    rc->mapMaxX = (bounds >> 16) & 0xFF;
+    rc->mapMaxY = (bounds >> 24) & 0xFF;
+    return true;
 }
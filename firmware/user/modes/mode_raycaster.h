@@ -34,4 +34,8 @@ raycasterScores_t;
 
 extern swadgeMode raycasterMode;
 
+#if defined(EMU)
+void raycasterBenchmark(uint32_t numFrames);
+#endif
+
 #endif
\ No newline at end of file
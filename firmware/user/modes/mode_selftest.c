@@ -41,7 +41,7 @@ typedef enum
 void ICACHE_FLASH_ATTR selfTestInit(void);
 void ICACHE_FLASH_ATTR selfTestExit(void);
 void ICACHE_FLASH_ATTR selfTestButtonCallback(uint8_t state, int button, int down);
-void ICACHE_FLASH_ATTR selfTestAudioCallback(int32_t samp);
+void ICACHE_FLASH_ATTR selfTestAudioCallback(const int16_t* samples, int n);
 bool ICACHE_FLASH_ATTR selfTestRenderTask(void);
 void ICACHE_FLASH_ATTR selfTestLedFunc(void*);
 
@@ -67,7 +67,7 @@ swadgeMode selfTestMode =
     .fnEnterMode = selfTestInit,
     .fnExitMode = selfTestExit,
     .fnButtonCallback = selfTestButtonCallback,
-    .fnAudioCallback = selfTestAudioCallback,
+    .fnAudioBlockCallback = selfTestAudioCallback,
     .fnRenderTask = selfTestRenderTask,
     .wifiMode = NO_WIFI,
     .fnEspNowRecvCb = NULL,
@@ -144,21 +144,33 @@ void ICACHE_FLASH_ATTR selfTestButtonCallback(uint8_t state __attribute__((unuse
 /**
  * Pass microphone samples to colorchord
  *
- * @param samp The sample read from the microphone
+ * @param samples The samples read from the microphone
+ * @param n       The number of samples
  */
-void ICACHE_FLASH_ATTR selfTestAudioCallback(int32_t samp)
+void ICACHE_FLASH_ATTR selfTestAudioCallback(const int16_t* samples, int n)
 {
-    PushSample32( samp );
-    st->samplesProcessed++;
-
-    // If at least 128 samples have been processed
-    if( st->samplesProcessed >= 128 )
+    while( n > 0 )
     {
-        // Colorchord magic
-        HandleFrameInfo();
+        // Push samples up to the end of the current 128 sample frame
+        int toPush = 128 - st->samplesProcessed;
+        if( toPush > n )
+        {
+            toPush = n;
+        }
+        PushSamples32( samples, toPush );
+        samples += toPush;
+        n -= toPush;
+        st->samplesProcessed += toPush;
 
-        // Reset the sample count
-        st->samplesProcessed = 0;
+        // If at least 128 samples have been processed
+        if( st->samplesProcessed >= 128 )
+        {
+            // Colorchord magic
+            HandleFrameInfo();
+
+            // Reset the sample count
+            st->samplesProcessed = 0;
+        }
     }
 }
 
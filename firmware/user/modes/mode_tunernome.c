@@ -32,6 +32,7 @@
 
 #include "embeddednf.h"
 #include "embeddedout.h"
+#include "embeddedbeat.h"
 
 /*============================================================================
  * Defines, Structs, Enums
@@ -47,7 +48,10 @@
 #define GUITAR_OFFSET         0
 #define CHROMATIC_OFFSET      6 // adjust start point by quartertones
 #define SENSITIVITY           5
-#define TONAL_DIFF_IN_TUNE_DEVIATION 10
+#define IN_TUNE_CENTS         5
+#define CENTS_IIR_BITS        2 // Light filtering, the estimate settles in a few frames
+#define CENTS_TO_COLOR        12 // How quickly LEDs go from white to red or blue
+#define BIN_CENTS             (1200 / FIXBPERO) // Furthest PeakOffsetCents() reports
 
 #define METRONOME_CENTER_X    OLED_WIDTH / 2
 #define METRONOME_CENTER_Y    OLED_HEIGHT - 10
@@ -101,6 +105,7 @@ typedef struct
 {
     tnMode mode;
     tuner_mode_t curTunerMode;
+    bool a4Adjusted;
 
     timer_t ledTimer;
     timer_t bpmButtonTimer;
@@ -109,7 +114,7 @@ typedef struct
 
     int audioSamplesProcessed;
     uint32_t intensities_filt[NUM_LIN_LEDS];
-    int32_t diffs_filt[NUM_LIN_LEDS];
+    int32_t cents_filt[NUM_LIN_LEDS];
 
     uint8_t tSigIdx;
     uint8_t beatCtr;
@@ -118,10 +123,12 @@ typedef struct
     int32_t tAccumulatedUs;
     bool isClockwise;
     int32_t usPerBeat;
+    bool syncToMusic;
+    uint32_t lastBeatCount;
 
     uint32_t semitone_intensitiy_filt[NUM_SEMITONES];
-    int32_t semitone_diff_filt[NUM_SEMITONES];
-    int16_t tonalDiff[NUM_SEMITONES];
+    int32_t semitone_cents_filt[NUM_SEMITONES];
+    int16_t cents[NUM_SEMITONES];
     int16_t intensity[NUM_SEMITONES];
 
     pngHandle upArrowPng;
@@ -146,24 +153,26 @@ typedef struct
 void ICACHE_FLASH_ATTR tunernomeEnterMode(void);
 void ICACHE_FLASH_ATTR tunernomeExitMode(void);
 void ICACHE_FLASH_ATTR switchToSubmode(tnMode);
-void ICACHE_FLASH_ATTR tunernomeButtonCallback(uint8_t state __attribute__((unused)),
-        int button, int down);
+void ICACHE_FLASH_ATTR tunernomeButtonCallback(uint8_t state, int button, int down);
 void ICACHE_FLASH_ATTR modifyBpm(int16_t bpmMod);
-void ICACHE_FLASH_ATTR tunernomeSampleHandler(int32_t samp);
+void ICACHE_FLASH_ATTR tunernomeSampleHandler(const int16_t* samples, int n);
 void ICACHE_FLASH_ATTR recalcMetronome(void);
 void ICACHE_FLASH_ATTR plotInstrumentNameAndNotes(const char* instrumentName, const char** instrumentNotes,
         uint16_t numNotes);
 void ICACHE_FLASH_ATTR plotTopSemiCircle(int xm, int ym, int r, color col);
 void ICACHE_FLASH_ATTR instrumentTunerMagic(const uint16_t freqBinIdxs[], uint16_t numStrings, led_t colors[],
         const uint16_t stringIdxToLedIdx[]);
+void ICACHE_FLASH_ATTR setTunerActiveBins(void);
+void ICACHE_FLASH_ATTR toggleMetronomeSync(void);
+void ICACHE_FLASH_ATTR modifyA4Calibration(int16_t hzMod);
 bool ICACHE_FLASH_ATTR tunernomeRenderTask(void);
 void ICACHE_FLASH_ATTR ledReset(void* timer_arg __attribute__((unused)));
 void ICACHE_FLASH_ATTR fasterBpmChange(void* timer_arg __attribute__((unused)));
 
 static inline int16_t getMagnitude(uint16_t idx);
-static inline int16_t getDiffAround(uint16_t idx);
+static inline int16_t getCentsAround(uint16_t idx);
 static inline int16_t getSemiMagnitude(int16_t idx);
-static inline int16_t getSemiDiffAround(uint16_t idx);
+static inline int16_t getSemiCentsAround(uint16_t idx);
 void ICACHE_FLASH_ATTR tnExitTimerFn(void* arg);
 
 /*============================================================================
@@ -181,7 +190,7 @@ swadgeMode tunernomeMode =
     .fnEspNowRecvCb = NULL,
     .fnEspNowSendCb = NULL,
     .fnAccelerometerCallback = NULL,
-    .fnAudioCallback = tunernomeSampleHandler,
+    .fnAudioBlockCallback = tunernomeSampleHandler,
     .menuImg = "tn-menu.gif"
 };
 
@@ -287,6 +296,7 @@ static const char theWordUkelele[] = "Ukelele";
 static const char leftStr[] = "< Exit";
 static const char rightStrTuner[] = "Tuner >";
 static const char rightStrMetronome[] = "Metronome >";
+static const char syncStr[] = "Sync";
 
 // TODO: these should be const after being assigned
 static int TUNER_FLAT_THRES_X;
@@ -314,11 +324,12 @@ static const timeSignature tSigs[] =
  */
 void ICACHE_FLASH_ATTR tunernomeEnterMode(void)
 {
-    float intermedX = cosf(TONAL_DIFF_IN_TUNE_DEVIATION * M_PI / 17 );
-    float intermedY = sinf(TONAL_DIFF_IN_TUNE_DEVIATION * M_PI / 17 );
-    TUNER_SHARP_THRES_X = round(METRONOME_CENTER_X - (intermedX * METRONOME_RADIUS));
-    TUNER_FLAT_THRES_X = round(METRONOME_CENTER_X + (intermedX * METRONOME_RADIUS));
-    TUNER_THRES_Y = round(METRONOME_CENTER_Y - (ABS(intermedY) * METRONOME_RADIUS));
+    // The needle swings 90 degrees either way for BIN_CENTS, mark where it's in tune
+    float intermedX = sinf((IN_TUNE_CENTS * M_PI / 2) / BIN_CENTS);
+    float intermedY = cosf((IN_TUNE_CENTS * M_PI / 2) / BIN_CENTS);
+    TUNER_SHARP_THRES_X = round(METRONOME_CENTER_X + (intermedX * METRONOME_RADIUS));
+    TUNER_FLAT_THRES_X = round(METRONOME_CENTER_X - (intermedX * METRONOME_RADIUS));
+    TUNER_THRES_Y = round(METRONOME_CENTER_Y - (intermedY * METRONOME_RADIUS));
 
     // Alloc and clear everything
     tunernome = os_malloc(sizeof(tunernome_t));
@@ -343,6 +354,7 @@ void ICACHE_FLASH_ATTR tunernomeEnterMode(void)
     enableDebounce(true);
 
     InitColorChord();
+    setTunerActiveBins();
 
     tunernome->exitTimeAccumulatedUs = 0;
     tunernome->tLastCallUs = 0;
@@ -361,6 +373,9 @@ void ICACHE_FLASH_ATTR switchToSubmode(tnMode newMode)
         {
             tunernome->mode = newMode;
 
+            // The metronome may have listened to every bin
+            setTunerActiveBins();
+
             led_t leds[NUM_LIN_LEDS] = {{0}};
             setLeds(leds, sizeof(leds));
 
@@ -374,6 +389,9 @@ void ICACHE_FLASH_ATTR switchToSubmode(tnMode newMode)
         {
             tunernome-> mode = newMode;
 
+            // Following the beat needs the whole spectrum
+            SetActiveBins32(NULL, 0);
+
             tunernome->isClockwise = true;
             tunernome->tSigIdx = 0;
             tunernome->beatCtr = 0;
@@ -428,15 +446,15 @@ static inline int16_t getMagnitude(uint16_t idx)
 }
 
 /**
- * Inline helper function to get the difference in magnitudes around a given
- * frequency bin from fuzzed_bins[]
+ * Inline helper function to estimate how far the pitch around a given
+ * frequency bin from fuzzed_bins[] is from that bin
  *
- * @param idx The index to get a difference in magnitudes around
- * @return The difference in magnitudes of the bins before and after the given index
+ * @param idx The index to estimate the pitch around
+ * @return The offset from the bin's frequency in cents, positive is sharp
  */
-static inline int16_t getDiffAround(uint16_t idx)
+static inline int16_t getCentsAround(uint16_t idx)
 {
-    return getMagnitude(idx + 1) - getMagnitude(idx - 1);
+    return PeakOffsetCents(getMagnitude(idx - 1), getMagnitude(idx), getMagnitude(idx + 1));
 }
 
 /**
@@ -459,15 +477,15 @@ static inline int16_t getSemiMagnitude(int16_t idx)
 }
 
 /**
- * Inline helper function to get the difference in magnitudes around a given
- * frequency bin from folded_bins[]
+ * Inline helper function to estimate how far the pitch around a given
+ * frequency bin from folded_bins[] is from that bin
  *
- * @param idx The index to get a difference in magnitudes around
- * @return The difference in magnitudes of the bins before and after the given index
+ * @param idx The index to estimate the pitch around
+ * @return The offset from the bin's frequency in cents, positive is sharp
  */
-static inline int16_t getSemiDiffAround(uint16_t idx)
+static inline int16_t getSemiCentsAround(uint16_t idx)
 {
-    return getSemiMagnitude(idx + 1) - getSemiMagnitude(idx - 1);
+    return PeakOffsetCents(getSemiMagnitude(idx - 1), getSemiMagnitude(idx), getSemiMagnitude(idx + 1));
 }
 
 /**
@@ -553,6 +571,53 @@ void ICACHE_FLASH_ATTR plotTopSemiCircle(int xm, int ym, int r, color col)
     } while (x < 0);
 }
 
+/**
+ * Only run the DFT for the bins the current tuner mode reads. The instrument
+ * tuners read each string's bin and its two neighbours, the semitone tuners
+ * read every bin
+ */
+void ICACHE_FLASH_ATTR setTunerActiveBins(void)
+{
+    const uint16_t* freqBinIdxs;
+    uint16_t numStrings;
+    switch(tunernome->curTunerMode)
+    {
+        case GUITAR_TUNER:
+        {
+            freqBinIdxs = freqBinIdxsGuitar;
+            numStrings = NUM_GUITAR_STRINGS;
+            break;
+        }
+        case VIOLIN_TUNER:
+        {
+            freqBinIdxs = freqBinIdxsViolin;
+            numStrings = NUM_VIOLIN_STRINGS;
+            break;
+        }
+        case UKELELE_TUNER:
+        {
+            freqBinIdxs = freqBinIdxsUkelele;
+            numStrings = NUM_UKELELE_STRINGS;
+            break;
+        }
+        default:
+        {
+            SetActiveBins32(NULL, 0);
+            return;
+        }
+    }
+
+    uint16_t bins[NUM_GUITAR_STRINGS * 3];
+    uint16_t i;
+    for(i = 0; i < numStrings; i++)
+    {
+        bins[i * 3 + 0] = freqBinIdxs[i] + GUITAR_OFFSET - 1;
+        bins[i * 3 + 1] = freqBinIdxs[i] + GUITAR_OFFSET;
+        bins[i * 3 + 2] = freqBinIdxs[i] + GUITAR_OFFSET + 1;
+    }
+    SetActiveBins32(bins, numStrings * 3);
+}
+
 /**
  * Instrument-agnostic tuner magic. Updates LEDs
  * @param freqBinIdxs An array of the indices of notes for the instrument's strings. See freqBinIdxsGuitar for an example.
@@ -570,20 +635,20 @@ void ICACHE_FLASH_ATTR instrumentTunerMagic(const uint16_t freqBinIdxs[], uint16
         tunernome->intensities_filt[i] = (getMagnitude(freqBinIdxs[i] + GUITAR_OFFSET) + tunernome->intensities_filt[i]) -
                                          (tunernome->intensities_filt[i] >> 5);
 
-        // Pick out the difference around current magnitude and filter it too
-        tunernome->diffs_filt[i] = (getDiffAround(freqBinIdxs[i] + GUITAR_OFFSET) + tunernome->diffs_filt[i]) -
-                                   (tunernome->diffs_filt[i] >> 5);
+        // Estimate the pitch from the peak around the target bin and filter it lightly
+        tunernome->cents_filt[i] = (getCentsAround(freqBinIdxs[i] + GUITAR_OFFSET) + tunernome->cents_filt[i]) -
+                                   (tunernome->cents_filt[i] >> CENTS_IIR_BITS);
 
         // This is the magnitude of the target frequency bin, cleaned up
         int16_t intensity = (tunernome->intensities_filt[i] >> SENSITIVITY) - 40; // drop a baseline.
         intensity = CLAMP(intensity, 0, 255);
 
-        // This is the tonal difference. You "calibrate" out the intensity.
-        int16_t tonalDiff = (tunernome->diffs_filt[i] >> SENSITIVITY) * 200 / (intensity + 1);
+        // How far off the note is, in cents
+        int16_t cents = tunernome->cents_filt[i] >> CENTS_IIR_BITS;
 
         int32_t red, grn, blu;
-        // Is the note in tune, i.e. is the magnitude difference in surrounding bins small?
-        if( (ABS(tonalDiff) < TONAL_DIFF_IN_TUNE_DEVIATION) )
+        // Is the note in tune?
+        if( (ABS(cents) < IN_TUNE_CENTS) )
         {
             // Note is in tune, make it white
             red = 255;
@@ -593,17 +658,17 @@ void ICACHE_FLASH_ATTR instrumentTunerMagic(const uint16_t freqBinIdxs[], uint16
         else
         {
             // Check if the note is sharp or flat
-            if( tonalDiff > 0 )
+            if( cents > 0 )
             {
                 // Note too sharp, make it red
                 red = 255;
-                grn = blu = 255 - (tonalDiff) * 15;
+                grn = blu = 255 - (cents - IN_TUNE_CENTS) * CENTS_TO_COLOR;
             }
             else
             {
                 // Note too flat, make it blue
                 blu = 255;
-                grn = red = 255 - (-tonalDiff) * 15;
+                grn = red = 255 - (-cents - IN_TUNE_CENTS) * CENTS_TO_COLOR;
             }
 
             // Make sure LED output isn't more than 255
@@ -657,7 +722,12 @@ bool ICACHE_FLASH_ATTR tunernomeRenderTask(void)
 
             char gainStr[16] = {0};
             ets_snprintf(gainStr, sizeof(gainStr) - 1, "Gain:%d", 1 + ((CCS.gINITIAL_AMP - AMP_OFFSET) / AMP_STEP_SIZE));
-            plotText(8 + afterExit, OLED_HEIGHT - FONT_HEIGHT_TOMTHUMB - 1, gainStr, TOM_THUMB, WHITE);
+            int16_t afterGain = plotText(8 + afterExit, OLED_HEIGHT - FONT_HEIGHT_TOMTHUMB - 1, gainStr, TOM_THUMB, WHITE);
+
+            // The reference pitch, changed by holding ACTION and pressing UP or DOWN
+            char a4Str[16] = {0};
+            ets_snprintf(a4Str, sizeof(a4Str) - 1, "A=%d", GetA4Calibration());
+            plotText(4 + afterGain, OLED_HEIGHT - FONT_HEIGHT_TOMTHUMB - 1, a4Str, TOM_THUMB, WHITE);
 
             // Up/Down arrows in middle of display around current note/mode
             drawPng(&(tunernome->upArrowPng),
@@ -753,9 +823,9 @@ bool ICACHE_FLASH_ATTR tunernomeRenderTask(void)
                 case SEMITONE_11:
                 default:
                 {
-                    // Draw tuner needle based on the value of tonalDiff, which is at most -32768 to 32767
-                    // clamp it to the range -180 -> 180
-                    int16_t clampedTonalDiff = CLAMP(tunernome->tonalDiff[tunernome->curTunerMode - SEMITONE_0] / 2, -180, 180);
+                    // Draw tuner needle based on the value of cents, which is at most -BIN_CENTS to BIN_CENTS
+                    // scale it to the range -180 -> 180
+                    int16_t clampedTonalDiff = CLAMP(tunernome->cents[tunernome->curTunerMode - SEMITONE_0] * 180 / BIN_CENTS, -180, 180);
 
                     // If the signal isn't intense enough, don't move the needle
                     if(tunernome->semitone_intensitiy_filt[tunernome->curTunerMode - SEMITONE_0] < 1000)
@@ -819,6 +889,11 @@ bool ICACHE_FLASH_ATTR tunernomeRenderTask(void)
             plotText(OLED_WIDTH - textWidth(rightStrTuner, TOM_THUMB), OLED_HEIGHT - FONT_HEIGHT_TOMTHUMB - 1, rightStrTuner,
                      TOM_THUMB,
                      WHITE);
+            if(tunernome->syncToMusic)
+            {
+                plotText((OLED_WIDTH - textWidth(syncStr, TOM_THUMB)) / 2, OLED_HEIGHT - FONT_HEIGHT_TOMTHUMB - 1, syncStr,
+                         TOM_THUMB, WHITE);
+            }
 
             if(0 == tunernome->tLastUpdateUs)
             {
@@ -831,8 +906,27 @@ bool ICACHE_FLASH_ATTR tunernomeRenderTask(void)
                 uint32_t tNowUs = system_get_time();
                 uint32_t tElapsedUs = tNowUs - tunernome->tLastUpdateUs;
                 bool shouldBlink = false;
+                // If following the music and the beat can be trusted, swing with it
+                if(tunernome->syncToMusic && beat_confidence > BEAT_CONFIDENT)
+                {
+                    if(beat_bpm != tunernome->bpm)
+                    {
+                        tunernome->bpm = CLAMP(beat_bpm, 1, MAX_BPM);
+                        recalcMetronome();
+                    }
+                    // Flip the arm on every beat heard
+                    if(beat_count != tunernome->lastBeatCount)
+                    {
+                        tunernome->lastBeatCount = beat_count;
+                        tunernome->isClockwise = !tunernome->isClockwise;
+                        shouldBlink = true;
+                    }
+                    // Place the arm by how far into the beat the music is
+                    int32_t phaseUs = ((uint64_t)beat_phase * tunernome->usPerBeat) >> 16;
+                    tunernome->tAccumulatedUs = tunernome->isClockwise ? phaseUs : tunernome->usPerBeat - phaseUs;
+                }
                 // If the arm is sweeping clockwise
-                if(tunernome->isClockwise)
+                else if(tunernome->isClockwise)
                 {
                     // Add to tAccumulatedUs
                     tunernome->tAccumulatedUs += tElapsedUs;
@@ -928,8 +1022,7 @@ bool ICACHE_FLASH_ATTR tunernomeRenderTask(void)
  * @param button The button which triggered this event
  * @param down true if the button was pressed, false if it was released
  */
-void ICACHE_FLASH_ATTR tunernomeButtonCallback( uint8_t state __attribute__((unused)),
-        int button, int down)
+void ICACHE_FLASH_ATTR tunernomeButtonCallback( uint8_t state, int button, int down)
 {
     if(LEFT == button)
     {
@@ -959,11 +1052,22 @@ void ICACHE_FLASH_ATTR tunernomeButtonCallback( uint8_t state __attribute__((unu
                 {
                     case UP:
                     {
+                        if(state & ACTION_MASK)
+                        {
+                            modifyA4Calibration(1);
+                            break;
+                        }
                         tunernome->curTunerMode = (tunernome->curTunerMode + 1) % MAX_GUITAR_MODES;
+                        setTunerActiveBins();
                         break;
                     }
                     case DOWN:
                     {
+                        if(state & ACTION_MASK)
+                        {
+                            modifyA4Calibration(-1);
+                            break;
+                        }
                         if(0 == tunernome->curTunerMode)
                         {
                             tunernome->curTunerMode = MAX_GUITAR_MODES - 1;
@@ -972,11 +1076,13 @@ void ICACHE_FLASH_ATTR tunernomeButtonCallback( uint8_t state __attribute__((unu
                         {
                             tunernome->curTunerMode--;
                         }
+                        setTunerActiveBins();
                         break;
                     }
                     case ACTION:
                     {
-                        cycleColorchordSensitivity();
+                        // The gain changes on release, unless ACTION was held to change A4
+                        tunernome->a4Adjusted = false;
                         break;
                     }
                     case RIGHT:
@@ -995,6 +1101,10 @@ void ICACHE_FLASH_ATTR tunernomeButtonCallback( uint8_t state __attribute__((unu
                     }
                 } // switch(button)
             } // if(down)
+            else if(ACTION == button && false == tunernome->a4Adjusted)
+            {
+                cycleColorchordSensitivity();
+            }
             break;
         } // case TN_TUNER:
         case TN_METRONOME:
@@ -1005,6 +1115,11 @@ void ICACHE_FLASH_ATTR tunernomeButtonCallback( uint8_t state __attribute__((unu
                 {
                     case UP:
                     {
+                        if(state & DOWN_MASK)
+                        {
+                            toggleMetronomeSync();
+                            break;
+                        }
                         modifyBpm(1);
                         tunernome->lastBpmButton = button;
                         tunernome->bpmButtonTimerUs = 0;
@@ -1013,6 +1128,11 @@ void ICACHE_FLASH_ATTR tunernomeButtonCallback( uint8_t state __attribute__((unu
                     }
                     case DOWN:
                     {
+                        if(state & UP_MASK)
+                        {
+                            toggleMetronomeSync();
+                            break;
+                        }
                         modifyBpm(-1);
                         tunernome->lastBpmButton = button;
                         tunernome->bpmButtonTimerUs = 0;
@@ -1104,153 +1224,212 @@ void ICACHE_FLASH_ATTR modifyBpm(int16_t bpmMod)
 }
 
 /**
- * This is called every time an audio sample is read from the ADC
- * This processes the sample and will display update the LEDs every
+ * Start or stop following the beat of whatever the mic hears. Pressing UP and
+ * DOWN together in the metronome calls this
+ */
+void ICACHE_FLASH_ATTR toggleMetronomeSync(void)
+{
+    tunernome->syncToMusic = !tunernome->syncToMusic;
+
+    // Stop the held button from changing the BPM
+    tunernome->lastBpmButton = 0;
+    tunernome->bpmButtonTimerUs = 0;
+    timerDisarm(&(tunernome->bpmButtonTimer));
+
+    if(tunernome->syncToMusic)
+    {
+        // Listen fresh
+        InitBeatDetect();
+        tunernome->lastBeatCount = 0;
+        tunernome->audioSamplesProcessed = 0;
+    }
+}
+
+/**
+ * Retune the tuner to a different reference pitch. Holding ACTION and pressing
+ * UP or DOWN in the tuner calls this. The bins for every A4 from A4_CAL_MIN to
+ * A4_CAL_MAX are precomputed, so this is just a table swap
+ *
+ * @param hzMod The amount to change A4 by, in Hz. The result is clamped
+ */
+void ICACHE_FLASH_ATTR modifyA4Calibration(int16_t hzMod)
+{
+    tunernome->a4Adjusted = true;
+    SetA4Calibration(GetA4Calibration() + hzMod);
+}
+
+/**
+ * This is called every time a block of audio samples is read from the ADC
+ * This processes the samples and will display update the LEDs every
  * 128 samples
  *
- * @param samp A 32 bit audio sample read from the ADC (microphone)
+ * @param samples A block of audio samples read from the ADC (microphone)
+ * @param n       The number of samples in the block
  */
-void ICACHE_FLASH_ATTR tunernomeSampleHandler(int32_t samp)
+void ICACHE_FLASH_ATTR tunernomeSampleHandler(const int16_t* samples, int n)
 {
-    if(tunernome->mode == TN_TUNER)
+    if(tunernome->mode == TN_TUNER || tunernome->syncToMusic)
     {
-        PushSample32( samp );
-        tunernome->audioSamplesProcessed++;
-
-        // If at least 128 samples have been processed
-        if( tunernome->audioSamplesProcessed >= 128 )
+        while( n > 0 )
         {
-            // Don't bother if colorchord is inactive
-            if( !COLORCHORD_ACTIVE )
+            // Push samples up to the end of the current 128 sample frame
+            int toPush = 128 - tunernome->audioSamplesProcessed;
+            if( toPush < 1 )
             {
-                return;
+                // The last frame was skipped, push one at a time until it isn't
+                toPush = 1;
             }
+            else if( toPush > n )
+            {
+                toPush = n;
+            }
+            PushSamples32( samples, toPush );
+            samples += toPush;
+            n -= toPush;
+            tunernome->audioSamplesProcessed += toPush;
 
-            // Colorchord magic
-            HandleFrameInfo();
-
-            led_t colors[NUM_LIN_LEDS] = {{0}};
-
-            switch(tunernome->curTunerMode)
+            // If at least 128 samples have been processed
+            if( tunernome->audioSamplesProcessed >= 128 )
             {
-                case GUITAR_TUNER:
+                // Don't bother if colorchord is inactive
+                if( !COLORCHORD_ACTIVE )
                 {
-                    instrumentTunerMagic(freqBinIdxsGuitar, NUM_GUITAR_STRINGS, colors, NULL);
-                    break;
+                    continue;
                 }
-                case VIOLIN_TUNER:
-                {
-                    instrumentTunerMagic(freqBinIdxsViolin, NUM_VIOLIN_STRINGS, colors, fourNoteStringIdxToLedIdx);
-                    break;
-                }
-                case UKELELE_TUNER:
+
+                // Colorchord magic
+                HandleFrameInfo();
+
+                // The metronome only wants the beat, it draws its own LEDs
+                if(TN_METRONOME == tunernome->mode)
                 {
-                    instrumentTunerMagic(freqBinIdxsUkelele, NUM_UKELELE_STRINGS, colors, fourNoteStringIdxToLedIdx);
-                    break;
+                    HandleBeatFrame();
+                    tunernome->audioSamplesProcessed = 0;
+                    continue;
                 }
-                case MAX_GUITAR_MODES:
-                    break;
-                case SEMITONE_0:
-                case SEMITONE_1:
-                case SEMITONE_2:
-                case SEMITONE_3:
-                case SEMITONE_4:
-                case SEMITONE_5:
-                case SEMITONE_6:
-                case SEMITONE_7:
-                case SEMITONE_8:
-                case SEMITONE_9:
-                case SEMITONE_10:
-                case SEMITONE_11:
-                case LISTENING:
-                default:
+
+                led_t colors[NUM_LIN_LEDS] = {{0}};
+
+                switch(tunernome->curTunerMode)
                 {
-                    for(uint8_t semitone = 0; semitone < NUM_SEMITONES; semitone++)
+                    case GUITAR_TUNER:
                     {
-                        // uint8_t semitoneIdx = (tunernome->curTunerMode - SEMITONE_0) * 2;
-                        uint8_t semitoneIdx = semitone * 2;
-                        // Pick out the current magnitude and filter it
-                        tunernome->semitone_intensitiy_filt[semitone] = (getSemiMagnitude(semitoneIdx + CHROMATIC_OFFSET) +
-                                tunernome->semitone_intensitiy_filt[semitone]) -
-                                (tunernome->semitone_intensitiy_filt[semitone] >> 5);
-
-                        // Pick out the difference around current magnitude and filter it too
-                        tunernome->semitone_diff_filt[semitone] = (getSemiDiffAround(semitoneIdx + CHROMATIC_OFFSET) +
-                                tunernome->semitone_diff_filt[semitone]) -
-                                (tunernome->semitone_diff_filt[semitone] >> 5);
-
-
-                        // This is the magnitude of the target frequency bin, cleaned up
-                        tunernome->intensity[semitone] = (tunernome->semitone_intensitiy_filt[semitone] >> SENSITIVITY) -
-                                                         40; // drop a baseline.
-                        tunernome->intensity[semitone] = CLAMP(tunernome->intensity[semitone], 0, 255);
-
-                        //This is the tonal difference. You "calibrate" out the intensity.
-                        tunernome->tonalDiff[semitone] = (tunernome->semitone_diff_filt[semitone] >> SENSITIVITY) * 200 /
-                                                         (tunernome->intensity[semitone] + 1);
+                        instrumentTunerMagic(freqBinIdxsGuitar, NUM_GUITAR_STRINGS, colors, NULL);
+                        break;
                     }
-
-                    // tonal diff is -32768 to 32767. if its within -10 to 10 (now defined as TONAL_DIFF_IN_TUNE_DEVIATION), it's in tune.
-                    // positive means too sharp, negative means too flat
-                    // intensity is how 'loud' that frequency is, 0 to 255. you'll have to play around with values
-                    int32_t red, grn, blu;
-                    // Is the note in tune, i.e. is the magnitude difference in surrounding bins small?
-                    if( (ABS(tunernome->tonalDiff[tunernome->curTunerMode - SEMITONE_0]) < TONAL_DIFF_IN_TUNE_DEVIATION) )
+                    case VIOLIN_TUNER:
                     {
-                        // Note is in tune, make it white
-                        red = 255;
-                        grn = 255;
-                        blu = 255;
+                        instrumentTunerMagic(freqBinIdxsViolin, NUM_VIOLIN_STRINGS, colors, fourNoteStringIdxToLedIdx);
+                        break;
                     }
-                    else
+                    case UKELELE_TUNER:
                     {
-                        // Check if the note is sharp or flat
-                        if( tunernome->tonalDiff[tunernome->curTunerMode - SEMITONE_0] > 0 )
+                        instrumentTunerMagic(freqBinIdxsUkelele, NUM_UKELELE_STRINGS, colors, fourNoteStringIdxToLedIdx);
+                        break;
+                    }
+                    case MAX_GUITAR_MODES:
+                        break;
+                    case SEMITONE_0:
+                    case SEMITONE_1:
+                    case SEMITONE_2:
+                    case SEMITONE_3:
+                    case SEMITONE_4:
+                    case SEMITONE_5:
+                    case SEMITONE_6:
+                    case SEMITONE_7:
+                    case SEMITONE_8:
+                    case SEMITONE_9:
+                    case SEMITONE_10:
+                    case SEMITONE_11:
+                    case LISTENING:
+                    default:
+                    {
+                        for(uint8_t semitone = 0; semitone < NUM_SEMITONES; semitone++)
+                        {
+                            // uint8_t semitoneIdx = (tunernome->curTunerMode - SEMITONE_0) * 2;
+                            uint8_t semitoneIdx = semitone * 2;
+                            // Pick out the current magnitude and filter it
+                            tunernome->semitone_intensitiy_filt[semitone] = (getSemiMagnitude(semitoneIdx + CHROMATIC_OFFSET) +
+                                    tunernome->semitone_intensitiy_filt[semitone]) -
+                                    (tunernome->semitone_intensitiy_filt[semitone] >> 5);
+
+                            // Estimate the pitch from the peak around the semitone and filter it lightly
+                            tunernome->semitone_cents_filt[semitone] = (getSemiCentsAround(semitoneIdx + CHROMATIC_OFFSET) +
+                                    tunernome->semitone_cents_filt[semitone]) -
+                                    (tunernome->semitone_cents_filt[semitone] >> CENTS_IIR_BITS);
+
+
+                            // This is the magnitude of the target frequency bin, cleaned up
+                            tunernome->intensity[semitone] = (tunernome->semitone_intensitiy_filt[semitone] >> SENSITIVITY) -
+                                                             40; // drop a baseline.
+                            tunernome->intensity[semitone] = CLAMP(tunernome->intensity[semitone], 0, 255);
+
+                            // How far off the semitone is, in cents
+                            tunernome->cents[semitone] = tunernome->semitone_cents_filt[semitone] >> CENTS_IIR_BITS;
+                        }
+
+                        // cents is -BIN_CENTS to BIN_CENTS. if its within -IN_TUNE_CENTS to IN_TUNE_CENTS, it's in tune.
+                        // positive means too sharp, negative means too flat
+                        // intensity is how 'loud' that frequency is, 0 to 255. you'll have to play around with values
+                        int32_t red, grn, blu;
+                        // Is the note in tune?
+                        if( (ABS(tunernome->cents[tunernome->curTunerMode - SEMITONE_0]) < IN_TUNE_CENTS) )
                         {
-                            // Note too sharp, make it red
+                            // Note is in tune, make it white
                             red = 255;
-                            grn = blu = 255 - (tunernome->tonalDiff[tunernome->curTunerMode - SEMITONE_0] - TONAL_DIFF_IN_TUNE_DEVIATION) * 15;
+                            grn = 255;
+                            blu = 255;
                         }
                         else
                         {
-                            // Note too flat, make it blue
-                            blu = 255;
-                            grn = red = 255 - (-(tunernome->tonalDiff[tunernome->curTunerMode - SEMITONE_0] + TONAL_DIFF_IN_TUNE_DEVIATION)) * 15;
+                            // Check if the note is sharp or flat
+                            if( tunernome->cents[tunernome->curTunerMode - SEMITONE_0] > 0 )
+                            {
+                                // Note too sharp, make it red
+                                red = 255;
+                                grn = blu = 255 - (tunernome->cents[tunernome->curTunerMode - SEMITONE_0] - IN_TUNE_CENTS) * CENTS_TO_COLOR;
+                            }
+                            else
+                            {
+                                // Note too flat, make it blue
+                                blu = 255;
+                                grn = red = 255 - (-(tunernome->cents[tunernome->curTunerMode - SEMITONE_0] + IN_TUNE_CENTS)) * CENTS_TO_COLOR;
+                            }
+
+                            // Make sure LED output isn't more than 255
+                            red = CLAMP(red, INT_MIN, 255);
+                            grn = CLAMP(grn, INT_MIN, 255);
+                            blu = CLAMP(blu, INT_MIN, 255);
                         }
 
-                        // Make sure LED output isn't more than 255
-                        red = CLAMP(red, INT_MIN, 255);
-                        grn = CLAMP(grn, INT_MIN, 255);
-                        blu = CLAMP(blu, INT_MIN, 255);
-                    }
-
-                    // Scale each LED's brightness by the filtered intensity for that bin
-                    red = (red >> 3 ) * ( tunernome->intensity[tunernome->curTunerMode - SEMITONE_0] >> 3);
-                    grn = (grn >> 3 ) * ( tunernome->intensity[tunernome->curTunerMode - SEMITONE_0] >> 3);
-                    blu = (blu >> 3 ) * ( tunernome->intensity[tunernome->curTunerMode - SEMITONE_0] >> 3);
+                        // Scale each LED's brightness by the filtered intensity for that bin
+                        red = (red >> 3 ) * ( tunernome->intensity[tunernome->curTunerMode - SEMITONE_0] >> 3);
+                        grn = (grn >> 3 ) * ( tunernome->intensity[tunernome->curTunerMode - SEMITONE_0] >> 3);
+                        blu = (blu >> 3 ) * ( tunernome->intensity[tunernome->curTunerMode - SEMITONE_0] >> 3);
 
-                    // Set the LED, ensure each channel is between 0 and 255
-                    uint32_t i;
-                    for (i = 0; i < NUM_GUITAR_STRINGS; i++)
-                    {
-                        colors[i].r = CLAMP(red, 0, 255);
-                        colors[i].g = CLAMP(grn, 0, 255);
-                        colors[i].b = CLAMP(blu, 0, 255);
-                    }
+                        // Set the LED, ensure each channel is between 0 and 255
+                        uint32_t i;
+                        for (i = 0; i < NUM_GUITAR_STRINGS; i++)
+                        {
+                            colors[i].r = CLAMP(red, 0, 255);
+                            colors[i].g = CLAMP(grn, 0, 255);
+                            colors[i].b = CLAMP(blu, 0, 255);
+                        }
 
-                    break;
-                } // default:
-            } // switch(tunernome->curTunerMode)
+                        break;
+                    } // default:
+                } // switch(tunernome->curTunerMode)
 
-            if(LISTENING != tunernome->curTunerMode)
-            {
-                // Draw the LEDs
-                setLeds( colors, sizeof(colors) );
+                if(LISTENING != tunernome->curTunerMode)
+                {
+                    // Draw the LEDs
+                    setLeds( colors, sizeof(colors) );
+                }
+                // Reset the sample count
+                tunernome->audioSamplesProcessed = 0;
             }
-            // Reset the sample count
-            tunernome->audioSamplesProcessed = 0;
         }
-    } // if(tunernome-> mode == TN_TUNER)
+    } // if(tunernome->mode == TN_TUNER || tunernome->syncToMusic)
 }
 
 /**
@@ -30,6 +30,7 @@
 #include "PartitionMap.h"
 #include "QMA6981.h"
 #include "synced_timer.h"
+#include "asset_cache.h"
 #include "printControl.h"
 
 #include "mode_menu.h"
@@ -52,6 +53,8 @@
 #define PROC_TASK_PRIO 0
 #define PROC_TASK_QUEUE_LEN 1
 
+#define AUDIO_BLOCK_LEN 128
+
 #define RTC_MEM_ADDR 64
 
 /*============================================================================
@@ -262,7 +265,7 @@ void ICACHE_FLASH_ATTR user_init(void)
 
 #if defined(FEATURE_MIC)
         // Initialize either the buzzer or the mic
-        if(NULL != swadgeModes[rtcMem.currentSwadgeMode]->fnAudioCallback)
+        if(NULL != swadgeModes[rtcMem.currentSwadgeMode]->fnAudioBlockCallback)
         {
             initMic();
         }
@@ -316,22 +319,27 @@ static void ICACHE_FLASH_ATTR procTask(os_event_t* events __attribute__((unused)
     HandleButtonEventSynchronous();
 
 #if defined(FEATURE_MIC)
-    // While there are samples available from the ADC
-    while( sampleAvailable() )
+    // Drain the ADC queue a block at a time
+    uint8_t rawSamples[AUDIO_BLOCK_LEN];
+    int16_t samples[AUDIO_BLOCK_LEN];
+    uint16_t numSamples;
+    while( 0 != (numSamples = getSamples(rawSamples, AUDIO_BLOCK_LEN)) )
     {
-        // Get the sample
-        int32_t samp = getSample();
-        // Run the sample through an IIR filter
+        // Run the block through an IIR filter and amplify it
         static uint32_t samp_iir = 0;
-        samp_iir = samp_iir - (samp_iir >> 10) + samp;
-        samp = (samp - (samp_iir >> 10)) * 16;
-        // Amplify the sample
-        samp = (samp * CCS.gINITIAL_AMP) >> 4;
+        int32_t amp = CCS.gINITIAL_AMP;
+        for(uint16_t i = 0; i < numSamples; i++)
+        {
+            int32_t samp = rawSamples[i];
+            samp_iir = samp_iir - (samp_iir >> 10) + samp;
+            samp = (samp - (samp_iir >> 10)) * 16;
+            samples[i] = (samp * amp) >> 4;
+        }
 
-        // Pass the sample to the mode
-        if(swadgeModeInit && NULL != swadgeModes[rtcMem.currentSwadgeMode]->fnAudioCallback)
+        // Pass the block to the mode
+        if(swadgeModeInit && NULL != swadgeModes[rtcMem.currentSwadgeMode]->fnAudioBlockCallback)
         {
-            swadgeModes[rtcMem.currentSwadgeMode]->fnAudioCallback(samp);
+            swadgeModes[rtcMem.currentSwadgeMode]->fnAudioBlockCallback(samples, numSamples);
         }
     }
 #endif
@@ -390,6 +398,10 @@ static void ICACHE_FLASH_ATTR procTask(os_event_t* events __attribute__((unused)
                 break;
             }
         }
+
+        // A frame was just pushed, so there's a whole frame period before the
+        // next one. Spend a little of it on one step of prefetch work
+        cacheProcessPrefetch();
     }
 #endif
 }
@@ -485,6 +497,10 @@ void ExitCritical(void)
         {
             swadgeModes[rtcMem.currentSwadgeMode]->fnExitMode();
         }
+#if defined(FEATURE_OLED)
+        // Free any assets the mode left resident
+        cacheFlush();
+#endif
 
         // Clean up ESP NOW if that's where we were at
         switch(swadgeModes[rtcMem.currentSwadgeMode]->wifiMode)
@@ -536,6 +552,9 @@ void ICACHE_FLASH_ATTR exitCurrentSwadgeMode(void)
     {
         swadgeModes[rtcMem.currentSwadgeMode]->fnExitMode();
     }
+#if defined(FEATURE_OLED)
+    cacheFlush();
+#endif
 #if defined(FEATURE_ACCEL)
     timerDisarm(&timerHandlePollAccel);
 #endif
@@ -121,12 +121,13 @@ typedef struct _swadgeMode
      */
     void (*fnButtonCallback)(uint8_t state, int button, int down);
     /**
-     * This function is called whenever an audio sample is read from the
-     * microphone (ADC), is filtered, and is ready for processing
+     * This function is called with a block of audio samples which were read
+     * from the microphone (ADC), are filtered, and are ready for processing
      *
-     * @param audoSample A 32 bit audio sample
+     * @param samples The filtered audio samples
+     * @param n       The number of samples in the block
      */
-    void (*fnAudioCallback)(int32_t audoSample);
+    void (*fnAudioBlockCallback)(const int16_t* samples, int n);
     /**
      * This is a setting, not a function pointer. Set it to one of these
      * values to have the system configure the swadge's WiFi
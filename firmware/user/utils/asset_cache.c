@@ -0,0 +1,486 @@
+/*
+ * asset_cache.c
+ *
+ *  Keeps decoded assets resident in RAM so that modes which free and reload
+ *  the same assets don't have to copy them out of flash every time.
+ *  Entries are reference counted. Entries which aren't referenced stay
+ *  resident until the byte budget is exceeded, then the least recently used
+ *  are evicted first.
+ */
+
+/*==============================================================================
+ * Includes
+ *============================================================================*/
+
+#include <osapi.h>
+#include <mem.h>
+#include <user_interface.h>
+#include "asset_cache.h"
+#include "printControl.h"
+
+#if defined(FEATURE_OLED)
+
+/*==============================================================================
+ * Structs
+ *============================================================================*/
+
+typedef struct
+{
+    char name[16];
+    cachedAssetType_t type;
+    uint8_t refCount;
+    uint32_t lastUse;
+    uint32_t size;
+    union
+    {
+        pngHandle png;
+        gifHandle gif;
+    } h;
+} cachedAsset_t;
+
+typedef struct
+{
+    char name[16];
+    cachedAssetType_t type;
+} prefetchHint_t;
+
+/*==============================================================================
+ * Prototypes
+ *============================================================================*/
+
+static cachedAsset_t* ICACHE_FLASH_ATTR cacheFind(const char* name, cachedAssetType_t type);
+static cachedAsset_t* ICACHE_FLASH_ATTR cacheLoad(const char* name, cachedAssetType_t type);
+static void ICACHE_FLASH_ATTR cacheEvict(uint8_t slot);
+static bool ICACHE_FLASH_ATTR cacheEvictLru(void);
+static void ICACHE_FLASH_ATTR cacheEnforceBudget(void);
+static void ICACHE_FLASH_ATTR cacheTouch(cachedAsset_t* entry);
+
+/*==============================================================================
+ * Variables
+ *============================================================================*/
+
+// Entries are allocated when loaded, so an empty cache only costs the pointers
+static cachedAsset_t* cache[ASSET_CACHE_ENTRIES] = {NULL};
+static uint32_t cacheClock = 0;
+static uint32_t cacheBytes = 0;
+
+static prefetchHint_t prefetchQueue[ASSET_CACHE_PREFETCH];
+static uint8_t prefetchHead = 0;
+static uint8_t prefetchCount = 0;
+// A prefetched gif whose first frame still needs to be decoded
+static cachedAsset_t* prefetchDecode = NULL;
+
+/*==============================================================================
+ * Functions
+ *============================================================================*/
+
+/**
+ * Find a resident asset
+ *
+ * @param name The name of the asset
+ * @param type The type of the asset
+ * @return The cache entry for the asset, or NULL if it isn't resident
+ */
+static cachedAsset_t* ICACHE_FLASH_ATTR cacheFind(const char* name, cachedAssetType_t type)
+{
+    for(uint8_t i = 0; i < ASSET_CACHE_ENTRIES; i++)
+    {
+        if(NULL != cache[i] && type == cache[i]->type &&
+                0 == ets_strncmp(name, cache[i]->name, sizeof(cache[i]->name)))
+        {
+            return cache[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Mark a cache entry as the most recently used one
+ *
+ * @param entry The entry which was used
+ */
+static void ICACHE_FLASH_ATTR cacheTouch(cachedAsset_t* entry)
+{
+    entry->lastUse = ++cacheClock;
+}
+
+/**
+ * Free an entry and all the memory it holds
+ *
+ * @param slot The index of the entry to free
+ */
+static void ICACHE_FLASH_ATTR cacheEvict(uint8_t slot)
+{
+    cachedAsset_t* entry = cache[slot];
+    AST_PRINTF("Evict %s, %d bytes\n", entry->name, entry->size);
+    if(prefetchDecode == entry)
+    {
+        prefetchDecode = NULL;
+    }
+    switch(entry->type)
+    {
+        case CACHED_PNG:
+        {
+            unloadPngAsset(&entry->h.png);
+            break;
+        }
+        case CACHED_GIF:
+        {
+            freeGifAsset(&entry->h.gif);
+            break;
+        }
+    }
+    cacheBytes -= entry->size;
+    os_free(entry);
+    cache[slot] = NULL;
+}
+
+/**
+ * Evict the least recently used entry which isn't referenced
+ *
+ * @return true if an entry was evicted, false if every entry is referenced
+ */
+static bool ICACHE_FLASH_ATTR cacheEvictLru(void)
+{
+    int16_t lru = -1;
+    for(uint8_t i = 0; i < ASSET_CACHE_ENTRIES; i++)
+    {
+        if(NULL != cache[i] && 0 == cache[i]->refCount &&
+                (-1 == lru || cache[i]->lastUse < cache[lru]->lastUse))
+        {
+            lru = i;
+        }
+    }
+
+    if(-1 == lru)
+    {
+        return false;
+    }
+    cacheEvict(lru);
+    return true;
+}
+
+/**
+ * Evict unreferenced entries until the resident assets fit in the budget.
+ * Referenced entries are never evicted, so this may not get under budget
+ */
+static void ICACHE_FLASH_ATTR cacheEnforceBudget(void)
+{
+    while(cacheBytes > ASSET_CACHE_BUDGET && cacheEvictLru())
+    {
+        ;
+    }
+}
+
+/**
+ * Load an asset from flash into a new cache entry, evicting the least recently
+ * used entry if there are no free slots
+ *
+ * @param name The name of the asset to load
+ * @param type The type of the asset to load
+ * @return The new entry, unreferenced, or NULL if it couldn't be loaded
+ */
+static cachedAsset_t* ICACHE_FLASH_ATTR cacheLoad(const char* name, cachedAssetType_t type)
+{
+    // Find a free slot, making one if necessary
+    int16_t slot = -1;
+    for(uint8_t i = 0; i < ASSET_CACHE_ENTRIES; i++)
+    {
+        if(NULL == cache[i])
+        {
+            slot = i;
+            break;
+        }
+    }
+    if(-1 == slot)
+    {
+        if(false == cacheEvictLru())
+        {
+            return NULL;
+        }
+        return cacheLoad(name, type);
+    }
+
+    cachedAsset_t* entry = (cachedAsset_t*)os_zalloc(sizeof(cachedAsset_t));
+    if(NULL == entry)
+    {
+        return NULL;
+    }
+    ets_strncpy(entry->name, name, sizeof(entry->name) - 1);
+    entry->type = type;
+
+    switch(type)
+    {
+        case CACHED_PNG:
+        {
+            if(false == loadPngFromAsset(name, &entry->h.png))
+            {
+                os_free(entry);
+                return NULL;
+            }
+            entry->size = entry->h.png.dataLen * sizeof(uint32_t);
+            break;
+        }
+        case CACHED_GIF:
+        {
+            loadGifFromAsset(name, &entry->h.gif);
+            if(NULL == entry->h.gif.frame)
+            {
+                freeGifAsset(&entry->h.gif);
+                os_free(entry);
+                return NULL;
+            }
+            entry->size = entry->h.gif.allocedSize + entry->h.gif.windowSize;
+            break;
+        }
+    }
+
+    AST_PRINTF("Load %s, %d bytes\n", entry->name, entry->size);
+    cacheTouch(entry);
+    cacheBytes += entry->size;
+    cache[slot] = entry;
+    return entry;
+}
+
+/**
+ * Get a PNG from the cache, loading it from flash if it isn't resident.
+ * The pixel data is shared with every other user of this PNG, so it must not
+ * be written to. Every successful acquire must be matched by a release
+ *
+ * @param name   The name of the PNG
+ * @param handle A handle to copy the PNG into
+ * @return true if the PNG was acquired, false if it was not
+ */
+bool ICACHE_FLASH_ATTR cacheAcquirePng(const char* name, pngHandle* handle)
+{
+    cachedAsset_t* entry = cacheFind(name, CACHED_PNG);
+    if(NULL == entry)
+    {
+        entry = cacheLoad(name, CACHED_PNG);
+    }
+
+    if(NULL == entry)
+    {
+        // Every entry is in use, so don't cache this one
+        return loadPngFromAsset(name, handle);
+    }
+
+    entry->refCount++;
+    cacheTouch(entry);
+    ets_memcpy(handle, &entry->h.png, sizeof(pngHandle));
+    return true;
+}
+
+/**
+ * Release a PNG acquired with cacheAcquirePng(). It stays resident until it's
+ * evicted for space
+ *
+ * @param handle The handle to release
+ */
+void ICACHE_FLASH_ATTR cacheReleasePng(pngHandle* handle)
+{
+    if(NULL == handle->data)
+    {
+        return;
+    }
+
+    for(uint8_t i = 0; i < ASSET_CACHE_ENTRIES; i++)
+    {
+        if(NULL != cache[i] && CACHED_PNG == cache[i]->type &&
+                handle->data == cache[i]->h.png.data)
+        {
+            if(cache[i]->refCount > 0)
+            {
+                cache[i]->refCount--;
+            }
+            cacheEnforceBudget();
+            return;
+        }
+    }
+
+    // This PNG wasn't cached
+    unloadPngAsset(handle);
+}
+
+/**
+ * Get a gif from the cache, loading it from flash if it isn't resident.
+ * The gif, including which frame it's on, is shared with every other user of
+ * this gif. Every successful acquire must be matched by a release
+ *
+ * @param name The name of the gif
+ * @return A handle to the gif, or NULL if it couldn't be loaded
+ */
+gifHandle* ICACHE_FLASH_ATTR cacheAcquireGif(const char* name)
+{
+    cachedAsset_t* entry = cacheFind(name, CACHED_GIF);
+    if(NULL == entry)
+    {
+        entry = cacheLoad(name, CACHED_GIF);
+    }
+
+    if(NULL == entry)
+    {
+        // Every entry is in use, so don't cache this one
+        gifHandle* handle = (gifHandle*)os_zalloc(sizeof(gifHandle));
+        if(NULL != handle)
+        {
+            loadGifFromAsset(name, handle);
+            if(NULL == handle->frame)
+            {
+                freeGifAsset(handle);
+                os_free(handle);
+                handle = NULL;
+            }
+        }
+        return handle;
+    }
+
+    // The caller decodes frames now, so don't advance this gif behind its back
+    if(prefetchDecode == entry)
+    {
+        prefetchDecode = NULL;
+    }
+
+    entry->refCount++;
+    cacheTouch(entry);
+    return &entry->h.gif;
+}
+
+/**
+ * Release a gif acquired with cacheAcquireGif(). It stays resident until it's
+ * evicted for space
+ *
+ * @param handle The handle to release, may be NULL
+ */
+void ICACHE_FLASH_ATTR cacheReleaseGif(gifHandle* handle)
+{
+    if(NULL == handle)
+    {
+        return;
+    }
+
+    for(uint8_t i = 0; i < ASSET_CACHE_ENTRIES; i++)
+    {
+        if(NULL != cache[i] && CACHED_GIF == cache[i]->type &&
+                handle == &cache[i]->h.gif)
+        {
+            if(cache[i]->refCount > 0)
+            {
+                cache[i]->refCount--;
+            }
+            cacheEnforceBudget();
+            return;
+        }
+    }
+
+    // This gif wasn't cached
+    freeGifAsset(handle);
+    os_free(handle);
+}
+
+/**
+ * Hint that an asset will be acquired soon. The asset is loaded later, a
+ * step at a time by cacheProcessPrefetch(), so that it's resident by the time
+ * it's needed. If too many hints are queued, the oldest is dropped
+ *
+ * @param name The name of the asset
+ * @param type The type of the asset
+ */
+void ICACHE_FLASH_ATTR cachePrefetch(const char* name, cachedAssetType_t type)
+{
+    if(NULL == name || NULL != cacheFind(name, type))
+    {
+        return;
+    }
+
+    // Don't queue the same hint twice
+    for(uint8_t i = 0; i < prefetchCount; i++)
+    {
+        prefetchHint_t* hint = &prefetchQueue[(prefetchHead + i) % ASSET_CACHE_PREFETCH];
+        if(type == hint->type && 0 == ets_strncmp(name, hint->name, sizeof(hint->name)))
+        {
+            return;
+        }
+    }
+
+    if(prefetchCount == ASSET_CACHE_PREFETCH)
+    {
+        prefetchHead = (prefetchHead + 1) % ASSET_CACHE_PREFETCH;
+        prefetchCount--;
+    }
+
+    prefetchHint_t* hint = &prefetchQueue[(prefetchHead + prefetchCount) % ASSET_CACHE_PREFETCH];
+    ets_memset(hint->name, 0, sizeof(hint->name));
+    ets_strncpy(hint->name, name, sizeof(hint->name) - 1);
+    hint->type = type;
+    prefetchCount++;
+}
+
+/**
+ * Do one step of prefetch work, either copying one hinted asset out of flash
+ * or decoding the first frame of the last prefetched gif, never both. This
+ * should be called right after a frame is drawn so the work lands in the idle
+ * time before the next one
+ */
+void ICACHE_FLASH_ATTR cacheProcessPrefetch(void)
+{
+    uint32_t start __attribute__((unused)) = system_get_time();
+
+    if(NULL != prefetchDecode)
+    {
+        // The gif was loaded on the last call, decode its first frame now
+        decodeGifFrame(&prefetchDecode->h.gif, false);
+        AST_PRINTF("Prefetch decode %s, %d us\n", prefetchDecode->name, system_get_time() - start);
+        prefetchDecode = NULL;
+        return;
+    }
+
+    if(0 == prefetchCount)
+    {
+        return;
+    }
+
+    prefetchHint_t* hint = &prefetchQueue[prefetchHead];
+    prefetchHead = (prefetchHead + 1) % ASSET_CACHE_PREFETCH;
+    prefetchCount--;
+
+    if(NULL != cacheFind(hint->name, hint->type))
+    {
+        return;
+    }
+
+    cacheLoad(hint->name, hint->type);
+    cacheEnforceBudget();
+
+    // The budget may have evicted what was just loaded
+    cachedAsset_t* entry = cacheFind(hint->name, hint->type);
+    if(NULL != entry)
+    {
+        AST_PRINTF("Prefetch load %s, %d us\n", entry->name, system_get_time() - start);
+        if(CACHED_GIF == entry->type)
+        {
+            prefetchDecode = entry;
+        }
+    }
+}
+
+/**
+ * Free every resident asset and drop all prefetch hints, whether or not
+ * they're referenced. This should be called when a mode exits
+ */
+void ICACHE_FLASH_ATTR cacheFlush(void)
+{
+    for(uint8_t i = 0; i < ASSET_CACHE_ENTRIES; i++)
+    {
+        if(NULL != cache[i])
+        {
+            cacheEvict(i);
+        }
+    }
+    cacheClock = 0;
+    prefetchHead = 0;
+    prefetchCount = 0;
+    prefetchDecode = NULL;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _ASSET_CACHE_H_
+#define _ASSET_CACHE_H_
+
+#include "user_config.h"
+#include "assets.h"
+
+#if defined(FEATURE_OLED)
+
+// The most assets which can be resident at once, in use or not
+#define ASSET_CACHE_ENTRIES  24
+// Assets which aren't in use are evicted, least recently used first, when all
+// resident assets take more than this many bytes of RAM
+#define ASSET_CACHE_BUDGET   6144
+// The most prefetch hints which can be queued at once
+#define ASSET_CACHE_PREFETCH 4
+
+typedef enum
+{
+    CACHED_PNG,
+    CACHED_GIF,
+} cachedAssetType_t;
+
+bool ICACHE_FLASH_ATTR cacheAcquirePng(const char* name, pngHandle* handle);
+void ICACHE_FLASH_ATTR cacheReleasePng(pngHandle* handle);
+gifHandle* ICACHE_FLASH_ATTR cacheAcquireGif(const char* name);
+void ICACHE_FLASH_ATTR cacheReleaseGif(gifHandle* handle);
+
+void ICACHE_FLASH_ATTR cachePrefetch(const char* name, cachedAssetType_t type);
+void ICACHE_FLASH_ATTR cacheProcessPrefetch(void);
+void ICACHE_FLASH_ATTR cacheFlush(void);
+
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 #include "assets.h"
 #include "oled.h"
 #include "fastlz.h"
+#include "asset_cache.h"
 #include "user_main.h"
 #include "printControl.h"
 #if defined(EMU)
@@ -274,13 +275,41 @@ void transformPixel(int16_t* x, int16_t* y, int16_t transX,
 }
 
 /**
- * Load a PNG asset from ROM to RAM
+ * Load a PNG asset from ROM to RAM, through the asset cache. If the PNG is
+ * already resident, its pixel data is shared rather than copied again
  *
  * @param name   The name of the asset to draw
  * @param handle A handle to load the asset into
  * @return true if the asset was allocated, false if it was not
  */
 bool ICACHE_FLASH_ATTR allocPngAsset(const char* name, pngHandle* handle)
+{
+    return cacheAcquirePng(name, handle);
+}
+
+/**
+ * Free a PNG asset loaded with allocPngAsset(). The pixel data may stay
+ * resident in the asset cache
+ *
+ * @param handle The handle to free memory from
+ */
+void ICACHE_FLASH_ATTR freePngAsset(pngHandle* handle)
+{
+    cacheReleasePng(handle);
+    handle->data = NULL;
+    handle->width = 0;
+    handle->height = 0;
+    handle->dataLen = 0;
+}
+
+/**
+ * Load a PNG asset from ROM to RAM, bypassing the asset cache
+ *
+ * @param name   The name of the asset to draw
+ * @param handle A handle to load the asset into
+ * @return true if the asset was allocated, false if it was not
+ */
+bool ICACHE_FLASH_ATTR loadPngFromAsset(const char* name, pngHandle* handle)
 {
     // Get the image from the packed assets
     uint32_t assetLen = 0;
@@ -291,10 +320,37 @@ bool ICACHE_FLASH_ATTR allocPngAsset(const char* name, pngHandle* handle)
     {
         uint32_t idx = 0;
 
-        // Get the width and height
-        handle->width  = assetPtr[idx++];
+        // Get the width, encoding, and height
+        uint16_t encoding = assetPtr[idx] >> 16;
+        handle->width  = assetPtr[idx++] & 0xFFFF;
         handle->height = assetPtr[idx++];
-        AST_PRINTF("Width: %d, height: %d\n", handle->width, handle->height);
+        AST_PRINTF("Width: %d, height: %d, encoding: %d\n", handle->width, handle->height, encoding);
+
+        if(PNG_ENC_FASTLZ == encoding)
+        {
+            // The length of the decompressed pixel data is stored first
+            uint32_t streamLen = assetPtr[idx++];
+            handle->data = (uint32_t*)os_malloc(streamLen);
+            if(NULL == handle->data)
+            {
+                handle->dataLen = 0;
+                return false;
+            }
+
+            // Decompress straight from ROM to RAM. The output is the window too
+            if(0 == fastlz_decompress_stream(&assetPtr[idx], assetLen - (idx * sizeof(uint32_t)),
+                                             handle->data, streamLen, handle->data, streamLen, false))
+            {
+                unloadPngAsset(handle);
+                return false;
+            }
+            handle->dataLen = streamLen / sizeof(uint32_t);
+            return true;
+        }
+        else if(PNG_ENC_VLC != encoding)
+        {
+            return false;
+        }
 
         // Pad the length to a 32 bit boundary for memcpy
         uint32_t paddedLen = assetLen - (2 * sizeof(uint32_t));
@@ -320,11 +376,11 @@ bool ICACHE_FLASH_ATTR allocPngAsset(const char* name, pngHandle* handle)
 }
 
 /**
- * Free a PNG asset from RAM
+ * Free a PNG asset loaded with loadPngFromAsset() from RAM
  *
  * @param handle The handle to free memory from
  */
-void ICACHE_FLASH_ATTR freePngAsset(pngHandle* handle)
+void ICACHE_FLASH_ATTR unloadPngAsset(pngHandle* handle)
 {
     if(NULL != handle->data)
     {
@@ -450,8 +506,6 @@ void ICACHE_FLASH_ATTR drawPngInv(pngHandle* handle, int16_t xp,
  * Draw a png asset directly to memory, not the OLED, without transformations
  * This is useful for loading raycast sprites
  *
- * TODO make the memory accesses safer
- *
  * @param handle The png asset to draw
  * @param buf    The memory to draw to
  */
@@ -480,6 +534,10 @@ void ICACHE_FLASH_ATTR drawPngToBuffer(pngHandle* handle, color* buf)
             // After bitIdx was incremented, check it
             if(bitIdx == 32)
             {
+                if(idx >= handle->dataLen)
+                {
+                    return;
+                }
                 chunk = handle->data[idx++];
                 bitIdx = 0;
             }
@@ -501,6 +559,88 @@ void ICACHE_FLASH_ATTR drawPngToBuffer(pngHandle* handle, color* buf)
                 // After bitIdx was incremented, check it
                 if(bitIdx == 32)
                 {
+                    if(idx >= handle->dataLen)
+                    {
+                        return;
+                    }
+                    chunk = handle->data[idx++];
+                    bitIdx = 0;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Draw a png asset directly to memory as two bit planes, one for color and one
+ * for opacity, without transformations. Pixels are column major, pixel (x, y)
+ * is bit ((x * height) + y), least significant bit first in each word. This
+ * is eight times smaller than drawPngToBuffer() and is sampled with shifts
+ *
+ * @param handle    The png asset to draw
+ * @param colorBits The memory to draw colors to, 1 is white, 0 is black.
+ *                  Must be at least ((width * height) + 31) / 32 words
+ * @param maskBits  The memory to draw opacity to, 1 is opaque, 0 is
+ *                  transparent. Must be the same size as colorBits
+ */
+void ICACHE_FLASH_ATTR drawPngToPackedBuffer(pngHandle* handle, uint32_t* colorBits, uint32_t* maskBits)
+{
+    uint32_t numWords = ((handle->width * handle->height) + 31) / 32;
+    ets_memset(colorBits, 0, numWords * sizeof(uint32_t));
+    ets_memset(maskBits, 0, numWords * sizeof(uint32_t));
+
+    uint32_t idx = 0;
+
+    // Read 32 bits at a time
+    uint32_t chunk = handle->data[idx++];
+    uint32_t bitIdx = 0;
+
+    // Draw the image's pixels
+    for(int16_t y = 0; y < handle->height; y++)
+    {
+        for(int16_t x = 0; x < handle->width; x++)
+        {
+            uint32_t pxIdx = (x * handle->height) + y;
+            uint32_t pxBit = 1U << (pxIdx & 31);
+
+            // 'Traverse' the huffman tree to find out what to do
+            bool isZero = true;
+            if(chunk & (0x80000000 >> (bitIdx++)))
+            {
+                // If it's a one, it's an opaque black pixel
+                maskBits[pxIdx >> 5] |= pxBit;
+                isZero = false;
+            }
+
+            // After bitIdx was incremented, check it
+            if(bitIdx == 32)
+            {
+                if(idx >= handle->dataLen)
+                {
+                    return;
+                }
+                chunk = handle->data[idx++];
+                bitIdx = 0;
+            }
+
+            // A zero can be followed by a zero or a one
+            if(isZero)
+            {
+                // zero-one means transparent, which is the default
+                if(0 == (chunk & (0x80000000 >> (bitIdx++))))
+                {
+                    // zero-zero means an opaque white pixel
+                    colorBits[pxIdx >> 5] |= pxBit;
+                    maskBits[pxIdx >> 5] |= pxBit;
+                }
+
+                // After bitIdx was incremented, check it
+                if(bitIdx == 32)
+                {
+                    if(idx >= handle->dataLen)
+                    {
+                        return;
+                    }
                     chunk = handle->data[idx++];
                     bitIdx = 0;
                 }
@@ -628,7 +768,7 @@ void ICACHE_FLASH_ATTR drawPngSequenceInv(pngSequenceHandle* handle, int16_t xp,
 void ICACHE_FLASH_ATTR loadGifFromAsset(const char* name, gifHandle* handle)
 {
     // Only do anything if the handle is uninitialized
-    if(NULL == handle->compressed)
+    if(NULL == handle->frame)
     {
         // Get the image from the packed assets
         uint32_t assetLen = 0;
@@ -649,13 +789,41 @@ void ICACHE_FLASH_ATTR loadGifFromAsset(const char* name, gifHandle* handle)
                        handle->nFrames,
                        handle->duration);
 
-            // Allocate enough space for the compressed data, decompressed data
-            // and the actual gif
+            // Frames are decompressed straight from ROM, so only the actual
+            // gif needs a full size buffer
             handle->allocedSize = ((handle->width * handle->height) + 8) / 8;
-            handle->compressed = (uint8_t*)os_malloc(handle->allocedSize);
-            handle->decompressed = (uint8_t*)os_malloc(handle->allocedSize);
             handle->frame = (uint8_t*)os_malloc(handle->allocedSize);
 
+            // Find the longest back-reference in any delta frame. That's how
+            // much decompressed history must be kept while streaming a delta.
+            // The first frame uses the frame itself as history
+            handle->windowSize = (handle->nFrames > 1) ? 1 : 0;
+            uint32_t idx = handle->idx;
+            for(uint16_t f = 0; f < handle->nFrames; f++)
+            {
+                uint32_t compressedLen = handle->assetPtr[idx++];
+                if(f > 0)
+                {
+                    uint32_t dist = fastlz_max_distance(&handle->assetPtr[idx], compressedLen);
+                    if(dist > handle->windowSize)
+                    {
+                        handle->windowSize = dist;
+                    }
+                }
+                idx += (compressedLen + 3) / 4;
+            }
+            if(handle->windowSize > handle->allocedSize)
+            {
+                handle->windowSize = handle->allocedSize;
+            }
+            if(handle->windowSize > 0)
+            {
+                handle->window = (uint8_t*)os_malloc(handle->windowSize);
+            }
+
+            AST_PRINTF("  window: %d\n", handle->windowSize);
+
+            handle->cFrame = 0;
             handle->firstFrameLoaded = false;
         }
     }
@@ -668,35 +836,33 @@ void ICACHE_FLASH_ATTR loadGifFromAsset(const char* name, gifHandle* handle)
  */
 void ICACHE_FLASH_ATTR freeGifAsset(gifHandle* handle)
 {
-    os_free(handle->compressed);
-    os_free(handle->decompressed);
-    os_free(handle->frame);
-    handle->compressed = NULL;
-    handle->decompressed = NULL;
+    if(NULL != handle->frame)
+    {
+        os_free(handle->frame);
+    }
+    if(NULL != handle->window)
+    {
+        os_free(handle->window);
+    }
     handle->frame = NULL;
+    handle->window = NULL;
 }
 
 /**
- * Draw a frame of a gif to the screen
+ * Decode a frame of a gif into its frame buffer without drawing it
  *
- * @param handle A handle to the gif to draw
- * @param xp The x coordinate to draw the asset at
- * @param yp The y coordinate to draw the asset at
- * @param flipLR true to flip over the Y axis, false to do nothing
- * @param flipUD true to flip over the X axis, false to do nothing
- * @param rotateDeg The number of degrees to rotate clockwise, must be 0-359
- * @param drawNext true to draw the next frame, false to draw the same frame again
+ * @param handle A handle to the gif to decode
+ * @param drawNext true to decode the next frame, false to only decode the
+ *                 first frame if it hasn't been yet
  */
-void ICACHE_FLASH_ATTR drawGifFromAsset(gifHandle* handle, int16_t xp, int16_t yp,
-                                        bool flipLR, bool flipUD, int16_t rotateDeg,
-                                        bool drawNext)
+void ICACHE_FLASH_ATTR decodeGifFrame(gifHandle* handle, bool drawNext)
 {
     if(drawNext || false == handle->firstFrameLoaded)
     {
         // Read the compressed length of this frame
         uint32_t compressedLen = handle->assetPtr[handle->idx++];
 
-        // Pad the length to a 32 bit boundary for memcpy
+        // Pad the length to a 32 bit boundary
         uint32_t paddedLen = compressedLen;
         while(paddedLen % 4 != 0)
         {
@@ -705,29 +871,24 @@ void ICACHE_FLASH_ATTR drawGifFromAsset(gifHandle* handle, int16_t xp, int16_t y
         AST_PRINTF("%s\n  frame: %d\n  cLen: %d\n  pLen: %d\n", __func__,
                    handle->cFrame, compressedLen, paddedLen);
 
-        // Copy the compressed data from flash to RAM
-        os_memcpy(handle->compressed, &handle->assetPtr[handle->idx], paddedLen);
-        handle->idx += (paddedLen / 4);
-
-        // If this is the first frame
+        // Decompress straight from flash
         if(handle->cFrame == 0)
         {
-            // Decompress it straight to the frame data
-            fastlz_decompress(handle->compressed, compressedLen,
-                              handle->frame, handle->allocedSize);
+            // The first frame is written to the frame data, which is its own
+            // history
+            fastlz_decompress_stream(&handle->assetPtr[handle->idx], compressedLen,
+                                     handle->frame, handle->allocedSize,
+                                     handle->frame, handle->allocedSize, false);
         }
         else
         {
-            // Otherwise decompress it to decompressed
-            fastlz_decompress(handle->compressed, compressedLen,
-                              handle->decompressed, handle->allocedSize);
-            // Then apply the changes to the current frame
-            uint16_t i;
-            for(i = 0; i < handle->allocedSize; i++)
-            {
-                handle->frame[i] ^= handle->decompressed[i];
-            }
+            // The others are deltas, XORed into the frame data as they are
+            // decompressed
+            fastlz_decompress_stream(&handle->assetPtr[handle->idx], compressedLen,
+                                     handle->frame, handle->allocedSize,
+                                     handle->window, handle->windowSize, true);
         }
+        handle->idx += (paddedLen / 4);
 
         if(drawNext)
         {
@@ -741,6 +902,24 @@ void ICACHE_FLASH_ATTR drawGifFromAsset(gifHandle* handle, int16_t xp, int16_t y
         }
         handle->firstFrameLoaded = true;
     }
+}
+
+/**
+ * Draw a frame of a gif to the screen
+ *
+ * @param handle A handle to the gif to draw
+ * @param xp The x coordinate to draw the asset at
+ * @param yp The y coordinate to draw the asset at
+ * @param flipLR true to flip over the Y axis, false to do nothing
+ * @param flipUD true to flip over the X axis, false to do nothing
+ * @param rotateDeg The number of degrees to rotate clockwise, must be 0-359
+ * @param drawNext true to draw the next frame, false to draw the same frame again
+ */
+void ICACHE_FLASH_ATTR drawGifFromAsset(gifHandle* handle, int16_t xp, int16_t yp,
+                                        bool flipLR, bool flipUD, int16_t rotateDeg,
+                                        bool drawNext)
+{
+    decodeGifFrame(handle, drawNext);
 
     // Draw the current frame to the OLED
     int16_t h, w;
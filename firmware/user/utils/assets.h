@@ -13,6 +13,10 @@ uint32_t* getAsset(const char* name, uint32_t* retLen);
     void ICACHE_FLASH_ATTR freeAssets(void);
 #endif
 
+// How a PNG asset's pixels are stored, packed in the upper 16 bits of its width
+#define PNG_ENC_VLC    0
+#define PNG_ENC_FASTLZ 1
+
 typedef struct
 {
     uint16_t width;
@@ -23,9 +27,12 @@ typedef struct
 
 bool ICACHE_FLASH_ATTR allocPngAsset(const char* name, pngHandle* handle);
 void ICACHE_FLASH_ATTR freePngAsset(pngHandle* handle);
+bool ICACHE_FLASH_ATTR loadPngFromAsset(const char* name, pngHandle* handle);
+void ICACHE_FLASH_ATTR unloadPngAsset(pngHandle* handle);
 void ICACHE_FLASH_ATTR drawPng(pngHandle* handle, int16_t xp,
                                int16_t yp, bool flipLR, bool flipUD, int16_t rotateDeg);
 void ICACHE_FLASH_ATTR drawPngToBuffer(pngHandle* handle, color* buf);
+void ICACHE_FLASH_ATTR drawPngToPackedBuffer(pngHandle* handle, uint32_t* colorBits, uint32_t* maskBits);
 void ICACHE_FLASH_ATTR drawPngInv(pngHandle* handle, int16_t xp,
                                   int16_t yp, bool flipLR, bool flipUD,
                                   int16_t rotateDeg, bool inv);
@@ -49,11 +56,12 @@ typedef struct
     uint32_t* assetPtr;
     uint32_t idx;
 
-    uint8_t* compressed;
-    uint8_t* decompressed;
     uint8_t* frame;
     uint32_t allocedSize;
 
+    uint8_t* window;
+    uint32_t windowSize;
+
     uint16_t width;
     uint16_t height;
 
@@ -65,6 +73,7 @@ typedef struct
 } gifHandle;
 
 void loadGifFromAsset(const char* name, gifHandle* handle);
+void decodeGifFrame(gifHandle* handle, bool drawNext);
 void drawGifFromAsset(gifHandle* handle, int16_t xp, int16_t yp,
                       bool flipLR, bool flipUD, int16_t rotateDeg, bool drawNext);
 void freeGifAsset(gifHandle* handle);
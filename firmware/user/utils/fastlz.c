@@ -123,6 +123,205 @@ int ICACHE_FLASH_ATTR fastlz_decompress(const void* input, int length, void* out
     return 0;
 }
 
+/*
+ * Read a byte from a buffer using only aligned 32-bit loads. Memory-mapped
+ * flash on the ESP8266 can't be read a byte at a time. Both the ESP8266 and
+ * the emulator hosts are little endian.
+ */
+static FASTLZ_INLINE flzuint8 fastlz_read_byte(const flzuint32* in, int i)
+{
+    return (flzuint8)(in[i >> 2] >> ((i & 3) << 3));
+}
+
+/*
+ * Parse the header of a match starting at control byte ctrl. Advances ip past
+ * the match's length and distance bytes, and writes the total number of bytes
+ * the match produces and how far back it references
+ */
+static FASTLZ_INLINE void ICACHE_FLASH_ATTR fastlz_parse_match(const flzuint32* in, int level,
+        flzuint32 ctrl, int* ip, flzuint32* len, flzuint32* dist)
+{
+    flzuint32 ofs = (ctrl & 31) << 8;
+    flzuint32 code;
+
+    (*len) = (ctrl >> 5) - 1;
+    if ((*len) == 7 - 1)
+    {
+        if(level == 1)
+        {
+            (*len) += fastlz_read_byte(in, (*ip)++);
+        }
+        else
+        {
+            do
+            {
+                code = fastlz_read_byte(in, (*ip)++);
+                (*len) += code;
+            } while (code == 255);
+        }
+    }
+    code = fastlz_read_byte(in, (*ip)++);
+    (*dist) = ofs + code + 1;
+
+    /* match from 16-bit distance, level 2 only */
+    if(level == 2 && FASTLZ_UNEXPECT_CONDITIONAL(code == 255) && ofs == (31 << 8))
+    {
+        ofs = fastlz_read_byte(in, (*ip)++) << 8;
+        ofs += fastlz_read_byte(in, (*ip)++);
+        (*dist) = ofs + 8191 + 1;
+    }
+
+    /* a match always copies at least three bytes */
+    (*len) += 3;
+}
+
+int ICACHE_FLASH_ATTR fastlz_max_distance(const void* input, int length)
+{
+    const flzuint32* in = (const flzuint32*) input;
+    int level = (fastlz_read_byte(in, 0) >> 5) + 1;
+    flzuint32 ctrl = fastlz_read_byte(in, 0) & 31;
+    int ip = 1;
+    flzuint32 maxDist = 0;
+
+    if(level > 2)
+    {
+        return 0;
+    }
+
+    for(;;)
+    {
+        if(ctrl >= 32)
+        {
+            flzuint32 len, dist;
+            fastlz_parse_match(in, level, ctrl, &ip, &len, &dist);
+            if(dist > maxDist)
+            {
+                maxDist = dist;
+            }
+        }
+        else
+        {
+            /* skip over the literal run */
+            ip += ctrl + 1;
+        }
+
+        if(ip >= length)
+        {
+            break;
+        }
+        ctrl = fastlz_read_byte(in, ip++);
+    }
+
+    return maxDist;
+}
+
+int ICACHE_FLASH_ATTR fastlz_decompress_stream(const void* input, int length, void* output, int maxout,
+        void* window, int windowLen, int xorOutput)
+{
+    const flzuint32* in = (const flzuint32*) input;
+    flzuint8* op = (flzuint8*) output;
+    flzuint8* wp = (flzuint8*) window;
+    int level = (fastlz_read_byte(in, 0) >> 5) + 1;
+    flzuint32 ctrl = fastlz_read_byte(in, 0) & 31;
+    int ip = 1;
+    int opos = 0;
+    int wpos = 0;
+
+    if(level > 2 || windowLen <= 0)
+    {
+        return 0;
+    }
+
+    for(;;)
+    {
+        flzuint32 len;
+        flzuint8 b;
+        if(ctrl >= 32)
+        {
+            flzuint32 dist;
+            int rpos;
+            fastlz_parse_match(in, level, ctrl, &ip, &len, &dist);
+
+#ifdef FASTLZ_SAFE
+            if (FASTLZ_UNEXPECT_CONDITIONAL(ip > length) ||
+                    FASTLZ_UNEXPECT_CONDITIONAL(opos + (int)len > maxout) ||
+                    FASTLZ_UNEXPECT_CONDITIONAL((int)dist > opos) ||
+                    FASTLZ_UNEXPECT_CONDITIONAL((int)dist > windowLen))
+            {
+                return 0;
+            }
+#endif
+
+            /* copy from the reference in the window, byte by byte so runs
+             * which overlap themselves are handled */
+            rpos = wpos - dist;
+            if(rpos < 0)
+            {
+                rpos += windowLen;
+            }
+            for(; len; --len)
+            {
+                b = wp[rpos];
+                if(++rpos == windowLen)
+                {
+                    rpos = 0;
+                }
+                wp[wpos] = b;
+                if(++wpos == windowLen)
+                {
+                    wpos = 0;
+                }
+                if(xorOutput)
+                {
+                    op[opos++] ^= b;
+                }
+                else
+                {
+                    op[opos++] = b;
+                }
+            }
+        }
+        else
+        {
+            len = ctrl + 1;
+#ifdef FASTLZ_SAFE
+            if (FASTLZ_UNEXPECT_CONDITIONAL(opos + (int)len > maxout) ||
+                    FASTLZ_UNEXPECT_CONDITIONAL(ip + (int)len > length))
+            {
+                return 0;
+            }
+#endif
+
+            /* copy the literal run */
+            for(; len; --len)
+            {
+                b = fastlz_read_byte(in, ip++);
+                wp[wpos] = b;
+                if(++wpos == windowLen)
+                {
+                    wpos = 0;
+                }
+                if(xorOutput)
+                {
+                    op[opos++] ^= b;
+                }
+                else
+                {
+                    op[opos++] = b;
+                }
+            }
+        }
+
+        if(ip >= length)
+        {
+            break;
+        }
+        ctrl = fastlz_read_byte(in, ip++);
+    }
+
+    return opos;
+}
+
 #else /* !defined(FASTLZ_COMPRESSOR) && !defined(FASTLZ_DECOMPRESSOR) */
 
 static FASTLZ_INLINE int ICACHE_FLASH_ATTR FASTLZ_DECOMPRESSOR(const void* input, int length, void* output, int maxout)
@@ -72,6 +72,41 @@ extern "C" {
 
 int ICACHE_FLASH_ATTR fastlz_decompress(const void* input, int length, void* output, int maxout);
 
+/**
+  Scan a block of compressed data without decompressing it and return the
+  largest back-reference distance used by any match, i.e. the smallest history
+  window fastlz_decompress_stream() can decompress this block with. Returns 0
+  if the block only contains literal runs.
+
+  The input is read one aligned 32-bit word at a time, so it may point
+  directly into memory-mapped flash.
+ */
+
+int ICACHE_FLASH_ATTR fastlz_max_distance(const void* input, int length);
+
+/**
+  Decompress a block of compressed data without a full size output buffer
+  for the decompressed data. Each decompressed byte is either written to
+  output, or XORed into output if xorOutput is non-zero, as soon as it is
+  decoded. This applies a delta frame directly on top of the previous frame.
+
+  Back-references are resolved from the window, a ring buffer of windowLen
+  bytes which holds the most recently decompressed bytes. windowLen must be
+  at least fastlz_max_distance() for this block. When not XORing, the window
+  may be the output buffer itself if windowLen is equal to maxout.
+
+  The input is read one aligned 32-bit word at a time, so it may point
+  directly into memory-mapped flash and does not need to be copied to RAM.
+
+  Returns the size of the decompressed block, or 0 if the compressed data is
+  corrupted, the output buffer is not large enough, or the window is too
+  small. Note that output may already be partially modified when 0 is
+  returned.
+ */
+
+int ICACHE_FLASH_ATTR fastlz_decompress_stream(const void* input, int length, void* output, int maxout,
+        void* window, int windowLen, int xorOutput);
+
 /**
   Compress a block of data in the input buffer and returns the size of
   compressed block. The size of input buffer is specified by length. The
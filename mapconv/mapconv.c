@@ -1,9 +1,51 @@
+/*
+ * mapconv.c
+ *
+ * Converts the raycaster's map images to binary map assets, which are packed
+ * into assets.bin and loaded by raycasterSetMap() in mode_raycaster.c
+ *
+ * Maps are laid out as 32 bit words
+ *   uint32_t w | (h << 16)
+ *   uint32_t numSpawns
+ *   uint32_t minX | (minY << 8) | (maxX << 16) | (maxY << 24)
+ *   uint32_t rleLen
+ *   uint32_t pvsRange
+ *   numSpawns * { uint32_t x | (y << 16) }
+ *   rleLen bytes of run length encoded tiles, padded to 32 bits
+ *   uint32_t numPvsRows
+ *   w * h uint16_t PVS row indices, two per word, low half first, padded to 32 bits
+ *   numPvsRows * { PVS_WORDS maybe visible words, PVS_WORDS always visible words }
+ *
+ * Each RLE byte is a 4 bit tile in the low nibble and the run length minus one
+ * in the high nibble. Tiles are in the order of MAP_TILE(x, y), x major. Each
+ * image row is an x, so the map is stored in the same order it used to be
+ * printed as a C array. The bounds are the smallest box which contains every
+ * wall, column and spawn point. Spawns are listed in tile order
+ *
+ * The potentially visible set (PVS) follows the tiles. Every cell has a PVS row,
+ * but most rows are the same as another cell's, so each distinct row is only
+ * stored once and every cell has the index of its row, in the same order as
+ * the tiles. A row is two bitmaps of the cells up to pvsRange away on
+ * either axis. A bit in the first is set if any point in this cell may see any
+ * point in the other cell. A bit in the second is set if every point in this
+ * cell sees every point in the other cell. Visibility is symmetric, so only
+ * offsets with dy > 0, or dy == 0 and dx > 0, are stored. The bit for an
+ * offset is (dx - 1) when dy == 0, or pvsRange + ((dy - 1) * (2 * pvsRange + 1))
+ * + (dx + pvsRange) otherwise. Bits are LSB first in each word
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
 #include "math.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+// Keep this in sync with mode_raycaster.c
 typedef enum
 {
     WMT_W1 = 0,
@@ -14,9 +56,23 @@ typedef enum
     WMT_S  = 5,
 } WorldMapTile_t;
 
-void processMapImage(char * fname);
+#define MAX_RUN 16
+
+// Keep this in sync with RAY_PVS_RANGE in mode_raycaster.c
+#define PVS_RANGE     6
+#define PVS_BITS      (((2 * PVS_RANGE + 1) * PVS_RANGE) + PVS_RANGE)
+#define PVS_WORDS     ((PVS_BITS + 31) / 32)
+#define PVS_SAMPLES   5
 
-int main (void)
+void processMapImage(const char* fname, const char* outDir);
+void writeU32(FILE* fp, uint32_t val);
+bool isWall(const uint8_t* tiles, int mapW, int mapH, int x, int y);
+bool checkLineOfSight(const uint8_t* tiles, int mapW, int mapH, float sX, float sY, float pX, float pY);
+bool checkHullIsClear(const uint8_t* tiles, int mapW, int mapH, int aX, int aY, int dX, int dY);
+void computePvs(const uint8_t* tiles, int mapW, int mapH, uint32_t* pvs);
+int dedupPvs(uint32_t* pvs, int numCells, uint16_t* rowIdxs);
+
+int main (int argc, char** argv)
 {
     // Generate a texture with a sin wave
     // uint8_t bmp[48 * 48] = {0};
@@ -33,21 +89,289 @@ int main (void)
     // }
     // stbi_write_bmp("sin.bmp", 48, 48, 1, bmp);
 
-    processMapImage("map_s.png");
-    processMapImage("map_m.png");
-    processMapImage("map_l.png");
+    // Write the binary maps to the firmware's assets unless told otherwise
+    const char* outDir = (argc > 1) ? argv[1] : "../firmware/assets";
+
+    processMapImage("map_s.png", outDir);
+    processMapImage("map_m.png", outDir);
+    processMapImage("map_l.png", outDir);
     return 0;
 }
 
-void processMapImage(char * fname)
+/**
+ * Write a little endian 32 bit word
+ *
+ * @param fp  The file to write to
+ * @param val The word to write
+ */
+void writeU32(FILE* fp, uint32_t val)
+{
+    uint8_t bytes[4] = {val & 0xFF, (val >> 8) & 0xFF, (val >> 16) & 0xFF, (val >> 24) & 0xFF};
+    fwrite(bytes, sizeof(bytes), 1, fp);
+}
+
+/**
+ * Check if a map cell blocks sight. Cells out of bounds are walls
+ *
+ * @param tiles The map, indexed by y + (x * mapH)
+ * @param mapW  The map's width
+ * @param mapH  The map's height
+ * @param x     The cell's x coordinate
+ * @param y     The cell's y coordinate
+ * @return true if the cell is a wall or column, false if it is open
+ */
+bool isWall(const uint8_t* tiles, int mapW, int mapH, int x, int y)
+{
+    if(x < 0 || x >= mapW || y < 0 || y >= mapH)
+    {
+        return true;
+    }
+    return tiles[y + (x * mapH)] <= WMT_C;
+}
+
+/**
+ * Check for walls between two points with the same DDA as
+ * checkWallsBetweenPoints() in mode_raycaster.c
+ *
+ * @param tiles The map, indexed by y + (x * mapH)
+ * @param mapW  The map's width
+ * @param mapH  The map's height
+ * @param sX    The X position to look at
+ * @param sY    The Y position to look at
+ * @param pX    The X position to look from
+ * @param pY    The Y position to look from
+ * @return true if there is a clear line between the points, false otherwise
+ */
+bool checkLineOfSight(const uint8_t* tiles, int mapW, int mapH, float sX, float sY, float pX, float pY)
+{
+    if(((int)sX == (int)pX) && ((int)sY == (int)pY))
+    {
+        return true;
+    }
+
+    float rayDirX = sX - pX;
+    float rayDirY = sY - pY;
+    int mapX = (int)pX;
+    int mapY = (int)pY;
+    float deltaDistX = fabsf(1 / rayDirX);
+    float deltaDistY = fabsf(1 / rayDirY);
+    int stepX = (rayDirX < 0) ? -1 : 1;
+    int stepY = (rayDirY < 0) ? -1 : 1;
+    float sideDistX = (rayDirX < 0) ? (pX - mapX) * deltaDistX : (mapX + 1.0 - pX) * deltaDistX;
+    float sideDistY = (rayDirY < 0) ? (pY - mapY) * deltaDistY : (mapY + 1.0 - pY) * deltaDistY;
+
+    // The walk can't be longer than the window, but don't trust float math
+    for(int steps = 0; steps < 4 * (PVS_RANGE + 2); steps++)
+    {
+        if(sideDistX < sideDistY)
+        {
+            sideDistX += deltaDistX;
+            mapX += stepX;
+        }
+        else
+        {
+            sideDistY += deltaDistY;
+            mapY += stepY;
+        }
+
+        if(isWall(tiles, mapW, mapH, mapX, mapY))
+        {
+            return false;
+        }
+        else if(mapX == (int)sX && mapY == (int)sY)
+        {
+            return true;
+        }
+    }
+    // Missed the target cell, so call it visible to be safe
+    return true;
+}
+
+/**
+ * Check if every line between two cells is clear. The lines between two unit
+ * squares sweep out their convex hull, which has edges along the axes and
+ * along the offset between the cells. A wall is outside the hull if it is
+ * separated from the hull along one of those axes
+ *
+ * @param tiles The map, indexed by y + (x * mapH)
+ * @param mapW  The map's width
+ * @param mapH  The map's height
+ * @param aX    The first cell's x coordinate
+ * @param aY    The first cell's y coordinate
+ * @param dX    The offset to the second cell's x coordinate
+ * @param dY    The offset to the second cell's y coordinate
+ * @return true if no wall touches the inside of the hull, false otherwise
+ */
+bool checkHullIsClear(const uint8_t* tiles, int mapW, int mapH, int aX, int aY, int dX, int dY)
+{
+    int minX = (dX < 0) ? aX + dX : aX;
+    int maxX = (dX < 0) ? aX : aX + dX;
+    int minY = (dY < 0) ? aY + dY : aY;
+    int maxY = (dY < 0) ? aY : aY + dY;
+
+    // Project the first cell's corners on the normal of the offset. The second
+    // cell projects to the same interval
+    int nX = -dY;
+    int nY = dX;
+    int hullMin = 0, hullMax = 0;
+    for(int c = 0; c < 4; c++)
+    {
+        int proj = (nX * (aX + (c & 1))) + (nY * (aY + (c >> 1)));
+        hullMin = (0 == c || proj < hullMin) ? proj : hullMin;
+        hullMax = (0 == c || proj > hullMax) ? proj : hullMax;
+    }
+
+    // Every wall in the bounding box must be outside the hull
+    for(int x = minX; x <= maxX; x++)
+    {
+        for(int y = minY; y <= maxY; y++)
+        {
+            if(!isWall(tiles, mapW, mapH, x, y))
+            {
+                continue;
+            }
+
+            int wallMin = 0, wallMax = 0;
+            for(int c = 0; c < 4; c++)
+            {
+                int proj = (nX * (x + (c & 1))) + (nY * (y + (c >> 1)));
+                wallMin = (0 == c || proj < wallMin) ? proj : wallMin;
+                wallMax = (0 == c || proj > wallMax) ? proj : wallMax;
+            }
+            if(wallMax > hullMin && wallMin < hullMax)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Compute the potentially visible set for every cell in the map. Cells which
+ * may see each other are found by sampling points in both cells. Cells which
+ * always see each other are found exactly by checkHullIsClear()
+ *
+ * @param tiles The map, indexed by y + (x * mapH)
+ * @param mapW  The map's width
+ * @param mapH  The map's height
+ * @param pvs   Zeroed output, 2 * PVS_WORDS words per cell in tile order
+ */
+void computePvs(const uint8_t* tiles, int mapW, int mapH, uint32_t* pvs)
+{
+    // Sample points are inset from the cell edges so they stay in the cell
+    static const float samples[PVS_SAMPLES] = {0.01f, 0.25f, 0.5f, 0.75f, 0.99f};
+
+    for(int aX = 0; aX < mapW; aX++)
+    {
+        for(int aY = 0; aY < mapH; aY++)
+        {
+            uint32_t* maybe = &pvs[(aY + (aX * mapH)) * 2 * PVS_WORDS];
+            uint32_t* always = &maybe[PVS_WORDS];
+            if(isWall(tiles, mapW, mapH, aX, aY))
+            {
+                continue;
+            }
+
+            for(int dY = 0; dY <= PVS_RANGE; dY++)
+            {
+                for(int dX = -PVS_RANGE; dX <= PVS_RANGE; dX++)
+                {
+                    if(0 == dY && dX <= 0)
+                    {
+                        continue;
+                    }
+                    int bX = aX + dX;
+                    int bY = aY + dY;
+                    if(isWall(tiles, mapW, mapH, bX, bY))
+                    {
+                        continue;
+                    }
+
+                    int bit = (0 == dY) ? (dX - 1) : PVS_RANGE + ((dY - 1) * (2 * PVS_RANGE + 1)) + (dX + PVS_RANGE);
+                    if(checkHullIsClear(tiles, mapW, mapH, aX, aY, dX, dY))
+                    {
+                        maybe[bit / 32] |= (1U << (bit % 32));
+                        always[bit / 32] |= (1U << (bit % 32));
+                        continue;
+                    }
+
+                    // Look for any clear line between sample points
+                    bool visible = false;
+                    for(int s = 0; s < PVS_SAMPLES * PVS_SAMPLES && !visible; s++)
+                    {
+                        for(int p = 0; p < PVS_SAMPLES * PVS_SAMPLES && !visible; p++)
+                        {
+                            visible = checkLineOfSight(tiles, mapW, mapH,
+                                                       bX + samples[s % PVS_SAMPLES], bY + samples[s / PVS_SAMPLES],
+                                                       aX + samples[p % PVS_SAMPLES], aY + samples[p / PVS_SAMPLES]);
+                        }
+                    }
+                    if(visible)
+                    {
+                        maybe[bit / 32] |= (1U << (bit % 32));
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Only keep one copy of each distinct PVS row. Walls, and open cells far from
+ * walls, mostly share rows
+ *
+ * @param pvs      2 * PVS_WORDS words per cell, compacted in place to the
+ *                 distinct rows
+ * @param numCells The number of cells
+ * @param rowIdxs  Output, the index of each cell's row
+ * @return The number of distinct rows
+ */
+int dedupPvs(uint32_t* pvs, int numCells, uint16_t* rowIdxs)
+{
+    const int rowLen = 2 * PVS_WORDS;
+    int numRows = 0;
+    for(int i = 0; i < numCells; i++)
+    {
+        int r;
+        for(r = 0; r < numRows; r++)
+        {
+            if(0 == memcmp(&pvs[r * rowLen], &pvs[i * rowLen], rowLen * sizeof(uint32_t)))
+            {
+                break;
+            }
+        }
+        if(r == numRows)
+        {
+            memmove(&pvs[r * rowLen], &pvs[i * rowLen], rowLen * sizeof(uint32_t));
+            numRows++;
+        }
+        rowIdxs[i] = r;
+    }
+    return numRows;
+}
+
+/**
+ * Convert a map image to tiles, print them as a C array, and write them as a
+ * binary map asset with the same name and a .rmp extension
+ *
+ * @param fname  The image to convert
+ * @param outDir The directory to write the binary map to
+ */
+void processMapImage(const char* fname, const char* outDir)
 {
     int w, h, n;
-    unsigned char* data = stbi_load(fname, &w, &h, &n, 0);
+    unsigned char* data = stbi_load(fname, &w, &h, &n, 3);
     if(NULL != data)
     {
         printf("%d by %d (%d)\n", w, h, n);
         int spawns = 0;
 
+        // Rows are x, columns are y
+        uint8_t tiles[h][w];
+        uint32_t spawnList[w * h];
+        int minX = h, minY = w, maxX = -1, maxY = -1;
+
         int dataIdx = 0;
         for (int y = 0; y < h; y++)
         {
@@ -58,40 +382,119 @@ void processMapImage(char * fname)
                 int g = (data[dataIdx++]);
                 int b = (data[dataIdx++]);
 
+                WorldMapTile_t tile;
                 if(r == 0xFF && g == 0xFF && b == 0xFF)
                 {
-                    printf("%d, ", WMT_E); // Empty
+                    tile = WMT_E; // Empty
                 }
                 else if(r == 0x80 && g == 0x80 && b == 0x80)
                 {
-                    spawns++;
-                    printf("%d, ", WMT_S); // Spawn
+                    spawnList[spawns++] = y | (x << 16);
+                    tile = WMT_S; // Spawn
                 }
                 else if(r == 0xFF)
                 {
-                    printf("%d, ", WMT_W1); // Wall 1
+                    tile = WMT_W1; // Wall 1
                 }
                 else if(g == 0xFF)
                 {
-                    printf("%d, ", WMT_W2); // Wall 2
+                    tile = WMT_W2; // Wall 2
                 }
                 else if(b == 0xFF)
                 {
-                    printf("%d, ", WMT_W3); // Wall 3
+                    tile = WMT_W3; // Wall 3
                 }
                 else
                 {
-                    printf("%d, ", WMT_C); // Column
+                    tile = WMT_C; // Column
+                }
+                printf("%d, ", tile);
+                tiles[y][x] = tile;
+
+                if(WMT_E != tile)
+                {
+                    minX = (y < minX) ? y : minX;
+                    maxX = (y > maxX) ? y : maxX;
+                    minY = (x < minY) ? x : minY;
+                    maxY = (x > maxY) ? x : maxY;
                 }
             }
             printf("},\n");
         }
         printf("\n");
         printf("%d spawns\n", spawns);
-        // ... process data if not NULL ...
-        // ... x = width, y = height, n = # 8-bit components per pixel ...
-        // ... replace "0" with "1".."4" to force that many components per pixel
-        // ... but "n" will always be the number that it would have been if you said 0
         stbi_image_free(data);
+
+        // Run length encode the tiles
+        uint8_t rle[w * h];
+        int rleLen = 0;
+        const uint8_t* tile = &tiles[0][0];
+        for(int i = 0; i < w * h;)
+        {
+            int run = 1;
+            while(i + run < w * h && run < MAX_RUN && tile[i + run] == tile[i])
+            {
+                run++;
+            }
+            rle[rleLen++] = ((run - 1) << 4) | tile[i];
+            i += run;
+        }
+
+        // Find which cells can see each other
+        uint32_t* pvs = calloc(w * h * 2 * PVS_WORDS, sizeof(uint32_t));
+        if(NULL == pvs)
+        {
+            fprintf(stderr, "Could not allocate the PVS\n");
+            return;
+        }
+        computePvs(&tiles[0][0], h, w, pvs);
+        uint16_t rowIdxs[w * h + 1];
+        int numPvsRows = dedupPvs(pvs, w * h, rowIdxs);
+        rowIdxs[w * h] = 0;
+
+        // Write the binary map
+        const char* base = strrchr(fname, '/');
+        base = (NULL != base) ? base + 1 : fname;
+        const char* ext = strrchr(base, '.');
+        int stemLen = (NULL != ext) ? (int)(ext - base) : (int)strlen(base);
+        char outName[512];
+        snprintf(outName, sizeof(outName), "%s/%.*s.rmp", outDir, stemLen, base);
+        FILE* fp = fopen(outName, "wb");
+        if(NULL == fp)
+        {
+            fprintf(stderr, "Could not write %s\n", outName);
+            free(pvs);
+            return;
+        }
+        writeU32(fp, h | (w << 16));
+        writeU32(fp, spawns);
+        writeU32(fp, (minX & 0xFF) | ((minY & 0xFF) << 8) | ((maxX & 0xFF) << 16) | ((maxY & 0xFF) << 24));
+        writeU32(fp, rleLen);
+        writeU32(fp, PVS_RANGE);
+        for(int i = 0; i < spawns; i++)
+        {
+            writeU32(fp, spawnList[i]);
+        }
+        fwrite(rle, rleLen, 1, fp);
+        while(rleLen % 4)
+        {
+            fputc(0, fp);
+            rleLen++;
+        }
+        long pvsStart = ftell(fp);
+        writeU32(fp, numPvsRows);
+        for(int i = 0; i < w * h; i += 2)
+        {
+            writeU32(fp, rowIdxs[i] | (rowIdxs[i + 1] << 16));
+        }
+        for(int i = 0; i < numPvsRows * 2 * PVS_WORDS; i++)
+        {
+            writeU32(fp, pvs[i]);
+        }
+        free(pvs);
+        long fileLen = ftell(fp);
+        fclose(fp);
+        printf("%s, %ld bytes, %ld of them the PVS with %d distinct rows\n", outName, fileLen, fileLen - pvsStart,
+               numPvsRows);
     }
-}
\ No newline at end of file
+}